@@ -0,0 +1,441 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Implementation of the API in "aperiodic.h": arrival generation, sporadic
+ * tasks and aperiodic servers.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+#include "time_utils.h"
+#include "task.h"
+#include "taskset.h"
+#include "aperiodic.h"
+
+
+const char *server_policy_string(int policy) {
+  switch (policy) {
+    case SERVER_POLLING:        return "polling";
+    case SERVER_DEFERRABLE:     return "deferrable";
+    case SERVER_SPORADIC:       return "sporadic";
+    default:                    return "ERROR-NO_SUCH_SERVER";
+  }
+}
+
+
+/****** ARRIVALS ******/
+
+static int arrival_cmp(const void *a, const void *b) {
+  long long x = *(const long long *) a;
+  long long y = *(const long long *) b;
+  return (x > y) - (x < y);
+}
+
+/* documented in header file */
+int arrivals_load(struct taskset *ts, FILE *f) {
+  char *line = NULL;    /* pointer to the line buffer */
+  size_t len = 0;       /* size of alloccated line buffer */
+  int lineno = 0;
+  int id;
+  double time_ms;
+  struct arrivals *a;
+
+  while (getline(&line, &len, f) != -1) {
+    lineno ++;
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+
+    if (sscanf(line, "%d %lf", &id, &time_ms) != 2
+        || id < 0 || id >= ts->tasks_count || time_ms < 0
+        || (ts->tasks[id].kind != TASK_SPORADIC
+            && ts->tasks[id].kind != TASK_APERIODIC)) {
+      printf_log(LOG_WARNING,
+          "Arrivals file, line %d: invalid arrival, skipping it.\n", lineno);
+      continue;
+    }
+
+    a = &ts->tasks[id].arrivals;
+    a->replay = realloc(a->replay, (a->replay_len + 1) * sizeof(long long));
+    if (a->replay == NULL) {
+      printf_log(LOG_ERROR, "Out of memory while reading arrivals.\n");
+      exit(1);
+    }
+    a->replay[a->replay_len ++] = time_ms * 1000000;
+  }
+
+  if (line) free(line);
+  fclose(f);
+
+  for (id = 0; id < ts->tasks_count; id++) {
+    a = &ts->tasks[id].arrivals;
+    if (a->replay != NULL) {
+      qsort(a->replay, a->replay_len, sizeof(long long), arrival_cmp);
+      printf_log(LOG_INFO, "Replaying %d arrival[s] for T%d\n",
+          a->replay_len, id);
+    }
+  }
+
+  return 0;
+}
+
+/** Compute the arrival following the current one */
+static void arrivals_next(struct task *task) {
+  struct arrivals *a = &task->arrivals;
+  struct timespec prev;
+  double u;
+
+  time_cpy(&prev, &a->next);
+
+  if (a->replay != NULL) {
+    if (a->replay_next >= a->replay_len) {
+      a->exhausted = true;
+      return;
+    }
+    time_cpy(&a->next, &task->ts->t0);
+    time_add_ns(&a->next, a->replay[a->replay_next ++]);
+
+    /* Enforce the minimum inter-arrival time */
+    time_add_ns(&prev, a->min_gap);
+    if (time_cmp(&a->next, &prev) < 0)
+      time_cpy(&a->next, &prev);
+  }
+  else {
+    u = erand48(a->xsubi);
+    time_add_ns(&a->next,
+        a->min_gap - (a->avg_gap - a->min_gap) * log(1.0 - u));
+  }
+}
+
+/** Initialize the arrivals of the task and compute the first one */
+static void arrivals_start(struct task *task) {
+  struct arrivals *a = &task->arrivals;
+
+  a->min_gap = task->period * 1000000LL;
+  a->avg_gap = task->avg_interarrival * 1000000LL;
+  a->xsubi[0] = options.seed & 0xffff;
+  a->xsubi[1] = (options.seed >> 16) & 0xffff;
+  a->xsubi[2] = task->id;
+  a->replay_next = 0;
+  a->exhausted = false;
+
+  time_cpy(&a->next, &task->ts->t0);
+  if (a->replay != NULL) {
+    a->min_gap = 0;  /* the first replayed arrival has no predecessor */
+    arrivals_next(task);
+    a->min_gap = task->period * 1000000LL;
+  }
+  else {
+    time_add_ms(&a->next, task->phase);
+  }
+}
+
+
+/**
+ * Sleep until the given time, waking up every ARRIVAL_MAX_SLEEP ms to check
+ * whether the task was instructed to quit.
+ * Return false if it was.
+ */
+static bool sleep_until(struct task *task, const struct timespec *t) {
+  struct timespec now;
+  struct timespec step;
+
+  while (! task->quit) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (time_cmp(&now, t) >= 0)
+      return true;
+
+    time_cpy(&step, &now);
+    time_add_ms(&step, ARRIVAL_MAX_SLEEP);
+    if (time_cmp(&step, t) > 0)
+      time_cpy(&step, t);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &step, NULL);
+  }
+  return false;
+}
+
+/** Sleep until the task is instructed to quit */
+static void wait_quit(struct task *task) {
+  struct timespec t;
+
+  while (! task->quit) {
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    time_add_ms(&t, ARRIVAL_MAX_SLEEP);
+    sleep_until(task, &t);
+  }
+}
+
+
+/****** SPORADIC TASKS ******/
+
+/* documented in header file */
+void sporadic_loop(struct task *task) {
+  struct timespec now;
+  int skipped;
+
+  arrivals_start(task);
+
+  while (! task->arrivals.exhausted) {
+    if (! sleep_until(task, &task->arrivals.next))
+      break;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    time_cpy(&task->rel, &task->arrivals.next);
+    time_cpy(&task->dl, &task->rel);
+    time_add_ms(&task->dl, task->deadline);
+
+    task_record_activation(task, time_diff_ns(&now, &task->rel));
+    task_job(task);
+    arrivals_next(task);
+
+    if (options.overrun_policy == OVERRUN_SKIP) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      for (skipped = 0; ! task->arrivals.exhausted
+          && time_cmp(&now, &task->arrivals.next) > 0; skipped++) {
+        arrivals_next(task);
+      }
+      if (skipped > 0) {
+        task->jobs += skipped;
+        task->skipped += skipped;
+        printf_log(LOG_INFO, "Overrun: skipping %d arrival%s\n",
+            skipped, (skipped == 1 ? "" : "s"));
+      }
+    }
+  }
+
+  wait_quit(task);
+}
+
+
+/****** SERVERS ******/
+
+/** Charge the server with the cpu time it consumed since the last call */
+static void server_account(struct task *task) {
+  struct server *srv = &task->server;
+  struct timespec cpu;
+  long long used;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+  used = time_diff_ns(&cpu, &srv->cpu_mark);
+  time_cpy(&srv->cpu_mark, &cpu);
+
+  srv->capacity -= used;
+  if (srv->active)
+    srv->consumed += used;
+}
+
+/** Sporadic server: mark the beginning of an active period */
+static void server_activate(struct task *task) {
+  struct server *srv = &task->server;
+
+  if (srv->policy != SERVER_SPORADIC || srv->active)
+    return;
+
+  srv->active = true;
+  srv->consumed = 0;
+  clock_gettime(CLOCK_MONOTONIC, &srv->active_since);
+}
+
+/**
+ * Sporadic server: mark the end of an active period, scheduling the
+ * replenishment of the budget consumed one period after it started.
+ */
+static void server_deactivate(struct task *task) {
+  struct server *srv = &task->server;
+  int i;
+
+  if (srv->policy != SERVER_SPORADIC || ! srv->active)
+    return;
+
+  srv->active = false;
+  if (srv->consumed <= 0)
+    return;
+
+  if (srv->repl_len < SERVER_MAX_REPLENISHMENTS) {
+    i = (srv->repl_first + srv->repl_len) % SERVER_MAX_REPLENISHMENTS;
+    srv->repl_len ++;
+    srv->repl_amount[i] = 0;
+  }
+  else {
+    /* Queue full: postpone the last one, which is always safe */
+    i = (srv->repl_first + srv->repl_len - 1) % SERVER_MAX_REPLENISHMENTS;
+  }
+  time_cpy(&srv->repl_time[i], &srv->active_since);
+  time_add_ms(&srv->repl_time[i], task->period);
+  srv->repl_amount[i] += srv->consumed;
+  srv->consumed = 0;
+}
+
+/** Apply all the replenishments that are due */
+static void server_replenish(struct task *task) {
+  struct server *srv = &task->server;
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  if (srv->policy == SERVER_SPORADIC) {
+    while (srv->repl_len > 0
+        && time_cmp(&now, &srv->repl_time[srv->repl_first]) >= 0) {
+      srv->capacity += srv->repl_amount[srv->repl_first];
+      srv->repl_first = (srv->repl_first + 1) % SERVER_MAX_REPLENISHMENTS;
+      srv->repl_len --;
+    }
+    if (srv->capacity > task->budget * 1000000LL)
+      srv->capacity = task->budget * 1000000LL;
+  }
+  else {
+    while (time_cmp(&now, &srv->next_period) >= 0) {
+      srv->capacity = task->budget * 1000000LL;
+      time_add_ms(&srv->next_period, task->period);
+    }
+  }
+}
+
+/** Return the client with the earliest next arrival, or NULL if none */
+static struct task *server_next_client(struct task *task) {
+  struct task *best = NULL;
+  struct task *client;
+  int i;
+
+  for (i = 0; i < task->ts->tasks_count; i++) {
+    client = &task->ts->tasks[i];
+    if (client->kind != TASK_APERIODIC || client->host != task
+        || client->arrivals.exhausted)
+      continue;
+    if (best == NULL
+        || time_cmp(&client->arrivals.next, &best->arrivals.next) < 0)
+      best = client;
+  }
+  return best;
+}
+
+/**
+ * Suspend the server until its next replenishment or, if `for_arrival` and
+ * the server is not a polling one, until the next arrival if it comes first.
+ */
+static void server_wait(struct task *task, bool for_arrival) {
+  struct server *srv = &task->server;
+  struct timespec when;
+  bool found;
+  struct task *client;
+
+  if (srv->policy == SERVER_SPORADIC) {
+    found = (srv->repl_len > 0);
+    if (found)
+      time_cpy(&when, &srv->repl_time[srv->repl_first]);
+  }
+  else {
+    found = true;
+    time_cpy(&when, &srv->next_period);
+  }
+
+  if (for_arrival && srv->policy != SERVER_POLLING) {
+    client = server_next_client(task);
+    if (client != NULL
+        && (! found || time_cmp(&client->arrivals.next, &when) < 0)) {
+      time_cpy(&when, &client->arrivals.next);
+      found = true;
+    }
+  }
+
+  if (! found) {
+    clock_gettime(CLOCK_MONOTONIC, &when);
+    time_add_ms(&when, ARRIVAL_MAX_SLEEP);
+  }
+  sleep_until(task, &when);
+
+  server_replenish(task);
+}
+
+/* documented in header file */
+void server_budget_check(struct task *task) {
+  server_account(task);
+
+  while (task->server.capacity <= 0 && ! task->quit) {
+    printf_log(LOG_DEBUG, "Budget exhausted, suspending the job\n");
+    server_deactivate(task);
+    server_wait(task, false);
+    server_activate(task);
+  }
+}
+
+/* documented in header file */
+void server_loop(struct task *task) {
+  struct server *srv = &task->server;
+  struct task *client;
+  struct timespec now;
+  int i;
+
+  srv->policy = task->server_policy;
+  srv->capacity = 0;
+  srv->active = false;
+  srv->consumed = 0;
+  srv->repl_first = 0;
+  srv->repl_len = 0;
+
+  for (i = 0; i < task->ts->tasks_count; i++) {
+    if (task->ts->tasks[i].host == task)
+      arrivals_start(&task->ts->tasks[i]);
+  }
+
+  time_cpy(&srv->next_period, &task->ts->t0);
+  time_add_ms(&srv->next_period, task->phase);
+  if (sleep_until(task, &srv->next_period)) {
+    srv->capacity = task->budget * 1000000LL;
+    time_add_ms(&srv->next_period, task->period);
+  }
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &srv->cpu_mark);
+
+  while (! task->quit) {
+    server_replenish(task);
+    server_account(task);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    client = server_next_client(task);
+
+    if (client == NULL || time_cmp(&client->arrivals.next, &now) > 0) {
+      /* Nothing to do: a polling server discards its budget */
+      if (srv->policy == SERVER_POLLING)
+        srv->capacity = 0;
+      server_deactivate(task);
+      server_wait(task, true);
+      continue;
+    }
+
+    if (srv->capacity <= 0) {
+      server_deactivate(task);
+      server_wait(task, false);
+      continue;
+    }
+
+    server_activate(task);
+
+    time_cpy(&client->rel, &client->arrivals.next);
+    time_cpy(&client->dl, &client->rel);
+    task_record_activation(client, time_diff_ns(&now, &client->rel));
+    task_job(client);
+    arrivals_next(client);
+  }
+
+  for (i = 0; i < task->ts->tasks_count; i++) {
+    if (task->ts->tasks[i].host == task)
+      task->ts->tasks[i].done = true;
+  }
+}
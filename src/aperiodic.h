@@ -0,0 +1,111 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This module implements the activation of non-periodic tasks.
+ *
+ * Sporadic and aperiodic tasks are activated by a sequence of arrivals, which
+ * is either drawn from a seeded pseudo-random generator or replayed from the
+ * arrivals file (see `options.arrivals_name`).
+ * Generated inter-arrival times are the task's minimum inter-arrival time plus
+ * an exponentially-distributed amount, so that their average is
+ * `avg_interarrival`.
+ *
+ * Sporadic tasks run in their own thread. Aperiodic tasks, instead, have no
+ * thread: their jobs are executed by a server task (polling, deferrable or
+ * sporadic server), within the server's budget.
+ */
+
+#ifndef __APERIODIC_H__
+#define __APERIODIC_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+struct task;     /* can't include task.h, which needs the structs below */
+struct taskset;
+
+
+#ifndef SERVER_MAX_REPLENISHMENTS
+#define SERVER_MAX_REPLENISHMENTS 16
+#endif
+
+/* Tasks waiting for an arrival wake up at least this often to check `quit` */
+#ifndef ARRIVAL_MAX_SLEEP
+#define ARRIVAL_MAX_SLEEP 100
+#endif
+
+enum server_policy {
+  SERVER_POLLING,
+  SERVER_DEFERRABLE,
+  SERVER_SPORADIC
+};
+
+/** The sequence of arrivals of a sporadic or aperiodic task */
+struct arrivals {
+  long long min_gap;            /* minimum inter-arrival time [ns] */
+  long long avg_gap;            /* average inter-arrival time [ns] */
+  unsigned short xsubi[3];      /* state of the pseudo-random generator */
+  long long *replay;            /* arrival offsets from t0 [ns], or NULL */
+  int replay_len;               /* length of `replay` */
+  int replay_next;              /* index of the next replayed arrival */
+  bool exhausted;               /* no more arrivals (replay is over) */
+  struct timespec next;         /* time of the next (pending) arrival */
+};
+
+/** The budget-tracking state of a server task */
+struct server {
+  int policy;                   /* one of the SERVER_* constants */
+  long long capacity;           /* remaining budget [ns] */
+  struct timespec cpu_mark;     /* thread cpu time when last accounted */
+  struct timespec next_period;  /* next periodic replenishment (PS, DS) */
+
+  /* Sporadic server only */
+  bool active;                  /* whether the server is consuming budget */
+  struct timespec active_since; /* when the server last became active */
+  long long consumed;           /* budget consumed since `active_since` */
+  struct timespec repl_time[SERVER_MAX_REPLENISHMENTS];
+  long long repl_amount[SERVER_MAX_REPLENISHMENTS];
+  int repl_first;               /* index of the earliest replenishment */
+  int repl_len;                 /* number of pending replenishments */
+};
+
+/** Converts a SERVER_* constant to its corresponding string */
+const char *server_policy_string(int policy);
+
+/**
+ * Read the arrivals file and attach the replayed arrivals to the tasks of `ts`.
+ * Each non-empty line not starting with `#` is "<TASK_ID> <TIME>", with TIME
+ * in (possibly fractional) milliseconds since the taskset activation.
+ * Return 0 on success.
+ */
+int arrivals_load(struct taskset *ts, FILE *f);
+
+/** Main loop of a sporadic task, to be run in its own thread */
+void sporadic_loop(struct task *task);
+
+/** Main loop of a server task, to be run in its own thread */
+void server_loop(struct task *server);
+
+/**
+ * Account the budget consumed by the server since the last check and, if it
+ * is exhausted, suspend the calling (server) thread until it is replenished.
+ * Not to be called while holding a resource.
+ */
+void server_budget_check(struct task *server);
+
+#endif
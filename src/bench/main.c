@@ -0,0 +1,428 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Microbenchmarks of the hot paths of scheduletrace: recording events
+ * (tick_pp, trace_next and trace_next_add), printing them, and the GUI
+ * routines reading the trace (trace_snapshot, evt_preceding, get_load,
+ * disp_trace) or its index (trace_keyed_busy_ns).
+ *
+ * Each benchmark runs on synthetic traces of increasing size, and is repeated
+ * until it takes at least BENCH_MIN_TIME milliseconds. Results are written to
+ * stdout as CSV: benchmark name, INSTRUMENT_LEVEL of the build, trace size
+ * [events], iterations and average time per iteration [ns]. Each
+ * instrumentation level has its own variant binary, built by `scons bench`.
+ *
+ * Usage: scheduletrace-bench [MAX_EVENTS]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <allegro.h>
+
+#include "../common.h"
+#include "../taskset.h"
+#include "../time_utils.h"
+#include "../gui/internals.h"
+
+
+/* Minimum duration of each benchmark [ms] */
+#ifndef BENCH_MIN_TIME
+#define BENCH_MIN_TIME 200
+#endif
+
+/* Tasks of the synthetic tasksets */
+#ifndef BENCH_TASKS
+#define BENCH_TASKS 8
+#endif
+
+/* Time between two synthetic events [ns] */
+#ifndef BENCH_EVT_SPACING
+#define BENCH_EVT_SPACING 20000
+#endif
+
+/* Size of the off-screen frame [px] */
+#define BENCH_FRAME_W 1000
+#define BENCH_FRAME_H 400
+
+#define BENCH_MAX_THREADS 4
+
+/* A benchmarked function, running `n` iterations */
+typedef void (*bench_fn)(void *arg, unsigned long n);
+
+
+/**
+ * Run `fn` with increasing iteration counts until it takes BENCH_MIN_TIME,
+ * then print its result
+ */
+static void bench_run(const char *name, int size, bench_fn fn, void *arg) {
+  struct timespec start, end;
+  unsigned long n;
+  long long elapsed;
+
+  for (n = 1; ; n *= 2) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fn(arg, n);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = time_diff_ns(&end, &start);
+    if (elapsed >= BENCH_MIN_TIME * 1000000LL)
+      break;
+  }
+  printf("%s,%d,%d,%lu,%.1f\n", name, INSTRUMENT_LEVEL, size, n,
+      (double) elapsed / n);
+  fflush(stdout);
+}
+
+
+/**
+ * Initialize a taskset of BENCH_TASKS periodic tasks (without threads) and a
+ * trace with room for `size` events. If `fill`, the trace is filled with
+ * synthetic events, as if the taskset had run and was then stopped.
+ */
+static void synth_taskset(struct taskset *ts, int size, bool fill) {
+  struct trace_evt *evt;
+  struct timespec now;
+  int t, i;
+
+  options.trace_size = size + 1;
+  taskset_init(ts);
+  ts->tasks_count = BENCH_TASKS;
+  ts->tasks = calloc(BENCH_TASKS, sizeof(struct task));
+  assert(ts->tasks != NULL);
+  for (t = 0; t < BENCH_TASKS; t++) {
+    task_init(&ts->tasks[t]);
+    ts->tasks[t].id = t;
+    ts->tasks[t].ts = ts;
+    ts->tasks[t].period = 10 * (t + 1);
+    ts->tasks[t].deadline = ts->tasks[t].period;
+  }
+
+  ts->next_evt = trace_next(&ts->trace);
+  if (! fill)
+    return;
+
+  /* The trace ends one second ago */
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  time_cpy(&ts->t0, &now);
+  time_add_ns(&ts->t0, -1000000000LL - (long long) size * BENCH_EVT_SPACING);
+
+  for (i = 0; i < size; i++) {
+    evt = &ts->trace.events[i];
+    evt->valid = true;
+    evt->task = i % (BENCH_TASKS + 1) - 1;
+    evt->type = (i % 7 == 0 && evt->task >= 0) ? EVT_ACTIVATION : EVT_RUN;
+    evt->res = (i / (BENCH_TASKS + 1)) % 3;
+    evt->count = 100;
+    evt->job = i / (BENCH_TASKS + 1);
+    evt->arg = 0;
+    evt->tick = 1 + 100UL * i;
+    time_cpy(&evt->time, &ts->t0);
+    time_add_ns(&evt->time, (long long) i * BENCH_EVT_SPACING);
+  }
+  ts->trace.len = size - 1;
+  ts->tick = 1 + 100UL * size;
+  ts->activated = true;
+  ts->stopped = true;
+}
+
+static void synth_taskset_free(struct taskset *ts) {
+  free(ts->tasks);
+  trace_free(&ts->trace);
+  run_assert(0 == sem_destroy(&ts->task_lock));
+}
+
+/** Set up a GUI context showing the whole trace of `ts` in a frame */
+static void synth_guictx(struct guictx *ctx, struct taskset *ts) {
+  long duration_ms;
+
+  duration_ms = (long long) ts->trace.len * BENCH_EVT_SPACING / 1000000 + 1;
+  ctx->ts = ts;
+  trace_snapshot(&ts->trace, &ctx->snap);
+  ctx->exit = false;
+  ctx->dmiss = 0;
+  ctx->scale = (double) BENCH_FRAME_W / duration_ms;
+  ctx->disp_zero = 0;
+  ctx->px_offset = 0;
+  ctx->selected = &ts->tasks[0];
+  ctx->cpuload_window = duration_ms / 10 + 1;
+  ctx->redraw = true;
+  ctx->show_res = false;
+  lanes_init(ctx);
+  run_assert(lanes_update(ctx));
+}
+
+
+/****** RECORDING ******/
+
+/* Restart a trace which is about to fill up */
+static void trace_rewind(struct taskset *ts) {
+  if (ts->trace.len + 2 >= ts->trace.size) {
+    ts->trace.len = 0;
+    ts->next_evt = trace_next(&ts->trace);
+  }
+}
+
+/* tick_pp by a single task: events are merged, the trace does not grow */
+static void bench_tick_same(void *arg, unsigned long n) {
+  struct taskset *ts = arg;
+  unsigned long i;
+
+  for (i = 0; i < n; i++) {
+    taskset_lock(ts);
+    tick_pp(ts, 0, 0, EVT_RUN, &ts->tasks[0].last_tick);
+    taskset_unlock(ts);
+  }
+}
+
+/* tick_pp by alternating tasks: every tick adds an event */
+static void bench_tick_switch(void *arg, unsigned long n) {
+  struct taskset *ts = arg;
+  unsigned long i;
+  int t;
+
+  for (i = 0; i < n; i++) {
+    t = i & 1;
+    taskset_lock(ts);
+    trace_rewind(ts);
+    tick_pp(ts, t, 0, EVT_RUN, &ts->tasks[t].last_tick);
+    taskset_unlock(ts);
+  }
+}
+
+/* Argument of a thread of bench_tick_contended */
+struct contender {
+  struct taskset *ts;
+  int id;
+  unsigned long n;
+  pthread_t tid;
+};
+
+static void *contender_main(void *arg) {
+  struct contender *c = arg;
+  unsigned long i;
+
+  for (i = 0; i < c->n; i++) {
+    taskset_lock(c->ts);
+    trace_rewind(c->ts);
+    tick_pp(c->ts, c->id, 0, EVT_RUN, &c->ts->tasks[c->id].last_tick);
+    taskset_unlock(c->ts);
+  }
+  return NULL;
+}
+
+/* Argument of bench_tick_contended */
+struct contention {
+  struct taskset *ts;
+  int threads;
+};
+
+/* tick_pp by several threads contending for the task lock */
+static void bench_tick_contended(void *arg, unsigned long n) {
+  struct contention *c = arg;
+  struct contender threads[BENCH_MAX_THREADS];
+  int i;
+
+  for (i = 0; i < c->threads; i++) {
+    threads[i].ts = c->ts;
+    threads[i].id = i;
+    threads[i].n = n / c->threads;
+    run_assert(0 == pthread_create(&threads[i].tid, NULL, contender_main,
+          &threads[i]));
+  }
+  for (i = 0; i < c->threads; i++)
+    run_assert(0 == pthread_join(threads[i].tid, NULL));
+}
+
+/* Append events to the trace */
+static void bench_trace_add(void *arg, unsigned long n) {
+  struct taskset *ts = arg;
+  struct trace_evt *evt;
+  unsigned long i;
+
+  for (i = 0; i < n; i++) {
+    if (ts->trace.len + 2 >= ts->trace.size)
+      ts->trace.len = 0;
+    evt = trace_next(&ts->trace);
+    evt->type = EVT_RUN;
+    evt->task = i % BENCH_TASKS;
+    evt->count = 1;
+    evt->tick = i;
+    evt->valid = true;
+    trace_next_add(&ts->trace);
+  }
+}
+
+/* Print events to /dev/null */
+static void bench_evt_print(void *arg, unsigned long n) {
+  struct taskset *ts = arg;
+  unsigned long i;
+
+  for (i = 0; i < n; i++)
+    trace_evt_print(&ts->trace.events[i % (ts->trace.len + 1)]);
+}
+
+
+/****** GUI ******/
+
+/* Take a snapshot of the trace, with no concurrent writer */
+static void bench_trace_snapshot(void *arg, unsigned long n) {
+  struct guictx *ctx = arg;
+  unsigned long i;
+
+  for (i = 0; i < n; i++)
+    trace_snapshot(&ctx->ts->trace, &ctx->snap);
+}
+
+/* Look up the event preceding pseudo-random times */
+static void bench_evt_preceding(void *arg, unsigned long n) {
+  struct guictx *ctx = arg;
+  long duration;
+  unsigned long i;
+  volatile int sink;
+
+  duration = ctx->cpuload_window * 10;
+  for (i = 0; i < n; i++)
+    sink = evt_preceding(ctx, (i * 7919) % duration);
+  (void) sink;
+}
+
+/* Compute the busy time of a task in windows at pseudo-random times */
+static void bench_index_busy(void *arg, unsigned long n) {
+  struct guictx *ctx = arg;
+  const struct trace_keyed *k;
+  struct timespec from, to;
+  long duration;
+  unsigned long i;
+  volatile long long sink;
+
+  k = trace_index_task(&ctx->index, 0);
+  duration = ctx->cpuload_window * 10;
+  for (i = 0; i < n; i++) {
+    time_cpy(&from, &ctx->ts->t0);
+    time_add_ms(&from, (i * 7919) % duration);
+    time_cpy(&to, &from);
+    time_add_ms(&to, ctx->cpuload_window);
+    sink = trace_keyed_busy_ns(k, &ctx->ts->trace, ctx->snap.len, &from, &to);
+  }
+  (void) sink;
+}
+
+/* Compute the cpu load for every pixel of a frame */
+static void bench_get_load(void *arg, unsigned long n) {
+  struct guictx *ctx = arg;
+  unsigned long i;
+  int px;
+  volatile double sink;
+
+  for (i = 0; i < n; i++) {
+    for (px = 0; px < BENCH_FRAME_W; px++)
+      sink = get_load(ctx, px / ctx->scale + ctx->disp_zero);
+  }
+  (void) sink;
+}
+
+/* Argument of bench_disp_trace */
+struct frame {
+  struct guictx *ctx;
+  BITMAP *bmp;
+};
+
+/* Draw the whole trace, with its static parts, into an off-screen bitmap */
+static void bench_disp_trace(void *arg, unsigned long n) {
+  struct frame *f = arg;
+  struct dirty_rect dirty = {0, 0, -1, -1};
+  unsigned long i;
+
+  for (i = 0; i < n; i++) {
+    disp_trace_static(f->ctx, f->bmp);
+    disp_trace(f->ctx, f->bmp, &dirty);
+  }
+}
+
+
+int main(int argc, char **argv) {
+  struct taskset ts;
+  struct guictx ctx;
+  struct contention contention;
+  struct frame frame;
+  char name[32];
+  int max_size, size;
+
+  max_size = 1000000;
+  if (argc > 1 && (sscanf(argv[1], "%d", &max_size) < 1 || max_size < 10)) {
+    fprintf(stderr, "Usage: %s [MAX_EVENTS]\n", argv[0]);
+    exit(1);
+  }
+
+  options.verbosity = LOG_WARNING;
+  options.logfile = stderr;
+  options.logfile_sync = false;
+  options.tracefile = NULL;
+
+  install_allegro(SYSTEM_NONE, &errno, atexit);
+  set_color_depth(16);
+  resource_colors_init();
+  frame.ctx = &ctx;
+  frame.bmp = create_bitmap(BENCH_FRAME_W, BENCH_FRAME_H);
+  if (frame.bmp == NULL) {
+    printf_log(LOG_ERROR, "Can't create the off-screen bitmap.\n");
+    exit(1);
+  }
+
+  printf("benchmark,level,events,iterations,ns_per_op\n");
+
+  for (size = 1000; size <= max_size; size *= 10) {
+    synth_taskset(&ts, size, false);
+    bench_run("tick_pp_same_task", size, bench_tick_same, &ts);
+    bench_run("tick_pp_new_event", size, bench_tick_switch, &ts);
+    contention.ts = &ts;
+    for (contention.threads = 2; contention.threads <= BENCH_MAX_THREADS;
+        contention.threads *= 2) {
+      snprintf(name, sizeof(name), "tick_pp_contended_%d",
+          contention.threads);
+      bench_run(name, size, bench_tick_contended, &contention);
+    }
+    bench_run("trace_next_add", size, bench_trace_add, &ts);
+    synth_taskset_free(&ts);
+
+    synth_taskset(&ts, size, true);
+    synth_guictx(&ctx, &ts);
+    options.tracefile = fopen("/dev/null", "w");
+    if (options.tracefile == NULL) {
+      printf_log_perror(LOG_WARNING, errno, "Not measuring trace_evt_print: "
+          "can't open /dev/null: ");
+    }
+    else {
+      bench_run("trace_evt_print", size, bench_evt_print, &ts);
+      fclose(options.tracefile);
+      options.tracefile = NULL;
+    }
+    bench_run("trace_snapshot", size, bench_trace_snapshot, &ctx);
+    bench_run("evt_preceding", size, bench_evt_preceding, &ctx);
+    bench_run("trace_index_busy", size, bench_index_busy, &ctx);
+    bench_run("get_load_frame", size, bench_get_load, &ctx);
+    bench_run("disp_trace_frame", size, bench_disp_trace, &frame);
+    lanes_free(&ctx);
+    synth_taskset_free(&ts);
+  }
+
+  destroy_bitmap(frame.bmp);
+  allegro_exit();
+  return 0;
+}
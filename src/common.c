@@ -17,7 +17,6 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <pthread.h>
-#include <semaphore.h>
 
 #include "common.h"
 
@@ -25,32 +24,36 @@
 /* Global options instance */
 struct options options;
 
+/* documented in header file */
+const char *loglevel_string(enum loglevel level) {
+  switch(level) {
+    case LOG_ERROR:     return "Error: ";
+    case LOG_WARNING:   return "Warning: ";
+    case LOG_INFO:      return "Info: ";
+    case LOG_DEBUG:     return "Debug: ";
+    default:            return "";
+  }
+}
+
 /* A printf-like function for logging, to be called using the provided macros */
 void printf_log_nosync(enum loglevel level, int e, const char *fmt, ...) {
   va_list args;
+
+  va_start(args, fmt);
+  vprintf_log_nosync(level, e, fmt, args);
+  va_end(args);
+}
+
+/* documented in header file */
+void vprintf_log_nosync(enum loglevel level, int e, const char *fmt,
+    va_list args) {
   char tname[16];
 
   if (level <= options.verbosity) {
     pthread_getname_np(pthread_self(), tname, 16);
-    fprintf(options.logfile, "%6s: ", tname);
+    fprintf(options.logfile, "%6s: %s", tname, loglevel_string(level));
 
-    switch(level) {
-      case LOG_ERROR:
-        fprintf(options.logfile, "Error: ");
-        break;
-      case LOG_WARNING:
-        fprintf(options.logfile, "Warning: ");
-        break;
-      case LOG_INFO:
-        fprintf(options.logfile, "Info: ");
-        break;
-      case LOG_DEBUG:
-        fprintf(options.logfile, "Debug: ");
-        break;
-    }
-    va_start(args, fmt);
     vfprintf(options.logfile, fmt, args);
-    va_end(args);
 
     if (e > 0) {
         errno = e;
@@ -63,3 +66,14 @@ void printf_log_nosync(enum loglevel level, int e, const char *fmt, ...) {
   }
 }
 
+/* documented in header file */
+void logfile_lock(void) {
+  if (options.logfile_sync)
+    run_assert(0 == pthread_mutex_lock(&options.logfile_mutex));
+}
+
+/* documented in header file */
+void logfile_unlock(void) {
+  if (options.logfile_sync)
+    run_assert(0 == pthread_mutex_unlock(&options.logfile_mutex));
+}
@@ -26,13 +26,26 @@
 
 #include <stdbool.h>
 #include <stdio.h>
-#include <semaphore.h>
+#include <stdarg.h>
+#include <pthread.h>
 #include <assert.h>
 #include <errno.h>
 #include <sched.h>
 
 enum loglevel {LOG_ERROR=-1, LOG_WARNING=0, LOG_INFO=1, LOG_DEBUG=2};
 
+/**
+ * How much the hot path (tick_pp and its callers) records, fixed at compile
+ * time so that disabled paths compile to nothing:
+ *  0: counters only (ticks, job records and statistics), no trace events;
+ *  1: trace events as well;
+ *  2: trace events, debug messages and assertions.
+ * The variant binaries are built by defining it (see src/SConscript).
+ */
+#ifndef INSTRUMENT_LEVEL
+#define INSTRUMENT_LEVEL 2
+#endif
+
 /* typedef enum {false, true} bool; */ /* removed, now using stdbool */
 
 
@@ -40,20 +53,30 @@ enum loglevel {LOG_ERROR=-1, LOG_WARNING=0, LOG_INFO=1, LOG_DEBUG=2};
  * Similar to `assert` but _always_ executes the expression
  */
 #define run_assert(expr) \
-  do { if (! expr) assert(false); } while (0)
+  do { if (! (expr)) assert(false); } while (0)
+
+/**
+ * An `assert` on the hot path: also compiled out below INSTRUMENT_LEVEL 2
+ */
+#if INSTRUMENT_LEVEL >= 2
+#define hot_assert(expr) assert(expr)
+#else
+#define hot_assert(expr) ((void) 0)
+#endif
 
 
 /**
  * A synchronized printf-like macro with an extra `loglevel` argument 
  * printf_log(enum loglevel level, const char *fmt, ...) 
+ * Info and debug messages of threads registered with the logger are queued
+ * and written asynchronously (see logger.h).
+ * Below INSTRUMENT_LEVEL 2, debug messages are compiled out.
  */
 #define printf_log(level, ...) \
   do { \
-    if (level <= options.verbosity) { \
-      if (options.logfile_sync) run_assert(0==sem_wait(&options.logfile_sem)); \
-      printf_log_nosync(level, 0, __VA_ARGS__); \
-      if (options.logfile_sync) run_assert(0==sem_post(&options.logfile_sem)); \
-    } \
+    if ((INSTRUMENT_LEVEL >= 2 || (level) != LOG_DEBUG) \
+        && level <= options.verbosity) \
+      printf_log_write(level, __VA_ARGS__); \
   } while (0)
 
 
@@ -65,9 +88,9 @@ enum loglevel {LOG_ERROR=-1, LOG_WARNING=0, LOG_INFO=1, LOG_DEBUG=2};
   do { \
     int errno_cache = e;  /* emulate call by value, so one can pass `errno` */ \
     if (level <= options.verbosity) { \
-      if (options.logfile_sync) run_assert(0==sem_wait(&options.logfile_sem)); \
+      logfile_lock(); \
       printf_log_nosync(level, errno_cache, __VA_ARGS__); \
-      if (options.logfile_sync) run_assert(0==sem_post(&options.logfile_sem)); \
+      logfile_unlock(); \
     } \
   } while (0)
 
@@ -75,6 +98,27 @@ enum loglevel {LOG_ERROR=-1, LOG_WARNING=0, LOG_INFO=1, LOG_DEBUG=2};
 /* it is not advisable to call this directly: use the macros, instead */
 void printf_log_nosync(enum loglevel level, int e, const char *fmt, ...);
 
+/* Same as printf_log_nosync, with a `va_list` */
+void vprintf_log_nosync(enum loglevel level, int e, const char *fmt,
+    va_list args);
+
+/**
+ * Take (release) `options.logfile_mutex`, if `options.logfile_sync`: for
+ * writing to the log file without interleaving with other threads.
+ */
+void logfile_lock(void);
+void logfile_unlock(void);
+
+/**
+ * Queue the message if the calling thread is registered with the logger and
+ * the level is LOG_INFO or LOG_DEBUG, otherwise write it synchronously.
+ * Implemented in logger.c: use the macros, instead.
+ */
+void printf_log_write(enum loglevel level, const char *fmt, ...);
+
+/* Return the prefix of messages of the given level, e.g. "Error: " */
+const char *loglevel_string(enum loglevel level);
+
 
 /**
  * A struct for holding global settings and variables.
@@ -85,15 +129,41 @@ struct options {
   bool          with_gui;
   FILE*         logfile;
   bool          logfile_sync;   /* Whether to use atomic writes to logfile */
-  sem_t         logfile_sem;    /* For implementing atomic writes to logfile */
+  pthread_mutex_t logfile_mutex; /* For atomic writes to logfile (priority
+                                   inheriting, as RT tasks take it too) */
   char*         taskfile_name;
   FILE*         taskfile;
   char*         tracefile_name;  
+  char*         arrivals_name;  /* Arrival times to replay, or NULL */
+  FILE*         arrivals_file;
+  unsigned long seed;           /* Seed for generated arrivals */
   FILE*         tracefile;
   bool          tracefile_flush;
   bool          logfile_flush;
 
   int           mutex_protocol; /* Protocol for shared resources' locks */
+  bool          lock_bench;     /* Whether to compare protocols at start */
+  int           overrun_policy; /* One of the OVERRUN_* constants (task.h) */
+  bool          release_engine; /* Whether to release periodic jobs from the
+                                   release engine (release.h) */
+  bool          with_mlock;     /* Whether to lock and prefault memory */
+  int           stack_size;     /* Stack size of task threads [KiB] */
+  int           trace_size;     /* Maximum number of trace events */
+  char*         jobs_name;      /* Where to export job metrics, or NULL */
+  int           jobs_size;      /* Job records kept per task */
+  char*         hist_name;      /* Where to export histograms, or NULL */
+  char*         shm_name;       /* Shared-memory ring to publish, or NULL */
+  long          duration;       /* Duration of headless runs [ms] */
+  bool          compare_protocols;      /* Run once per mutex protocol */
+  char*         run_dir;        /* Directory of tasksets to run, or NULL */
+  cpu_set_t     run_cpus;       /* CPUs available to the runner */
+  char*         out_dir;        /* Output directory of the runner */
+  char*         gen_dir;        /* Where to generate tasksets, or NULL */
+  char*         gen_params;     /* Generation parameters (generator.h) */
+  double        probe_max;      /* Maximum probe effect, 0 not to measure it */
+  int           timer_backend;  /* One of the TIMER_* constants (periodic.h) */
+  long          timer_slack;    /* Timer slack [ns] of tasks, -1 to keep */
+  long          timer_spin;     /* Spinning time [us] of TIMER_HYBRID */
   bool          with_affinity;  /* Whether to set tasks cpu affinity */
   cpu_set_t     task_cpuset;    /* The 1-sized cpuset to be used by tasks */
   bool          idle_yield;     /* Whether the idle task should yield() */
@@ -102,6 +172,11 @@ struct options {
 
   int           gui_w;          /* Width of the GUI window */
   int           gui_h;          /* Height of the GUI window */
+  int           gui_max_fps;    /* Maximum frame rate of the GUI [Hz] */
+  bool          gui_res_lanes;  /* Whether to show the resource lanes */
+  char*         render_name;    /* Image to render the trace to, or NULL */
+  long          render_from;    /* Time range of the image [ms] */
+  long          render_to;      /* (-1 for the end of the trace) */
 };
 
 extern struct options options;
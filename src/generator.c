@@ -0,0 +1,383 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "generator.h"
+#include "task.h"
+#include "common.h"
+
+
+/** A generated task */
+struct gen_task {
+  unsigned int period;          /* [ms] */
+  unsigned int deadline;        /* [ms] */
+  unsigned int priority;
+  double util;
+  unsigned long ops;            /* total operations of a job */
+  int res;                      /* resource of the critical section, or 0 */
+  unsigned long cs_ops;         /* operations in the critical section */
+};
+
+
+/* documented in header file */
+void gen_params_init(struct gen_params *gp) {
+  gp->count = 100;
+  gp->tasks = 5;
+  gp->util = 0.5;
+  gp->period_min = 10;
+  gp->period_max = 1000;
+  gp->period_dist = GEN_PERIOD_LOGUNIFORM;
+  gp->deadline_min = 1.0;
+  gp->resources = 0;
+  gp->cs_ratio = 0.1;
+  gp->prio = GEN_PRIO_RM;
+  gp->ops_per_ms = 0.0;
+  gp->seed = 1;
+}
+
+
+/* documented in header file */
+int gen_params_parse(struct gen_params *gp, const char *str) {
+  char key[16], val[32];
+  int n;
+
+  while (*str != '\0') {
+    n = -1;
+    sscanf(str, "%15[a-z]=%31[^,]%n", key, val, &n);
+    if (n < 0) {
+      printf_log(LOG_ERROR, "Invalid generator parameters: %s\n", str);
+      return -1;
+    }
+    str += n;
+    if (*str == ',')
+      str++;
+
+    if (strcmp(key, "count") == 0)
+      n = (sscanf(val, "%d", &gp->count) == 1 && gp->count > 0);
+    else if (strcmp(key, "tasks") == 0)
+      n = (sscanf(val, "%d", &gp->tasks) == 1 && gp->tasks > 0);
+    else if (strcmp(key, "util") == 0)
+      n = (sscanf(val, "%lf", &gp->util) == 1 && gp->util > 0);
+    else if (strcmp(key, "periods") == 0)
+      n = (sscanf(val, "%u-%u", &gp->period_min, &gp->period_max) == 2
+          && gp->period_min > 0 && gp->period_min <= gp->period_max);
+    else if (strcmp(key, "dist") == 0) {
+      n = 1;
+      if (strcmp(val, "loguniform") == 0)
+        gp->period_dist = GEN_PERIOD_LOGUNIFORM;
+      else if (strcmp(val, "harmonic") == 0)
+        gp->period_dist = GEN_PERIOD_HARMONIC;
+      else
+        n = 0;
+    }
+    else if (strcmp(key, "dl") == 0)
+      n = (sscanf(val, "%lf", &gp->deadline_min) == 1
+          && gp->deadline_min > 0 && gp->deadline_min <= 1);
+    else if (strcmp(key, "res") == 0)
+      n = (sscanf(val, "%d", &gp->resources) == 1 && gp->resources >= 0);
+    else if (strcmp(key, "cs") == 0)
+      n = (sscanf(val, "%lf", &gp->cs_ratio) == 1
+          && gp->cs_ratio >= 0 && gp->cs_ratio <= 1);
+    else if (strcmp(key, "prio") == 0) {
+      n = 1;
+      if (strcmp(val, "RM") == 0)
+        gp->prio = GEN_PRIO_RM;
+      else if (strcmp(val, "DM") == 0)
+        gp->prio = GEN_PRIO_DM;
+      else
+        n = 0;
+    }
+    else if (strcmp(key, "ops") == 0)
+      n = (sscanf(val, "%lf", &gp->ops_per_ms) == 1 && gp->ops_per_ms > 0);
+    else
+      n = 0;
+
+    if (! n) {
+      printf_log(LOG_ERROR, "Invalid generator parameter: %s=%s\n", key, val);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+/** Write the generation parameters as a header comment of a taskset file */
+static void gen_params_print(FILE *f, const struct gen_params *gp, int index) {
+  fprintf(f, "# Generated by scheduletrace: seed=%lu index=%d\n",
+      gp->seed, index);
+  fprintf(f, "# tasks=%d,util=%g,periods=%u-%u,dist=%s,dl=%g,res=%d,cs=%g,"
+      "prio=%s,ops=%.0f\n", gp->tasks, gp->util, gp->period_min,
+      gp->period_max,
+      gp->period_dist == GEN_PERIOD_HARMONIC ? "harmonic" : "loguniform",
+      gp->deadline_min, gp->resources, gp->cs_ratio,
+      gp->prio == GEN_PRIO_DM ? "DM" : "RM", gp->ops_per_ms);
+}
+
+
+/**
+ * Draw the utilizations of the tasks with UUniFast, discarding draws where a
+ * task exceeds 1. Return 0 on success.
+ */
+static int uunifast_discard(struct gen_task *tasks, int n, double util,
+    unsigned short xsubi[3]) {
+  double sum, next;
+  int i, tries;
+
+  for (tries = 0; tries < GEN_MAX_TRIES; tries++) {
+    sum = util;
+    for (i = 0; i < n - 1; i++) {
+      next = sum * pow(erand48(xsubi), 1.0 / (n - i - 1));
+      tasks[i].util = sum - next;
+      sum = next;
+    }
+    tasks[n - 1].util = sum;
+
+    for (i = 0; i < n && tasks[i].util <= 1.0; i++)
+      ;
+    if (i == n)
+      return 0;
+  }
+  return -1;
+}
+
+
+/** Draw a period according to `gp->period_dist` [ms] */
+static unsigned int draw_period(const struct gen_params *gp,
+    unsigned short xsubi[3]) {
+  double lo, hi;
+  int steps;
+
+  if (gp->period_dist == GEN_PERIOD_HARMONIC) {
+    steps = (int) floor(log2((double) gp->period_max / gp->period_min));
+    return gp->period_min << (int) (erand48(xsubi) * (steps + 1));
+  }
+
+  lo = log(gp->period_min);
+  hi = log(gp->period_max + 1.0);
+  return (unsigned int) fmin(exp(lo + erand48(xsubi) * (hi - lo)),
+      gp->period_max);
+}
+
+
+/** Priority key of a task: the shorter, the higher the priority */
+static unsigned int prio_key(const struct gen_params *gp,
+    const struct gen_task *task) {
+  return (gp->prio == GEN_PRIO_DM) ? task->deadline : task->period;
+}
+
+
+/** A task with its priority key, for sorting by priority */
+struct prio_rank {
+  unsigned int key;
+  int task;
+};
+
+/** Order by decreasing key (i.e. increasing priority), then by task */
+static int prio_rank_cmp(const void *a, const void *b) {
+  const struct prio_rank *x = a;
+  const struct prio_rank *y = b;
+
+  if (x->key != y->key)
+    return (x->key > y->key) ? -1 : 1;
+  return x->task - y->task;
+}
+
+
+/**
+ * Assign RM or DM priorities in [GEN_PRIO_MIN, GEN_PRIO_MAX]: tasks with the
+ * same key share the priority and, if there are more distinct keys than
+ * priority levels, neighbouring keys are merged. Return 0 on success.
+ */
+static int assign_priorities(const struct gen_params *gp,
+    struct gen_task *tasks, int n) {
+  const int levels = GEN_PRIO_MAX - GEN_PRIO_MIN + 1;
+  struct prio_rank *order;
+  int i, rank, distinct;
+
+  order = malloc(n * sizeof(struct prio_rank));
+  if (order == NULL) {
+    printf_log(LOG_ERROR, "Out of memory.\n");
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    order[i].key = prio_key(gp, &tasks[i]);
+    order[i].task = i;
+  }
+  qsort(order, n, sizeof(struct prio_rank), prio_rank_cmp);
+
+  distinct = 0;
+  for (i = 0; i < n; i++) {
+    if (i == 0 || order[i].key != order[i - 1].key)
+      distinct++;
+  }
+
+  /* rank = number of distinct keys longer than the task's */
+  rank = -1;
+  for (i = 0; i < n; i++) {
+    if (i == 0 || order[i].key != order[i - 1].key)
+      rank++;
+    tasks[order[i].task].priority = GEN_PRIO_MIN
+      + (distinct > levels ? rank * levels / distinct : rank);
+  }
+
+  free(order);
+  return 0;
+}
+
+
+/** Generate the tasks of a taskset. Return 0 on success. */
+static int generate_taskset(const struct gen_params *gp,
+    struct gen_task *tasks, unsigned short xsubi[3]) {
+  double exec_ms;
+  int i;
+
+  if (uunifast_discard(tasks, gp->tasks, gp->util, xsubi) != 0) {
+    printf_log(LOG_ERROR, "Can't draw %d task utilizations summing to %g with "
+        "none above 1.\n", gp->tasks, gp->util);
+    return -1;
+  }
+
+  for (i = 0; i < gp->tasks; i++) {
+    tasks[i].period = draw_period(gp, xsubi);
+    exec_ms = tasks[i].util * tasks[i].period;
+
+    tasks[i].deadline = tasks[i].period;
+    if (gp->deadline_min < 1.0) {
+      tasks[i].deadline = (unsigned int) fmax(ceil(exec_ms),
+          tasks[i].period * (gp->deadline_min
+            + erand48(xsubi) * (1.0 - gp->deadline_min)));
+      if (tasks[i].deadline == 0)
+        tasks[i].deadline = 1;
+    }
+
+    tasks[i].ops = (unsigned long) fmax(1.0, exec_ms * gp->ops_per_ms);
+    tasks[i].res = 0;
+    tasks[i].cs_ops = 0;
+    if (gp->resources > 0) {
+      tasks[i].res = 1 + (int) (erand48(xsubi) * gp->resources);
+      tasks[i].cs_ops = (unsigned long) (tasks[i].ops * gp->cs_ratio);
+    }
+  }
+
+  return assign_priorities(gp, tasks, gp->tasks);
+}
+
+
+/** Write a generated task in the syntax of task_init_str() */
+static void gen_task_print(FILE *f, const struct gen_task *task) {
+  unsigned long before, after;
+
+  fprintf(f, "T=%u,D=%u,pr=%u,ph=0,[", task->period, task->deadline,
+      task->priority);
+  if (task->cs_ops == 0) {
+    fprintf(f, "(R0,%lu)", task->ops);
+  }
+  else {
+    /* the critical section is in the middle of the job */
+    before = (task->ops - task->cs_ops) / 2;
+    after = task->ops - task->cs_ops - before;
+    if (before > 0)
+      fprintf(f, "(R0,%lu)", before);
+    fprintf(f, "(R%d,%lu)", task->res, task->cs_ops);
+    if (after > 0)
+      fprintf(f, "(R0,%lu)", after);
+  }
+  fprintf(f, "]\n");
+}
+
+
+/**
+ * Set the erand48 state of taskset `index` to the splitmix64 of the seed and
+ * the index, so that every bit of both changes the taskset.
+ */
+static void taskset_state(unsigned long seed, int index,
+    unsigned short xsubi[3]) {
+  uint64_t z;
+
+  z = (uint64_t) seed ^ (uint64_t) index * 0x9e3779b97f4a7c15ull;
+  z += 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  z ^= z >> 31;
+
+  xsubi[0] = z & 0xffff;
+  xsubi[1] = (z >> 16) & 0xffff;
+  xsubi[2] = (z >> 32) & 0xffff;
+}
+
+
+/* documented in header file */
+int generate_tasksets(struct gen_params *gp, const char *dir) {
+  struct gen_task *tasks;
+  unsigned short xsubi[3];
+  char name[PATH_MAX];
+  FILE *f;
+  int i, t;
+
+  if (gp->ops_per_ms <= 0) {
+    printf_log(LOG_INFO, "Calibrating operations per millisecond...\n");
+    gp->ops_per_ms = task_calibrate(GEN_CALIBRATION_MS);
+  }
+  printf_log(LOG_INFO, "Generating %d tasksets into \"%s\", %.0f operations "
+      "per ms.\n", gp->count, dir, gp->ops_per_ms);
+
+  if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+    printf_log_perror(LOG_ERROR, errno, "Error while creating directory "
+        "\"%s\": ", dir);
+    return -1;
+  }
+
+  tasks = malloc(gp->tasks * sizeof(struct gen_task));
+  if (tasks == NULL) {
+    printf_log(LOG_ERROR, "Out of memory.\n");
+    return -1;
+  }
+
+  for (i = 0; i < gp->count; i++) {
+    taskset_state(gp->seed, i, xsubi);
+    if (generate_taskset(gp, tasks, xsubi) != 0)
+      break;
+
+    snprintf(name, sizeof(name), "%s/ts-%04d", dir, i);
+    f = fopen(name, "w");
+    if (f == NULL) {
+      printf_log_perror(LOG_ERROR, errno, "Error while opening file \"%s\": ",
+          name);
+      break;
+    }
+    gen_params_print(f, gp, i);
+    for (t = 0; t < gp->tasks; t++)
+      gen_task_print(f, &tasks[t]);
+    if (fclose(f) != 0) {
+      printf_log(LOG_ERROR, "Error while writing \"%s\".\n", name);
+      break;
+    }
+  }
+
+  free(tasks);
+  if (i < gp->count)
+    return -1;
+  printf_log(LOG_INFO, "Generated %d tasksets.\n", gp->count);
+  return 0;
+}
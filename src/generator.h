@@ -0,0 +1,99 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This module generates synthetic periodic tasksets, written as taskset files.
+ *
+ * Task utilizations are drawn with UUniFast (UUniFast-Discard when the total
+ * utilization exceeds 1, so that no task exceeds 1), periods are either
+ * log-uniform or harmonic (powers of two times the minimum period), and
+ * constrained deadlines are drawn uniformly in [dl * T, T].
+ * A job's execution time is converted to section operations using the
+ * measured (or given) number of operations per millisecond: a share of it can
+ * be spent in a critical section on a randomly chosen shared resource.
+ * Priorities are assigned by Rate Monotonic or Deadline Monotonic.
+ *
+ * Each taskset is generated from its own 48-bit erand48 state, a hash
+ * (splitmix64) of all the 64 bits of the base seed and of its index: both are
+ * recorded in the header comment of the file, together with all the other
+ * generation parameters.
+ */
+
+#ifndef __GENERATOR_H__
+#define __GENERATOR_H__
+
+/* Range of the assigned priorities, between the GUI and the release engine */
+#ifndef GEN_PRIO_MIN
+#define GEN_PRIO_MIN 3
+#endif
+#ifndef GEN_PRIO_MAX
+#define GEN_PRIO_MAX 97
+#endif
+
+/* UUniFast-Discard gives up after this many discarded draws */
+#ifndef GEN_MAX_TRIES
+#define GEN_MAX_TRIES 1000
+#endif
+
+/* Duration of the calibration of operations per millisecond [ms] */
+#ifndef GEN_CALIBRATION_MS
+#define GEN_CALIBRATION_MS 200
+#endif
+
+enum gen_period_dist {
+  GEN_PERIOD_LOGUNIFORM,
+  GEN_PERIOD_HARMONIC
+};
+
+enum gen_prio {
+  GEN_PRIO_RM,
+  GEN_PRIO_DM
+};
+
+/** Parameters of the generation */
+struct gen_params {
+  int count;                    /* number of tasksets */
+  int tasks;                    /* tasks per taskset */
+  double util;                  /* total utilization of each taskset */
+  unsigned int period_min;      /* [ms] */
+  unsigned int period_max;      /* [ms] */
+  int period_dist;              /* one of the GEN_PERIOD_* constants */
+  double deadline_min;          /* minimum D/T, 1 for implicit deadlines */
+  int resources;                /* number of shared resources (besides R0) */
+  double cs_ratio;              /* share of each job in a critical section */
+  int prio;                     /* one of the GEN_PRIO_* constants */
+  double ops_per_ms;            /* operations per ms, <= 0 to calibrate */
+  unsigned long seed;           /* base seed */
+};
+
+/** Set the default generation parameters */
+void gen_params_init(struct gen_params *gp);
+
+/**
+ * Parse a comma-separated list of KEY=VALUE into `gp`. Keys are count, tasks,
+ * util, periods (MIN-MAX), dist (loguniform or harmonic), dl, res, cs,
+ * prio (RM or DM) and ops.
+ * Return 0 on success.
+ */
+int gen_params_parse(struct gen_params *gp, const char *str);
+
+/**
+ * Generate `gp->count` tasksets into directory `dir` (created if needed),
+ * named ts-0000, ts-0001 and so on. Return 0 on success.
+ */
+int generate_tasksets(struct gen_params *gp, const char *dir);
+
+#endif
@@ -25,12 +25,12 @@
 #include "common.h"
 #include "taskset.h"
 
-#ifndef GUI_PERIOD
-#define GUI_PERIOD 20
+/* Default maximum frame rate [Hz]: the renderer checks for new events at
+ * this rate, and only draws if there are visible ones */
+#ifndef GUI_DEFAULT_MAX_FPS
+#define GUI_DEFAULT_MAX_FPS 50
 #endif
 
-#define GUI_DEADLINE GUI_PERIOD
-
 #ifndef GUI_THREAD_PRIORITY
 #define GUI_THREAD_PRIORITY 2
 #endif
@@ -54,6 +54,22 @@
  */
 void gui_run(struct taskset *ts);
 
+/**
+ * Like gui_run, on a replica of a taskset of another process (see
+ * scheduletrace-view), kept up to date by another thread of the caller:
+ * taskset operations are disabled, and the GUI thread runs at the caller's
+ * priority.
+ */
+void gui_view(struct taskset *ts);
+
+/**
+ * Render the trace of the given (stopped) taskset from options.render_from to
+ * options.render_to to a options.gui_w x options.gui_h PNG image, without a
+ * display.
+ * Return 0 on success, -1 on failure (logged).
+ */
+int gui_render(struct taskset *ts, const char *path);
+
 #define makegrey(x) makecol(x, x, x)
 
 #define COL_RED         makecol(255,   0,   0)
@@ -70,6 +86,11 @@ void gui_run(struct taskset *ts);
 #define TEXT_COL        makegrey(180)
 #define ACTIVATION_COL  COL_WHITE
 #define DEADLINE_COL    COL_RED
+#define DMISS_COL       COL_ORANGE
+#define COMPLETION_COL  makegrey(150)
+#define OTHERS_COL      makegrey(110)
+#define WAITING_COL     makegrey(200)
+#define HANDOFF_COL     COL_WHITE
 #define CPULOAD_BG_COL  makegrey( 30)
 #define CPULOAD_OK_COL  makecol(  0, 153,  51)
 #define CPULOAD_AVG_COL makecol(230,  92,   0)
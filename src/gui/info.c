@@ -14,22 +14,72 @@
  * limitations under the License.
  */
 
+#include <math.h>
+
+#include "../time_utils.h"
 #include "internals.h"
 
 
 #define LINE_SPACING 5
 
 
-static const char *mutex_protocol_str(int protocol) {
-  switch (protocol) {
-    case PTHREAD_PRIO_NONE:     return "NONE";
-    case PTHREAD_PRIO_PROTECT:  return "PROTECT";
-    case PTHREAD_PRIO_INHERIT:  return "INHERIT";
+static const char *overrun_policy_str(int policy) {
+  switch (policy) {
+    case OVERRUN_CONTINUE:      return "CONTINUE";
+    case OVERRUN_SKIP:          return "SKIP";
+    case OVERRUN_ABORT:         return "ABORT";
     default:                    return "?UNKNOWN?";
   }
 }
 
 
+/* Print p50, p99, p99.9 and max of a histogram, in microseconds */
+static int display_hist(BITMAP *area, int ypos, const char *label,
+    const struct histogram *h)
+{
+  if (h->count == 0) {
+    textprintf_ex(area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+        " %-9s --", label);
+  }
+  else {
+    textprintf_ex(area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+        " %-9s %7.0f %7.0f %7.0f %7.0f", label,
+        histogram_percentile(h, 50) / 1000.0,
+        histogram_percentile(h, 99) / 1000.0,
+        histogram_percentile(h, 99.9) / 1000.0,
+        histogram_percentile(h, 100) / 1000.0);
+  }
+  return ypos + text_height(font) + LINE_SPACING;
+}
+
+
+/**
+ * Return the fraction of the cpu used by `task` in the cpu load window ending
+ * with the last ended event, or NAN if unknown. Only the events of the task
+ * are looked at, through the index of the trace.
+ */
+static double cpu_share(struct guictx *ctx, struct task *task) {
+  struct timespec from;
+  const struct timespec *to;
+  long long window_ns;
+
+  if (ctx->snap.len < 2)
+    return NAN;
+
+  to = &ctx->ts->trace.events[ctx->snap.len - 1].time;
+  time_cpy(&from, to);
+  time_add_ms(&from, -ctx->cpuload_window);
+  if (time_cmp(&from, &ctx->ts->t0) < 0)
+    time_cpy(&from, &ctx->ts->t0);
+  window_ns = time_diff_ns(to, &from);
+  if (window_ns <= 0)
+    return NAN;
+
+  return (double) trace_keyed_busy_ns(trace_index_task(&ctx->index, task->id),
+      &ctx->ts->trace, ctx->snap.len, &from, to) / window_ns;
+}
+
+
 static const char *taskset_status_str(struct taskset *ts) {
   if (! ts->activated)                  return "READY";
   else if (! ts->stopped)               return "RUNNING";
@@ -43,8 +93,12 @@ void display_info(struct guictx *ctx, BITMAP *info_area) {
   int ypos;
   int lineheight;
   struct task *task;
+  struct timespec cputime, now;
+  long long elapsed_ns;
+  double share;
 
-  if (! ctx->redraw) {
+  /* While running, refresh the live statistics */
+  if (! ctx->redraw && ! taskset_isactive(ctx->ts)) {
     return;
   }
   printf_log(LOG_DEBUG, "Re-drawing info pane...\n");
@@ -65,17 +119,68 @@ void display_info(struct guictx *ctx, BITMAP *info_area) {
       "T%d:", task->id);
   ypos += lineheight;
 
-  textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
-      " T %u ms, D %u ms", task->period, task->deadline);
+  switch (task->kind) {
+    case TASK_SPORADIC:
+      textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+          " sporadic, MIT %u ms, avg %u ms", task->period,
+          task->avg_interarrival);
+      ypos += lineheight;
+      textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+          " D %u ms", task->deadline);
+      break;
+    case TASK_APERIODIC:
+      textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+          " aperiodic, avg %u ms", task->avg_interarrival);
+      ypos += lineheight;
+      textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+          " served by T%d", task->server_id);
+      break;
+    case TASK_SERVER:
+      textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+          " %s server", server_policy_string(task->server_policy));
+      ypos += lineheight;
+      textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+          " T %u ms, Q %u ms", task->period, task->budget);
+      break;
+    default:
+      textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+          " T %u ms, D %u ms", task->period, task->deadline);
+  }
   ypos += lineheight;
 
+  if (task->kind != TASK_APERIODIC) {
+    textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+        " priority %u, phase %u ms", task->priority, task->phase);
+    ypos += lineheight;
+  }
+
   textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
-      " priority %u, phase %u ms", task->priority, task->phase);
+      " deadline misses: %u", task->dmiss);
+  ypos += lineheight;
+
+  share = cpu_share(ctx, task);
+  if (isnan(share)) {
+    textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+        " cpu share: --");
+  }
+  else {
+    textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+        " cpu share: %.1f%% (last %ld ms)", 100 * share, ctx->cpuload_window);
+  }
   ypos += lineheight;
 
+  if (options.overrun_policy != OVERRUN_CONTINUE) {
+    textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+        " skipped %u, aborted %u", task->skipped, task->aborted);
+    ypos += lineheight;
+  }
+
   textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
-      " deadline misses: %u", task->dmiss);
+      " [us]          p50     p99   p99.9     max");
   ypos += lineheight;
+  ypos = display_hist(info_area, ypos, "response", &task->hist_response);
+  ypos = display_hist(info_area, ypos, "latency", &task->hist_latency);
+  ypos = display_hist(info_area, ypos, "blocking", &task->hist_blocking);
 
   textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
       " %u section%s:", task->sections_count,
@@ -100,7 +205,11 @@ void display_info(struct guictx *ctx, BITMAP *info_area) {
 
   /* Other info */
   textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
-      "Using \"%s\" mutex protocol",mutex_protocol_str(options.mutex_protocol));
+      "Using \"%s\" mutex protocol",mutex_protocol_string(options.mutex_protocol));
+  ypos += lineheight;
+
+  textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+      "Overrun policy: %s", overrun_policy_str(options.overrun_policy));
   ypos += lineheight;
 
   textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
@@ -111,6 +220,20 @@ void display_info(struct guictx *ctx, BITMAP *info_area) {
       "CPU load window: %ld", ctx->cpuload_window);
   ypos += lineheight;
 
+  /* The cost of the viewer itself */
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cputime);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed_ns = time_diff_ns(&now, &ctx->started);
+  textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+      "GUI: %.2f ms/frame (max %.2f), cpu %.1f%%", ctx->frame_ns / 1e6,
+      ctx->frame_max_ns / 1e6, elapsed_ns > 0 ? 100.0 *
+      (cputime.tv_sec * 1e9 + cputime.tv_nsec) / elapsed_ns : 0.0);
+  ypos += lineheight;
+
+  textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
+      "GUI: %lu frames, %lu deadline misses", ctx->frames, ctx->dmiss);
+  ypos += lineheight;
+
   textprintf_ex(info_area, font, GUI_MARGIN, ypos, TEXT_COL, -1,
       "[%s]", taskset_status_str(ctx->ts));
   ypos += lineheight;
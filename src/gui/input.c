@@ -29,11 +29,54 @@ static void get_keycodes(char *scan, char *ascii) {
 }
 
 
+/** Scroll the lanes, if needed, so that the lane of the task is shown */
+static void lane_show(struct guictx *ctx, int task_id) {
+  if (task_id < ctx->lane_top)
+    ctx->lane_top = task_id;
+  else if (task_id >= ctx->lane_top + ctx->lanes_shown)
+    ctx->lane_top = task_id - MAX(ctx->lanes_shown, 1) + 1;
+}
+
+
+/**
+ * Track the pointer, for the tooltip, and select the task of the event
+ * clicked on.
+ */
+static void get_mouse_input(struct guictx *ctx) {
+  const struct trace_evt *evt;
+  bool down;
+  int i;
+
+  if (mouse_needs_poll()) poll_mouse();
+
+  if (mouse_x != ctx->mouse_x || mouse_y != ctx->mouse_y) {
+    ctx->mouse_x = mouse_x;
+    ctx->mouse_y = mouse_y;
+    ctx->mouse_moved = true;
+  }
+
+  down = mouse_b & 1;
+  if (down && ! ctx->mouse_down) {
+    i = evt_at(ctx, ctx->mouse_x, ctx->mouse_y);
+    evt = (i >= 0) ? snap_evt(ctx, i) : NULL;
+    if (evt != NULL && evt->task >= 0) {
+      ctx->selected = &ctx->ts->tasks[evt->task];
+      ctx->redraw = true;
+      printf_log(LOG_DEBUG, "Clicked on event %d: T%d selected\n", i,
+          evt->task);
+    }
+  }
+  ctx->mouse_down = down;
+}
+
+
 void get_user_input(struct guictx *ctx) {
   char scan, ascii;
   int task_id;
 
-  if (keyboard_needs_poll()) run_assert(poll_keyboard());
+  get_mouse_input(ctx);
+
+  if (keyboard_needs_poll()) run_assert(0 == poll_keyboard());
 
   if (keypressed()) {
     ctx->redraw = true;
@@ -80,6 +123,11 @@ void get_user_input(struct guictx *ctx) {
       printf_log(LOG_DEBUG, "Pan to zero: origin now at %d\n", ctx->disp_zero);
     }
     /* TASKSET OPERATIONS */
+    else if (ctx->replica
+        && (scan == KEY_A || scan == KEY_S || scan == KEY_SPACE)) {
+      printf_log(LOG_INFO, "Viewing another process: its taskset can't be "
+          "operated from here.\n");
+    }
     else if (scan == KEY_A) {
       if (! ctx->ts->activated) {
         printf_log(LOG_INFO, "Activating taskset...\n");
@@ -116,10 +164,27 @@ void get_user_input(struct guictx *ctx) {
       task_id = (ctx->selected->id - 1) % ctx->ts->tasks_count;
       if (task_id < 0) task_id += ctx->ts->tasks_count;
       ctx->selected = &ctx->ts->tasks[task_id];
+      lane_show(ctx, task_id);
     }
     else if (scan == KEY_DOWN) {
       task_id = (ctx->selected->id + 1) % ctx->ts->tasks_count;
       ctx->selected = &ctx->ts->tasks[task_id];
+      lane_show(ctx, task_id);
+    }
+    /* SCROLL LANES (the layout keeps them in range) */
+    else if (scan == KEY_HOME) {
+      ctx->lane_top -= MAX(ctx->lanes_shown, 1);
+      printf_log(LOG_DEBUG, "Scroll up: first lane now T%d\n", ctx->lane_top);
+    }
+    else if (scan == KEY_END) {
+      ctx->lane_top += MAX(ctx->lanes_shown, 1);
+      printf_log(LOG_DEBUG, "Scroll down: first lane now T%d\n",
+          ctx->lane_top);
+    }
+    else if (scan == KEY_L) {
+      ctx->show_res = ! ctx->show_res;
+      printf_log(LOG_DEBUG, "Resource lanes %s\n",
+          ctx->show_res ? "shown" : "hidden");
     }
     /* OTHER */
     else if (scan == KEY_R || scan == KEY_F5) {
@@ -150,11 +215,15 @@ static const char help_lines[][HELP_LINE_LEN] = {
   " =   Default zoom",
   " UP  Select prev task",
   " DOWN  Select next task",
+  " HOME  Scroll lanes up",
+  " END   Scroll lanes down",
+  " L     Show/hide resources",
   " ",
   " PGDN  Scroll right 5x",
   " PGUP  Scroll left  5x",
   " SPACE Activate/Stop",
   " R     Refresh screen",
+  " CLICK Select task of event",
   "",
 };
 
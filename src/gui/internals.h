@@ -18,10 +18,14 @@
 #define __GUI_INTERNALS_H__
 
 #include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
 #include <allegro.h>
 
 #include "../common.h"
 #include "../taskset.h"
+#include "../trace_index.h"
+#include "../trace_holds.h"
 
 #include "../gui.h"
 
@@ -29,22 +33,90 @@
 #define GUI_DEFAULT_ZOOM (200.0 / 1000)  /* px/ms */
 #define GUI_PAN 50  /* px */
 #define GUI_MAX_TRACELINE_HEIGHT 100
+#define GUI_MIN_TRACELINE_HEIGHT 32  /* fits the markers; lanes scroll below */
+
+/** A rectangle, with inclusive corners: empty if x1 > x2 */
+struct dirty_rect {
+  int x1, y1, x2, y2;
+};
+
+/**
+ * The off-screen layers of the main area. Static parts (timelines, headings,
+ * periodic markers, load axes) are only redrawn on a full redraw (zoom, pan,
+ * ...), while the trace and load layers are drawn incrementally and masked
+ * over them. Every frame, the rectangle that changed is composited into
+ * `frame`, which is then blitted to the screen at once.
+ */
+struct layers {
+  BITMAP *frame;        /* composited main area */
+  BITMAP *statics;      /* static parts of the whole main area */
+  BITMAP *timeline;     /* sub-bitmaps of `statics` */
+  BITMAP *headings;
+  BITMAP *markers;
+  BITMAP *axes;
+  BITMAP *trace;        /* trace events, over `markers` */
+  BITMAP *load;         /* cpu load plot, over `axes` */
+  bool stopped;         /* whether `statics` shows a stopped taskset */
+  struct dirty_rect tip;/* where the tooltip is drawn over `frame` */
+};
 
 struct guictx {
   struct taskset *ts;   /* the observed taskset */
+  bool replica;         /* whether `ts` is a replica, not to be operated */
+  struct trace_snap snap;   /* the trace as seen by the frame being drawn */
   pthread_t tid;        /* tid of the gui thread */
   volatile bool exit;   /* set to true to instruct main loop to exit */
-  unsigned long dmiss;  /* counts deadline misses in the gui task */
+  sem_t wake;           /* posted on input, to wake the renderer up */
+  unsigned long dmiss;  /* frames not drawn within a frame period */
+
+  unsigned long frames; /* frames drawn so far */
+  long long frame_ns;   /* cpu time of the last frame [ns] */
+  long long frame_max_ns;   /* maximum cpu time of a frame [ns] */
+  struct timespec started;  /* when the gui thread started */
 
   double scale;         /* current zoom level [px/ms] */
   long disp_zero;       /* time of the beginning of the time axis [ms start] */
+  int px_offset;        /* pixels of the time axis left of the drawn area */
   struct task *selected;/* currently selected task */
   long cpuload_window;  /* size of the window for computing the cpu load [ms] */
 
   volatile bool redraw; /* instruct the gui to redraw itself */
+
+  int mouse_x, mouse_y; /* pointer position in the main area */
+  bool mouse_moved;     /* whether it moved since the last frame */
+  bool mouse_down;      /* whether the left button is pressed */
+  int hover;            /* event under the pointer, -1 if none */
+
+  struct layers layers; /* off-screen layers of the main area */
+  int trace_from;       /* first event not yet fully drawn */
+  int load_from;        /* first pixel of the load plot not yet computed */
+
+  /* Lanes: idle first, then the tasks from `lane_top`, as many as fit. When
+   * not all of them fit, the next lane aggregates the hidden ones. Then, if
+   * `show_res`, come the lanes of the resources, from R1. */
+  struct trace_index index; /* of the snapshot (see lanes_update) */
+  struct trace_holds holds; /* of the resources, from `index` */
+  int lane_h;           /* height of a lane [px] */
+  int lane_top;         /* first task shown */
+  int lanes_shown;      /* tasks shown */
+  bool others;          /* whether there is the aggregate lane */
+  double *others_cov;   /* per pixel, time covered by the shown lanes [ms] */
+  int others_w;         /* pixels of `others_cov` */
+  int cov_upto;         /* events accounted in `others_cov` so far */
+  bool show_res;        /* whether the resource lanes are shown */
+  int res_count;        /* resources of the tasks, R0 included */
+  int res_shown;        /* resource lanes shown */
+  long res_changed;     /* where the holds changed since drawn [ms] */
 };
 
 
+/**
+ * Return the default size of the window for computing the cpu load: 1.5
+ * times the period of the last task having one.
+ */
+long default_cpuload_window(struct taskset *ts);  /* main.c */
+
+
 /**
  * Asynchronously checks if there is any pending user input and takes action.
  */
@@ -63,13 +135,116 @@ void display_help(BITMAP *help_area);  /* input.c */
 void display_info(struct guictx *ctx, BITMAP *info_area);  /* info.c */
 
 
+/**
+ * Compute the resource colors: call once the color depth is set.
+ */
+void resource_colors_init(void);  /* trace.c */
+
 /** Return the color for the given resource */
 int get_resource_color(int r);  /* trace.c */
 
 /**
- * Display the execution trace in the given bitmap.
+ * Return the event `i` of the trace, as seen by the snapshot of the frame:
+ * a copy, if it is the current one.
+ */
+const struct trace_evt *snap_evt(struct guictx *ctx, int i);  /* trace.c */
+
+/**
+ * Return the index of the event drawn at (`x`, `y`) of the main area: the
+ * length of the snapshot for the current event, -1 if none.
+ */
+int evt_at(struct guictx *ctx, int x, int y);  /* trace.c */
+
+/**
+ * Return whether the (complete) event `i` starts before the right end of the
+ * visible window, so that drawing it changes the view.
+ */
+bool evt_visible(struct guictx *ctx, int i);  /* trace.c */
+
+/** Set up the (empty) lanes of the context */
+void lanes_init(struct guictx *ctx);  /* trace.c */
+
+/**
+ * Index the events of the snapshot not indexed yet, by task and resource,
+ * and the holds of the resources: drawing relies on the index being up to
+ * date. Return false if out of memory.
+ */
+bool lanes_update(struct guictx *ctx);  /* trace.c */
+
+/** Free the index and the lane buffers of the context */
+void lanes_free(struct guictx *ctx);  /* trace.c */
+
+/**
+ * Create the off-screen layers for a main area of the given size.
+ * Return false on failure.
+ */
+bool layers_create(struct layers *layers, int w, int h);  /* trace.c */
+
+/** Destroy the layers, which may be partially created */
+void layers_destroy(struct layers *layers);  /* trace.c */
+
+/**
+ * Display the execution trace in the given bitmap, through the layers.
  */
 void display_trace(struct guictx *ctx, BITMAP *main_area);  /* trace.c */
 
 
+/**
+ * Return the right limit of the interesting time [ms]: the end of the trace,
+ * once the taskset is stopped, LONG_MAX before.
+ */
+long time_limit(struct guictx *ctx);  /* trace.c */
+
+
+/*
+ * Rendering to images (see render.c): an image has the layout of the main
+ * area, and its plot (trace, load and timeline) is drawn in vertical tiles,
+ * independently of each other.
+ */
+
+/**
+ * Return the width of the plot in an image of the given size, or 0 if the
+ * image is too small.
+ */
+int render_plot_width(int image_w, int image_h);  /* trace.c */
+
+/** Return the abscissa of the plot in an image */
+int render_plot_x(void);  /* trace.c */
+
+/**
+ * Draw the left margin of the image: line headings and legends.
+ * Return false on failure.
+ */
+bool render_margin(struct guictx *ctx, BITMAP *image);  /* trace.c */
+
+/**
+ * Draw on `tile`, as high as the image, the part of the plot as wide as the
+ * tile starting at pixel `x` of the plot. `ctx` is modified, so each tile
+ * needs a copy of its own. Return false on failure.
+ */
+bool render_tile(struct guictx *ctx, BITMAP *tile, int x);  /* trace.c */
+
+
+/* The following parts of display_trace are exposed for the benchmarks */
+
+/** Return the index of the latest event preceding the given time [ms] */
+int evt_preceding(struct guictx *ctx, long time_ms);  /* trace.c */
+
+/** Draw the timelines and periodic markers of the trace area */
+void disp_trace_static(struct guictx *ctx, BITMAP *markers);  /* trace.c */
+
+/**
+ * Draw the trace events on the (masked) trace layer: all of them on a redraw,
+ * otherwise those not drawn yet. The touched pixels are added to `dirty`.
+ */
+void disp_trace(struct guictx *ctx, BITMAP *trace_layer,
+    struct dirty_rect *dirty);  /* trace.c */
+
+/**
+ * Return the cpu load in the `cpuload_window` ending at the given time [ms],
+ * or NAN if unknown.
+ */
+double get_load(struct guictx *ctx, long time_ms);  /* trace.c */
+
+
 #endif
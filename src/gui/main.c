@@ -24,7 +24,8 @@
 #include <allegro.h>
 
 #include "../common.h"
-#include "../periodic.h"
+#include "../time_utils.h"
+#include "../logger.h"
 #include "internals.h"
 
 
@@ -61,11 +62,82 @@ static void screen_split_cleanup(
 }
 
 
+/**
+ * Sleep until the renderer is woken up by an input, or until `until`
+ * (monotonic). Wake-ups that happened meanwhile are coalesced.
+ */
+static void wait_for_wake(struct guictx *ctx, const struct timespec *until) {
+  while (sem_clockwait(&ctx->wake, CLOCK_MONOTONIC, until) < 0
+      && errno == EINTR)
+    ;
+  while (sem_trywait(&ctx->wake) == 0)
+    ;
+}
+
+
+/** Return a value that changes whenever the taskset status does */
+static int taskset_status(struct taskset *ts) {
+  return ts->activated | ts->stopped << 1 | taskset_isactive(ts) << 2;
+}
+
+
+/**
+ * Draw a frame, measuring its cpu time and checking that it ends within a
+ * frame period of the wake-up at `woken`.
+ */
+static void draw_frame(struct guictx *ctx, BITMAP *main_area,
+    BITMAP *info_area, bool with_trace, const struct timespec *woken,
+    long long period_ns)
+{
+  struct timespec start, end, now;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+  scare_mouse();  /* unless the pointer is drawn by the hardware */
+  display_info(ctx, info_area);
+  if (with_trace)
+    display_trace(ctx, main_area);
+  unscare_mouse();
+  ctx->redraw = false;
+  ctx->mouse_moved = false;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+  ctx->frames ++;
+  ctx->frame_ns = time_diff_ns(&end, &start);
+  if (ctx->frame_ns > ctx->frame_max_ns)
+    ctx->frame_max_ns = ctx->frame_ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (time_diff_ns(&now, woken) > period_ns) {
+    ctx->dmiss ++;
+    printf_log(LOG_INFO, "GUI Deadline miss! (so far: %lu)\n", ctx->dmiss);
+  }
+}
+
+
+/** Stop the taskset, whether it started or not, and wait for its tasks */
+static void taskset_finish(struct taskset *ts) {
+  if (! ts->activated) {
+    /* Tasks are still waiting for activation: unlock them so they exit */
+    printf_log(LOG_INFO, "Destroying the taskset, which didn'e even start.\n");
+    taskset_quit(ts);
+    taskset_activate(ts);
+  }
+  else if (! ts->stopped) {
+    printf_log(LOG_INFO, "Stopping the taskset before quitting...\n");
+    taskset_quit(ts);
+  }
+  printf_log(LOG_INFO, "Waiting for the taskset to finish...\n");
+  taskset_join(ts);
+}
+
+
 static void gui_thread_main(struct guictx *ctx) {
   int s;
   BITMAP *main_area, *info_area, *help_area;
-  struct timespec at;
-  struct timespec dl;
+  struct timespec now, next_check, next_frame;
+  long long period_ns;
+  int seen_len, seen_status, len, status;
+  bool with_trace, ticked, live;
 
   s = pthread_setname_np(pthread_self(), "gui");
   if (s) {
@@ -73,6 +145,7 @@ static void gui_thread_main(struct guictx *ctx) {
         "GUI thread activation failed: pthread_setname_np returned error: ");
     return;
   }
+  logger_thread_init("gui");
 
   screen_split(&main_area, &info_area, &help_area);
   if (main_area == NULL || info_area == NULL || help_area == NULL) {
@@ -80,44 +153,81 @@ static void gui_thread_main(struct guictx *ctx) {
     return;
   }
 
+  if (! layers_create(&ctx->layers, main_area->w, main_area->h)) {
+    printf_log(LOG_ERROR, "Can't create the off-screen layers.\n");
+    layers_destroy(&ctx->layers);
+    screen_split_cleanup(main_area, info_area, help_area);
+    return;
+  }
+
   display_help(help_area);
 
-  set_period_ms(&at, &dl, GUI_PERIOD, GUI_DEADLINE, NULL, 0);
+  /* The renderer sleeps until an input wakes it up, or until the next check
+   * for new events: it draws if either changed the view, or at every check
+   * while the taskset runs, and at most options.gui_max_fps times a second. */
+  period_ns = 1000000000LL / options.gui_max_fps;
+  clock_gettime(CLOCK_MONOTONIC, &ctx->started);
+  time_cpy(&next_check, &ctx->started);
+  time_cpy(&next_frame, &ctx->started);
+  seen_len = -1;
+  seen_status = -1;
 
   while (! ctx->exit) {
-    wait_for_period_ms(&at, &dl, GUI_PERIOD);
-    if (deadline_miss(&dl)) {
-      ctx->dmiss ++;
-      printf_log(LOG_INFO, "GUI Deadline miss! (so far: %d)\n", ctx->dmiss);
+    wait_for_wake(ctx, &next_check);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ticked = time_cmp(&now, &next_check) >= 0;
+    if (ticked) {
+      time_cpy(&next_check, &now);
+      time_add_ns(&next_check, period_ns);
     }
 
     get_user_input(ctx);
 
-    display_info(ctx, info_area);
-    display_trace(ctx, main_area);
+    /* The status first: a stopped taskset's snapshot is final */
+    status = taskset_status(ctx->ts);
+    trace_snapshot(&ctx->ts->trace, &ctx->snap);
+    len = ctx->snap.len;
+    if (! lanes_update(ctx)) {
+      printf_log(LOG_ERROR, "Out of memory while indexing the trace.\n");
+      break;
+    }
 
-    ctx->redraw = false;
-  }
+    /* The current event and the statistics change at every tick while the
+     * taskset runs, even if no new event is committed */
+    live = ticked && taskset_isactive(ctx->ts);
+
+    /* New events off the visible window only change the statistics */
+    with_trace = ctx->redraw || ctx->mouse_moved || status != seen_status
+      || (seen_len >= 0 && len > seen_len && evt_visible(ctx, seen_len))
+      || (live && ctx->snap.cur.valid && evt_visible(ctx, len));
+    if (! with_trace && len == seen_len && ! live)
+      continue;
+
+    /* Keep to the maximum frame rate */
+    if (time_cmp(&now, &next_frame) < 0) {
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_frame, NULL);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+    time_cpy(&next_frame, &now);
+    time_add_ns(&next_frame, period_ns);
 
-  if (! ctx->ts->activated) {
-    /* Tasks are still waiting for activation: unlock them so they exit */
-    printf_log(LOG_INFO, "Destroying the taskset, which didn'e even start.\n");
-    taskset_quit(ctx->ts);
-    taskset_activate(ctx->ts);
+    draw_frame(ctx, main_area, info_area, with_trace, &now, period_ns);
+    seen_len = len;
+    seen_status = status;
   }
-  else if (! ctx->ts->stopped) {
-    printf_log(LOG_INFO, "Stopping the taskset before quitting...\n");
-    taskset_quit(ctx->ts);
-  }
-  printf_log(LOG_INFO, "Waiting for the taskset to finish...\n");
-  taskset_join(ctx->ts);
 
+  /* A replica's taskset belongs to another process */
+  if (! ctx->replica)
+    taskset_finish(ctx->ts);
+
+  layers_destroy(&ctx->layers);
   screen_split_cleanup(main_area, info_area, help_area);
 }
 
 
 static void *gui_thread_function(void *params) {
   gui_thread_main((struct guictx *)params);
+  logger_thread_exit();
   return NULL;
 }
 
@@ -146,16 +256,19 @@ static void gui_thread_create(struct guictx *ctx) {
   s = pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_JOINABLE);
   if (s) handle_error_clean(s, "pthread_attr_setdetachstate");
 
-  s = pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
-  if (s) handle_error_clean(s, "pthread_attr_setinheritsched");
+  /* A viewer of another process runs at normal priority */
+  if (! ctx->replica) {
+    s = pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+    if (s) handle_error_clean(s, "pthread_attr_setinheritsched");
 
-  s = pthread_attr_setschedpolicy(&tattr, SCHED_RR);
-  if (s) handle_error_clean(s, "pthread_attr_setschedpolicy");
+    s = pthread_attr_setschedpolicy(&tattr, SCHED_RR);
+    if (s) handle_error_clean(s, "pthread_attr_setschedpolicy");
+
+    sched_param.sched_priority = GUI_THREAD_PRIORITY;
+    s = pthread_attr_setschedparam(&tattr, &sched_param);
+    if (s) handle_error_clean(s, "pthread_attr_setschedparam");
+  }
 
-  sched_param.sched_priority = GUI_THREAD_PRIORITY;
-  s = pthread_attr_setschedparam(&tattr, &sched_param);
-  if (s) handle_error_clean(s, "pthread_attr_setschedparam");
-  
   s = pthread_create(&ctx->tid, &tattr, gui_thread_function, (void *) ctx);
   if (s) handle_error_clean(s, "pthread_create");
 
@@ -165,16 +278,34 @@ static void gui_thread_create(struct guictx *ctx) {
 #undef handle_error_clean
 
 
-/* Required by the close_button_handler */
+/* Required by the close_button_handler and keyboard_handler */
 static struct guictx *global_ctx;
 
 
 void close_button_handler(void) {
   global_ctx->exit = true;
+  sem_post(&global_ctx->wake);
 }
 END_OF_FUNCTION(close_button_handler)
 
 
+/* Called by allegro on every key press: wakes the renderer up, which then
+ * reads the key from the buffer */
+int keyboard_handler(int key) {
+  sem_post(&global_ctx->wake);
+  return key;
+}
+END_OF_FUNCTION(keyboard_handler)
+
+
+/* Called by allegro on pointer moves and clicks: wakes the renderer up, which
+ * then reads the pointer state */
+void mouse_handler(int flags) {
+  sem_post(&global_ctx->wake);
+}
+END_OF_FUNCTION(mouse_handler)
+
+
 /** Fully initialize the graphics library and start the GUI threads */
 static void graphics_init() {
   int s;
@@ -197,28 +328,66 @@ static void graphics_init() {
     printf_log(LOG_ERROR, "Allegro library failed in set_gfx_mode.\n");
     exit(1);
   }
+  resource_colors_init();
 
   s = install_keyboard();
   if (s) {
     printf_log(LOG_ERROR, "Allegro library failed in install_keyboard.\n");
     exit(1);
   }
+  LOCK_VARIABLE(global_ctx);
+  LOCK_FUNCTION(keyboard_handler);
+  keyboard_callback = keyboard_handler;
+
+  /* The GUI is still usable from the keyboard */
+  s = install_mouse();
+  if (s < 0) {
+    printf_log(LOG_WARNING, "No mouse: events can't be inspected.\n");
+    return;
+  }
+  enable_hardware_cursor();
+  show_mouse(screen);
+  LOCK_FUNCTION(mouse_handler);
+  mouse_callback = mouse_handler;
 }
 
 
-/* Main entry-point */
-void gui_run(struct taskset *ts) {
+/* documented in internals.h */
+long default_cpuload_window(struct taskset *ts) {
+  int t;
+
+  /* Aperiodic tasks have no period: use the last task having one */
+  for (t = ts->tasks_count - 1; t > 0 && ts->tasks[t].period == 0; t--)
+    ;
+  return ts->tasks[t].period * 1.5;
+}
+
+
+/** Run the GUI on `ts`, which is a replica filled by another thread if so */
+static void gui_start(struct taskset *ts, bool replica) {
   int s;
   struct guictx ctx;
 
   ctx.exit = false;
   ctx.ts = ts;
+  ctx.replica = replica;
   ctx.dmiss = 0;
+  ctx.frames = 0;
+  ctx.frame_ns = 0;
+  ctx.frame_max_ns = 0;
+  run_assert(0 == sem_init(&ctx.wake, 0, 0));
   ctx.scale = GUI_DEFAULT_ZOOM;
   ctx.disp_zero = 0;
+  ctx.px_offset = 0;
   ctx.selected = &ts->tasks[0];
-  ctx.cpuload_window = ts->tasks[ts->tasks_count - 1].period * 1.5;
+  ctx.cpuload_window = default_cpuload_window(ts);
   ctx.redraw = true;
+  ctx.mouse_x = ctx.mouse_y = -1;
+  ctx.mouse_moved = false;
+  ctx.mouse_down = false;
+  ctx.hover = -1;
+  ctx.show_res = options.gui_res_lanes;
+  lanes_init(&ctx);
 
   global_ctx = &ctx;
 
@@ -233,5 +402,18 @@ void gui_run(struct taskset *ts) {
   }
 
   allegro_exit();
+  lanes_free(&ctx);
+  run_assert(0 == sem_destroy(&ctx.wake));
 }
 
+
+/* Main entry-point */
+void gui_run(struct taskset *ts) {
+  gui_start(ts, false);
+}
+
+
+/* documented in gui.h */
+void gui_view(struct taskset *ts) {
+  gui_start(ts, true);
+}
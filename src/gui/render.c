@@ -0,0 +1,166 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This file renders the trace of a stopped taskset to a PNG image, without a
+ * display: the drawing routines of trace.c run on memory bitmaps.
+ *
+ * The plot is split into tiles RENDER_TILE_W pixels wide, each drawn on a
+ * bitmap of its own and then copied into the image, so that the layers stay
+ * small. Allegro 4 is not thread-safe, so the tiles are drawn by the calling
+ * thread only: just the PNG encoding runs on a pool of threads (one per
+ * online CPU), which read the image one at a time (see png.h).
+ */
+
+#include <unistd.h>
+#include <time.h>
+#include <allegro.h>
+
+#include "../common.h"
+#include "../png.h"
+#include "../time_utils.h"
+#include "internals.h"
+
+
+/* Width of a tile [px] */
+#ifndef RENDER_TILE_W
+#define RENDER_TILE_W 2048
+#endif
+
+/* Maximum number of threads encoding the image */
+#ifndef RENDER_MAX_THREADS
+#define RENDER_MAX_THREADS 64
+#endif
+
+/** Draw the plot on `image`, a tile at a time. Return false on failure. */
+static bool render_tiles(const struct guictx *ctx, BITMAP *image,
+    int plot_x, int plot_w, int tiles)
+{
+  struct guictx tile_ctx;
+  BITMAP *tile;
+  int i, x, w;
+  bool ok;
+
+  ok = true;
+  for (i = 0; ok && i < tiles; i++) {
+    x = i * RENDER_TILE_W;
+    w = MIN(RENDER_TILE_W, plot_w - x);
+
+    tile = create_bitmap(w, image->h);
+    tile_ctx = *ctx;
+    ok = tile != NULL && render_tile(&tile_ctx, tile, x);
+    if (ok)
+      blit(tile, image, 0, 0, plot_x + x, 0, w, tile->h);
+    if (tile != NULL)
+      destroy_bitmap(tile);
+  }
+  return ok;
+}
+
+
+/* Convert a row of the image for png_write */
+static void image_row(void *arg, int y, unsigned char *rgb) {
+  BITMAP *image = arg;
+  int x, c;
+
+  for (x = 0; x < image->w; x++) {
+    c = getpixel(image, x, y);
+    rgb[3 * x + 0] = getr(c);
+    rgb[3 * x + 1] = getg(c);
+    rgb[3 * x + 2] = getb(c);
+  }
+}
+
+
+/* documented in gui.h */
+int gui_render(struct taskset *ts, const char *path) {
+  struct guictx ctx;
+  BITMAP *image;
+  struct timespec start, end;
+  long from, to;
+  int plot_x, plot_w, tiles, threads, s;
+  bool ok;
+
+  if (! ts->stopped || ts->trace.len < 1) {
+    printf_log(LOG_ERROR, "Nothing to render: the trace is empty.\n");
+    return -1;
+  }
+
+  s = install_allegro(SYSTEM_NONE, &errno, atexit);
+  if (s) {
+    printf_log(LOG_ERROR, "Allegro library refused to start.\n");
+    return -1;
+  }
+  set_color_depth(16);
+  resource_colors_init();
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  ctx.ts = ts;
+  trace_snapshot(&ts->trace, &ctx.snap);
+  ctx.px_offset = 0;
+  ctx.selected = NULL;
+  ctx.cpuload_window = default_cpuload_window(ts);
+  ctx.redraw = true;
+  ctx.show_res = options.gui_res_lanes;
+  lanes_init(&ctx);
+
+  from = options.render_from;
+  to = (options.render_to >= 0) ? options.render_to : time_limit(&ctx);
+  plot_x = render_plot_x();
+  plot_w = render_plot_width(options.gui_w, options.gui_h);
+  if (plot_w == 0 || to <= from) {
+    printf_log(LOG_ERROR, "Can't render %ld-%ld ms in a %dx%d image.\n",
+        from, to, options.gui_w, options.gui_h);
+    return -1;
+  }
+  ctx.disp_zero = from;
+  ctx.scale = (double) plot_w / (to - from);
+
+  image = create_bitmap(options.gui_w, options.gui_h);
+  if (image == NULL) {
+    printf_log(LOG_ERROR, "Can't create a %dx%d bitmap.\n",
+        options.gui_w, options.gui_h);
+    return -1;
+  }
+  clear_to_color(image, BG_COL);
+
+  tiles = (plot_w + RENDER_TILE_W - 1) / RENDER_TILE_W;
+  ok = lanes_update(&ctx) && render_margin(&ctx, image)
+    && render_tiles(&ctx, image, plot_x, plot_w, tiles);
+  lanes_free(&ctx);
+
+  if (! ok) {
+    printf_log(LOG_ERROR, "Out of memory while rendering.\n");
+    destroy_bitmap(image);
+    return -1;
+  }
+
+  threads = sysconf(_SC_NPROCESSORS_ONLN);
+  threads = MAX(MIN(threads, RENDER_MAX_THREADS), 1);
+  s = png_write(path, image->w, image->h, image_row, image, threads);
+  if (s)
+    printf_log_perror(LOG_ERROR, errno, "Can't write \"%s\": ", path);
+  destroy_bitmap(image);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (! s) {
+    printf_log(LOG_INFO, "Rendered %ld-%ld ms to \"%s\" (%dx%d, %d tiles, "
+        "encoded by %d threads) in %ld ms.\n", from, to, path, options.gui_w,
+        options.gui_h, tiles, threads, time_diff_ms(&end, &start));
+  }
+  return s;
+}
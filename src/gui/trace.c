@@ -16,6 +16,9 @@
 
 #include <limits.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "../time_utils.h"
 #include "../bsearch_left.h"
@@ -37,8 +40,20 @@
 #define TRACE_H         18
 #define DEADLINE_H      (TRACE_H + 4)
 #define ACTIVATION_H    (DEADLINE_H + 4)
+#define DMISS_H         (ACTIVATION_H + 4)
+#define COMPLETION_H    (TRACE_H / 2)
 #define ACT_DEADL_W     2
 
+#define HOLD_H          10
+#define WAIT_STEP       3   /* between the lines of two waiting tasks */
+
+#define TIP_LINES       4
+#define TIP_LEN         64
+#define TIP_OFFSET      12  /* from the pointer */
+
+
+/* Resources beyond the first PLOT_PALETTE_COLORS ones reuse colors */
+#define PLOT_PALETTE_COLORS 15
 
 static const PALETTE PLOT_PALETTE = {
   {0xff, 0xff, 0x33},   /* R0 - no resource */
@@ -64,50 +79,115 @@ static const PALETTE PLOT_PALETTE = {
   {0xee, 0xee, 0xee},
 };
 
-/* Return the right limit of the interesting time */
-static long time_limit(struct guictx *ctx) {
+/* PLOT_PALETTE, converted to the current color depth */
+static int resource_colors[PLOT_PALETTE_COLORS];
+
+
+/****** LAYERS ******/
+
+static void dirty_add(struct dirty_rect *d, int x1, int y1, int x2, int y2) {
+  if (x1 > x2 || y1 > y2)
+    return;
+  if (d->x1 > d->x2) {
+    d->x1 = x1; d->y1 = y1; d->x2 = x2; d->y2 = y2;
+    return;
+  }
+  d->x1 = MIN(d->x1, x1);
+  d->y1 = MIN(d->y1, y1);
+  d->x2 = MAX(d->x2, x2);
+  d->y2 = MAX(d->y2, y2);
+}
+
+static void dirty_clear(struct dirty_rect *d) {
+  d->x1 = d->y1 = 0;
+  d->x2 = d->y2 = -1;
+}
+
+/* Add the rectangle `d` of a `w`x`h` area at (`x`, `y`) to `dirty` */
+static void dirty_add_from(struct dirty_rect *dirty,
+    const struct dirty_rect *d, int x, int y, int w, int h)
+{
+  dirty_add(dirty, x + MAX(d->x1, 0), y + MAX(d->y1, 0),
+      x + MIN(d->x2, w - 1), y + MIN(d->y2, h - 1));
+}
+
+/** Mask-blit the part of `layer`, placed at (`x`, `y`), within `d` */
+static void overlay(BITMAP *layer, BITMAP *frame, int x, int y,
+    const struct dirty_rect *d)
+{
+  int x1, y1, x2, y2;
+
+  x1 = MAX(d->x1, x);
+  y1 = MAX(d->y1, y);
+  x2 = MIN(d->x2, x + layer->w - 1);
+  y2 = MIN(d->y2, y + layer->h - 1);
+  if (x1 <= x2 && y1 <= y2)
+    masked_blit(layer, frame, x1 - x, y1 - y, x1, y1, x2 - x1 + 1, y2 - y1 +1);
+}
+
+/* documented in internals.h */
+const struct trace_evt *snap_evt(struct guictx *ctx, int i) {
+  if (i == ctx->snap.len)
+    return &ctx->snap.cur;
+  return &ctx->ts->trace.events[i];
+}
+
+/* documented in internals.h */
+long time_limit(struct guictx *ctx) {
   const struct trace_evt *evt;
 
   if (! ctx->ts->stopped) {
     return LONG_MAX;
   }
   else {
-    evt = &ctx->ts->trace.events[ctx->ts->trace.len];
+    evt = snap_evt(ctx, ctx->snap.len);
     if (! evt->valid)
-      evt = &ctx->ts->trace.events[ctx->ts->trace.len - 1];
+      evt = snap_evt(ctx, ctx->snap.len - 1);
 
     assert(evt->valid);
     return time_diff_ms(&evt->time, &ctx->ts->t0);
   }
 }
 
+/* Rounded down, so that tiles agree on pixels left of their border */
 static long time_to_px(struct guictx *ctx, int width, long time) {
-  return (time - ctx->disp_zero) * ctx->scale;
+  return floor((time - ctx->disp_zero) * ctx->scale - ctx->px_offset);
 }
 
 static long px_to_time(struct guictx *ctx, int width, long px) {
-  return px / ctx->scale + ctx->disp_zero;
+  return (px + ctx->px_offset) / ctx->scale + ctx->disp_zero;
+}
+
+/* Time at the left border of the area */
+static long min_disp_time(struct guictx *ctx) {
+  return px_to_time(ctx, 0, 0);
 }
 
 static long max_disp_time(struct guictx *ctx, int net_width) {
-  return ctx->disp_zero + net_width / ctx->scale;
+  return px_to_time(ctx, net_width, net_width);
 }
 
 static int evt_time_cmp(const void *time_key, const void *evt_item) {
   return time_cmp(time_key, &((struct trace_evt *)evt_item)->time);
 }
 
-/* Return the index of the latest event preceding the given time  */
+/* documented in internals.h */
 int evt_preceding(struct guictx *ctx, long time_ms) {
   struct timespec t;
 
   time_cpy(&t, &ctx->ts->t0);
   time_add_ms(&t, time_ms);
 
-  return bsearch_left(&t, &ctx->ts->trace.events, ctx->ts->trace.len,
+  return bsearch_left(&t, ctx->ts->trace.events, ctx->snap.len,
       sizeof(struct trace_evt), evt_time_cmp);
 }
 
+/* documented in internals.h */
+bool evt_visible(struct guictx *ctx, int i) {
+  return time_diff_ms(&snap_evt(ctx, i)->time, &ctx->ts->t0)
+    <= max_disp_time(ctx, ctx->layers.trace->w);
+}
+
 /****** TIMELINE  ******/
 
 /* "-1"-terminated array of possible ticks distance [ms] */
@@ -159,6 +239,38 @@ static int nextmult(int a, int b, int phase) {
   return ceildiv(b - phase, a) * a + phase; 
 }
 
+/* Return the time unit of the ticks (1 for ms, 1000 for s) and its name */
+static int timeline_unit(long time_dist, const char **unit) {
+  if (time_dist % 1000) {
+    *unit = "ms";
+    return 1;
+  }
+  *unit = "s";
+  return 1000;
+}
+
+/* Display the "t [unit]" legend of a timeline at the left of the area */
+static void disp_timeline_legend(struct guictx *ctx, BITMAP *area, int y) {
+  long time_dist;
+  const char *unit;
+
+  scale2ticks(ctx->scale, &time_dist);
+  timeline_unit(time_dist, &unit);
+
+  textprintf_ex(area, font,
+      1+text_length(font, "["), y - text_height(font) / 2, TEXT_COL, -1, "t");
+  textprintf_ex(area, font,
+      1, y + GUI_MARGIN + text_height(font) / 2, TEXT_COL, -1,
+      "[%s]", unit);
+}
+
+/**
+ * Display a timeline at height `y`, with labelled ticks if `show_scale`.
+ * If `with_offset`, it leaves the margins of the trace lines free (and shows
+ * the legend there, if `show_scale`), otherwise it spans the whole area, which
+ * may be a tile of a wider image: ticks just outside are drawn as well, so
+ * that labels crossing the border are complete.
+ */
 static void disp_timeline(struct guictx *ctx, BITMAP *area, int y,
     bool show_scale, bool with_offset) {
   int x, t;
@@ -174,31 +286,23 @@ static void disp_timeline(struct guictx *ctx, BITMAP *area, int y,
   lineend_x_roff = (with_offset ? LINEEND_X_ROFF : 0);
 
   scale2ticks(ctx->scale, &time_dist);
+  unit_factor = timeline_unit(time_dist, &unit);
 
-  if (time_dist % 1000) {
-    unit = "ms";
-    unit_factor = 1;
-  }
-  else {
-    unit = "s";
-    unit_factor = 1000;
-  }
-
-  if (show_scale) {
-    textprintf_ex(area, font,
-        1+text_length(font, "["), y - text_height(font) / 2, TEXT_COL, -1, "t");
-    textprintf_ex(area, font,
-        1, y + GUI_MARGIN + text_height(font) / 2, TEXT_COL, -1,
-        "[%s]", unit);
-  }
+  if (show_scale && with_offset)
+    disp_timeline_legend(ctx, area, y);
 
   hline(area, linestart_x, y + 0, area->w - lineend_x_roff, TEXT_COL);
   hline(area, linestart_x, y + 1, area->w - lineend_x_roff, TEXT_COL);
 
   time_end = max_disp_time(ctx, area->w - linestart_x - lineend_x_roff);
-  for (t = nextmult(time_dist, ctx->disp_zero, 0); t < time_end; t += time_dist)
+  t = nextmult(time_dist, min_disp_time(ctx), 0);
+  if (! with_offset) {
+    t -= time_dist;
+    time_end += time_dist;
+  }
+  for (; t < time_end; t += time_dist)
   {
-    x = linestart_x + (t - ctx->disp_zero) * ctx->scale;
+    x = linestart_x + time_to_px(ctx, area->w, t);
 
     vline(area, x, y, y + TICK_LEN, TEXT_COL);
     if (show_scale && !(t / time_dist % TICKS_PER_LABEL))
@@ -209,30 +313,148 @@ static void disp_timeline(struct guictx *ctx, BITMAP *area, int y,
 }
 
 
+/****** LANES ******/
+
+/* documented in internals.h */
+void lanes_init(struct guictx *ctx) {
+  int t, s;
+
+  trace_index_init(&ctx->index, ctx->ts->tasks_count);
+  trace_holds_init(&ctx->holds);
+  ctx->lane_h = 0;
+  ctx->lane_top = 0;
+  ctx->lanes_shown = 0;
+  ctx->others = false;
+  ctx->others_cov = NULL;
+  ctx->others_w = 0;
+  ctx->cov_upto = 0;
+
+  ctx->res_count = 1;
+  for (t = 0; t < ctx->ts->tasks_count; t++) {
+    for (s = 0; s < ctx->ts->tasks[t].sections_count; s++) {
+      ctx->res_count =
+        MAX(ctx->res_count, (int) ctx->ts->tasks[t].sections[s].res + 1);
+    }
+  }
+  ctx->res_shown = 0;
+  ctx->res_changed = LONG_MAX;
+}
+
+/* documented in internals.h */
+bool lanes_update(struct guictx *ctx) {
+  struct timespec changed;
+
+  changed.tv_sec = LONG_MAX;
+  changed.tv_nsec = 0;
+  if (! trace_index_update(&ctx->index, &ctx->ts->trace, ctx->snap.len)
+      || ! trace_holds_update(&ctx->holds, &ctx->index, &ctx->ts->trace,
+        &changed))
+    return false;
+
+  if (changed.tv_sec != LONG_MAX) {
+    ctx->res_changed = MIN(ctx->res_changed,
+        time_diff_ms(&changed, &ctx->ts->t0));
+  }
+  return true;
+}
+
+/* documented in internals.h */
+void lanes_free(struct guictx *ctx) {
+  trace_index_free(&ctx->index);
+  trace_holds_free(&ctx->holds);
+  free(ctx->others_cov);
+  lanes_init(ctx);
+}
+
+/**
+ * Lay out the lanes in a trace area `h` pixels tall: all of them if they are
+ * at least GUI_MIN_TRACELINE_HEIGHT pixels high, otherwise the resources, as
+ * many tasks as fit from `lane_top`, and the aggregate lane.
+ */
+static void lanes_layout(struct guictx *ctx, int h) {
+  int n, r, rows;
+
+  n = ctx->ts->tasks_count;
+  r = ctx->show_res ? ctx->res_count - 1 : 0;
+  ctx->lane_h = h / (n + 1 + r);
+  if (ctx->lane_h > GUI_MAX_TRACELINE_HEIGHT)
+    ctx->lane_h = GUI_MAX_TRACELINE_HEIGHT;
+
+  if (ctx->lane_h >= GUI_MIN_TRACELINE_HEIGHT) {
+    ctx->lanes_shown = n;
+    ctx->lane_top = 0;
+    ctx->others = false;
+    ctx->res_shown = r;
+    return;
+  }
+
+  /* Rows for idle and the aggregate lane, then for the resources (which
+   * were asked for) and for the tasks shown */
+  ctx->lane_h = GUI_MIN_TRACELINE_HEIGHT;
+  rows = MAX(h / ctx->lane_h - 2, 0);
+  ctx->res_shown = MIN(r, rows);
+  ctx->lanes_shown = rows - ctx->res_shown;
+  ctx->lane_top = MAX(MIN(ctx->lane_top, n - ctx->lanes_shown), 0);
+  ctx->others = true;
+}
+
+/* Return the task (-1 for idle) in the given row of lanes */
+static int lane_task(struct guictx *ctx, int row) {
+  return (row == 0) ? -1 : ctx->lane_top + row - 1;
+}
+
+/* Return the baseline of the given row of lanes */
+static int row_y(struct guictx *ctx, int row) {
+  return (row + 1) * ctx->lane_h - GUI_MARGIN - 1;
+}
+
+/* Return the baseline of the lane of `task` (-1 for idle), -1 if hidden */
+static int lane_y(struct guictx *ctx, int task) {
+  if (task < 0)
+    return row_y(ctx, 0);
+  if (task < ctx->lane_top || task >= ctx->lane_top + ctx->lanes_shown)
+    return -1;
+  return row_y(ctx, task - ctx->lane_top + 1);
+}
+
+/* Return the baseline of the aggregate lane */
+static int others_y(struct guictx *ctx) {
+  return row_y(ctx, ctx->lanes_shown + 1);
+}
+
+/* Return the row of the lane of resource `res` (from 1) */
+static int res_row(struct guictx *ctx, int res) {
+  return ctx->lanes_shown + (ctx->others ? 1 : 0) + res;
+}
+
+
 /****** TRACE  ******/
 
-/* Return the height of each trace line */
-static int get_line_height(struct guictx *ctx, int tot_height) {
-  int ret;
+/* Return the start of event `i` of the snapshot [ms] */
+static long evt_ms(struct guictx *ctx, int i) {
+  return time_diff_ms(&snap_evt(ctx, i)->time, &ctx->ts->t0);
+}
+
+/* documented in internals.h */
+void resource_colors_init(void) {
+  int r;
 
-  ret = tot_height / (ctx->ts->tasks_count + 1);
-  if (ret > GUI_MAX_TRACELINE_HEIGHT) ret = GUI_MAX_TRACELINE_HEIGHT;
-  return ret;
+  for (r = 0; r < PLOT_PALETTE_COLORS; r++) {
+    resource_colors[r] =
+      makecol(PLOT_PALETTE[r].r, PLOT_PALETTE[r].g, PLOT_PALETTE[r].b);
+  }
 }
 
-/** Return the color for the given resource */
+/* documented in internals.h */
 int get_resource_color(int r) {
-  RGB ret;
-
-  select_palette(PLOT_PALETTE);
-  get_color(r, &ret);
-  unselect_palette();
-  return makecol(ret.r, ret.g, ret.b);
+  if (r >= PLOT_PALETTE_COLORS)
+    r = 1 + (r - 1) % (PLOT_PALETTE_COLORS - 1);
+  return resource_colors[r];
 }
 
-/** Draw a single event */
+/** Draw a single event, on the lane with baseline `y` */
 static void disp_evt(struct guictx *ctx, BITMAP *area,
-    const struct trace_evt *evt, long start_time,long end_time, int line_height)
+    const struct trace_evt *evt, long start_time, long end_time, int y)
 {
   int startpx, endpx;
 
@@ -242,45 +464,70 @@ static void disp_evt(struct guictx *ctx, BITMAP *area,
   /* void rectfill(BITMAP *bmp, int x1, int y1, int x2, int y2, int color); */
   rectfill(area,
       startpx,
-      (evt->task+1 + 1) * line_height - GUI_MARGIN - 1 + (
-        evt->type == EVT_RUN ? 0 : 1),
+      y + (evt->type == EVT_RUN ? 0 : 1),
       endpx,
-      (evt->task+1 + 1) * line_height - GUI_MARGIN - 1 - TRACE_H,
+      y - TRACE_H,
       get_resource_color(evt->res));
 }
 
+/**
+ * Draw the marker for an activation (of a non-periodic task), a job completion
+ * or a deadline miss, if `evt` is one
+ */
+static void disp_evt_marker(struct guictx *ctx, BITMAP *area,
+    const struct trace_evt *evt, long time, int y)
+{
+  int px;
+  int h;
+  int col;
+
+  if (evt->type == EVT_ACTIVATION) {
+    h = ACTIVATION_H;
+    col = ACTIVATION_COL;
+  }
+  else if (evt->type == EVT_DEADLINE) {
+    h = DMISS_H;
+    col = DMISS_COL;
+  }
+  else if (evt->type == EVT_COMPLETION) {
+    h = COMPLETION_H;
+    col = COMPLETION_COL;
+  }
+  else {
+    return;
+  }
+
+  px = time_to_px(ctx, area->w, time);
+  rectfill(area, px, y, px + ACT_DEADL_W - 1, y - h, col);
+}
+
 /* Draw the activations and deadlines for the given task */
 static void disp_at_dt(
-    struct guictx *ctx, BITMAP *area, struct task *task, int line_height)
+    struct guictx *ctx, BITMAP *area, struct task *task, int y)
 {
   long time;
   long time_upper_limit = time_limit(ctx);
   int px;
 
-  /* Activation times */
-  for (time = nextmult(task->period, ctx->disp_zero, task->phase);
-      time <= max_disp_time(ctx, area->w);  time += task->period)
+  /* Server replenishments (periodic tasks trace their actual activations) */
+  for (time = nextmult(task->period, min_disp_time(ctx), task->phase);
+      time <= max_disp_time(ctx, area->w) && task->kind == TASK_SERVER;
+      time += task->period)
   {
     if (time >= 0 && time < time_upper_limit) {
       px = time_to_px(ctx, area->w, time);
-      rectfill(area,
-          px, (task->id+1 + 1) * line_height - GUI_MARGIN - 1,
-          px + ACT_DEADL_W - 1,
-          (task->id+1 + 1) * line_height - GUI_MARGIN - 1 - ACTIVATION_H,
+      rectfill(area, px, y, px + ACT_DEADL_W - 1, y - ACTIVATION_H,
           ACTIVATION_COL);
     }
   }
   /* Deadlines */
-  for (time = nextmult(task->period, ctx->disp_zero,
+  for (time = nextmult(task->period, min_disp_time(ctx),
                        task->phase + task->deadline - task->period);
       time <= max_disp_time(ctx, area->w);  time += task->period)
   {
     if (time >= 0  &&  time < time_upper_limit) {
       px = time_to_px(ctx, area->w, time);
-      rectfill(area,
-          px, (task->id+1 + 1) * line_height - GUI_MARGIN - 1,
-          px + ACT_DEADL_W - 1,
-          (task->id+1 + 1) * line_height - GUI_MARGIN - 1 - DEADLINE_H,
+      rectfill(area, px, y, px + ACT_DEADL_W - 1, y - DEADLINE_H,
           DEADLINE_COL);
     }
   }
@@ -288,82 +535,558 @@ static void disp_at_dt(
 
 /* Display the task names */
 static void disp_headings(struct guictx *ctx, BITMAP *area) {
-  int t;
-
-  if (! ctx->redraw) {
-    return;
-  }
+  int row, t, y, r;
 
   printf_log(LOG_DEBUG, "Re-drawing line headings...\n");
   clear_to_color(area, BG_COL);
+  lanes_layout(ctx, area->h);
 
-  for (t = -1; t < ctx->ts->tasks_count; t++) {
+  for (row = 0; row <= ctx->lanes_shown; row++) {
+    t = lane_task(ctx, row);
+    y = row_y(ctx, row);
     textprintf_ex(area, font,
-        GUI_MARGIN, (t+1 + 1) * get_line_height(ctx, area->h) - GUI_MARGIN -1 - text_height(font),
+        GUI_MARGIN, y - text_height(font),
         TEXT_COL, BG_COL,
         (t >= 0) ? ("T%d") : ("idle"), t);
 
-    if (t == ctx->selected->id) {
+    if (ctx->selected != NULL && t == ctx->selected->id) {
       hline(area,
-          GUI_MARGIN,
-          (t+1 + 1) * get_line_height(ctx, area->h) - GUI_MARGIN,
+          GUI_MARGIN, y + 1,
           GUI_MARGIN + text_length(font, "  "),
           TEXT_COL);
     }
   }
+
+  if (ctx->others) {
+    textprintf_ex(area, font,
+        GUI_MARGIN, others_y(ctx) - text_height(font),
+        TEXT_COL, BG_COL, "+%d", ctx->ts->tasks_count - ctx->lanes_shown);
+  }
+
+  for (r = 1; r <= ctx->res_shown; r++) {
+    textprintf_ex(area, font,
+        GUI_MARGIN, row_y(ctx, res_row(ctx, r)) - text_height(font),
+        TEXT_COL, BG_COL, "R%d", r);
+  }
 }
 
-/* Fills the trace area with all the info */
-static void disp_trace(struct guictx *ctx, BITMAP *area) {
-  int i, t;
-  const struct trace *trace;
-  int lh;       /* line height */
-  long time_end;
-  const struct trace_evt *evt, *prev_evt;
+/* documented in internals.h */
+void disp_trace_static(struct guictx *ctx, BITMAP *area) {
+  int row, t, r;
+
+  printf_log(LOG_DEBUG, "Clearing trace area...\n");
+  clear_to_color(area, BG_COL);
+  lanes_layout(ctx, area->h);
+
+  for (row = 0; row <= ctx->lanes_shown; row++)
+    disp_timeline(ctx, area, row_y(ctx, row) + 1, false, false);
+  if (ctx->others)
+    disp_timeline(ctx, area, others_y(ctx) + 1, false, false);
+  for (r = 1; r <= ctx->res_shown; r++)
+    disp_timeline(ctx, area, row_y(ctx, res_row(ctx, r)) + 1, false, false);
+
+  for (row = 1; row <= ctx->lanes_shown; row++) {
+    t = lane_task(ctx, row);
+    /* Non-periodic activations are only known from the trace */
+    if (ctx->ts->tasks[t].kind == TASK_PERIODIC
+        || ctx->ts->tasks[t].kind == TASK_SERVER)
+      disp_at_dt(ctx, area, &ctx->ts->tasks[t], row_y(ctx, row));
+  }
+}
+
+/* Time at the left border of pixel `px`, unrounded [ms] */
+static double px_time(struct guictx *ctx, long px) {
+  return (px + ctx->px_offset) / ctx->scale + ctx->disp_zero;
+}
+
+/* (Re)allocate the per-pixel coverage of the aggregate lane, empty */
+static void others_reset(struct guictx *ctx, int w) {
+  if (ctx->others_w != w) {
+    free(ctx->others_cov);
+    ctx->others_cov = malloc(w * sizeof(double));
+    ctx->others_w = w;
+    if (ctx->others_cov == NULL) {
+      printf_log(LOG_ERROR, "Out of memory: hidden tasks are not shown.\n");
+      ctx->others_w = 0;
+      return;
+    }
+  }
+  memset(ctx->others_cov, 0, w * sizeof(double));
+}
+
+/* Account a committed event of a shown lane in the aggregate lane */
+static void others_add(struct guictx *ctx, long start_time, long end_time) {
+  long px, endpx;
+  double overlap;
+
+  px = MAX(time_to_px(ctx, ctx->others_w, start_time), 0);
+  endpx = MIN(time_to_px(ctx, ctx->others_w, end_time), ctx->others_w - 1);
+  for (; px <= endpx; px++) {
+    overlap = MIN(end_time, px_time(ctx, px + 1))
+      - MAX(start_time, px_time(ctx, px));
+    if (overlap > 0)
+      ctx->others_cov[px] += overlap;
+  }
+}
+
+/**
+ * Redraw the columns `x1` to `x2` of the aggregate lane: the busy fraction of
+ * the hidden tasks is what the shown lanes leave of the committed events.
+ */
+static void others_draw(struct guictx *ctx, BITMAP *area, int x1, int x2) {
+  long settled_time;
+  double t1, t2, busy;
+  int x, y, h;
+
+  if (! ctx->others || ctx->others_cov == NULL)
+    return;
+
+  settled_time = (ctx->snap.len > 0) ? evt_ms(ctx, ctx->snap.len) : 0;
+  y = others_y(ctx);
+  for (x = MAX(x1, 0); x <= MIN(x2, ctx->others_w - 1); x++) {
+    t1 = px_time(ctx, x);
+    t2 = px_time(ctx, x + 1);
+    busy = MIN(t2, settled_time) - MAX(t1, 0) - ctx->others_cov[x];
+    h = lround(MAX(MIN(busy / (t2 - t1), 1), 0) * (TRACE_H + 1));
+
+    vline(area, x, y - TRACE_H, y, bitmap_mask_color(area));
+    if (h > 0)
+      vline(area, x, y - h + 1, y, OTHERS_COL);
+  }
+}
+
+/**
+ * Draw the committed event `i` from `start_time` to `end_time`, if its lane
+ * is shown, and account it in the aggregate lane unless it already is.
+ */
+static void disp_committed(struct guictx *ctx, BITMAP *area, int i,
+    long start_time, long end_time)
+{
+  const struct trace_evt *evt;
+  int y;
+
+  evt = snap_evt(ctx, i);
+  y = lane_y(ctx, evt->task);
+  if (y >= 0) {
+    disp_evt(ctx, area, evt, start_time, end_time, y);
+    disp_evt_marker(ctx, area, evt, start_time, y);
+    if (i >= ctx->cov_upto && ctx->others && ctx->others_cov != NULL)
+      others_add(ctx, start_time, end_time);
+  }
+}
+
+/* Return the position in `lane` of its last event starting by `time` [ms] */
+static uint32_t lane_preceding(struct guictx *ctx,
+    const struct trace_keyed *lane, long time)
+{
+  struct timespec t;
+  uint32_t p;
+
+  /* Starting by `time` means starting before `time` + 1 */
+  time_cpy(&t, &ctx->ts->t0);
+  time_add_ms(&t, time + 1);
+  p = trace_keyed_before(lane, &ctx->ts->trace, &t);
+  return (p > 0) ? p - 1 : 0;
+}
+
+/* Draw the committed events of the lane of `task` within the window */
+static void disp_lane(struct guictx *ctx, BITMAP *area, int task,
+    long start_time, long end_time)
+{
+  const struct trace_keyed *lane;
+  long evt_time, next_time;
+  uint32_t p;
+  int i;
+
+  lane = trace_index_task(&ctx->index, task);
+  for (p = lane_preceding(ctx, lane, start_time); p < lane->len; p++) {
+    i = lane->evts[p];
+    evt_time = evt_ms(ctx, i);
+    if (evt_time > end_time)
+      break;
+    next_time = evt_ms(ctx, i + 1);
+    if (next_time >= start_time)
+      disp_committed(ctx, area, i, evt_time, next_time);
+  }
+}
+
+/* Return the position in `rh` of its last hold acquired by `time` [ms] */
+static uint32_t hold_preceding(struct guictx *ctx,
+    const struct trace_res_holds *rh, long time)
+{
+  struct timespec t;
+  uint32_t k;
+
+  time_cpy(&t, &ctx->ts->t0);
+  time_add_ms(&t, time + 1);
+  k = trace_holds_before(rh, &ctx->ts->trace, &t);
+  return (k > 0) ? k - 1 : 0;
+}
+
+/* Return when the owner of `hold` started waiting on the lock [ms] */
+static long hold_ready_ms(struct guictx *ctx, const struct trace_hold *hold) {
+  struct timespec t;
+
+  time_cpy(&t, &snap_evt(ctx, hold->acquire)->time);
+  time_add_ns(&t, -hold->wait);
+  return time_diff_ms(&t, &ctx->ts->t0);
+}
+
+/* Return the end of `hold` [ms]: the start of the current event, if open */
+static long hold_end_ms(struct guictx *ctx, const struct trace_hold *hold) {
+  if (hold->release == TRACE_HOLD_OPEN)
+    return evt_ms(ctx, ctx->snap.len);
+  return evt_ms(ctx, hold->release);
+}
+
+/**
+ * Redraw the columns `x1` to `x2` of the lane of resource `res`: its holds,
+ * labelled with their owner, and the hand-offs between them. The owner of a
+ * hold handed off was waiting for it: that is a line above the holds, at a
+ * height set by the task.
+ */
+static void disp_res_lane(struct guictx *ctx, BITMAP *area, int res,
+    int x1, int x2)
+{
+  const struct trace_res_holds *rh;
+  const struct trace_hold *hold;
+  long start_time, end_time, max_wait, acquire_time;
+  int y, top, levels, wait_y, startpx, endpx, task;
+  char owner[16];
+  uint32_t k;
+
+  x1 = MAX(x1, 0);
+  x2 = MIN(x2, area->w - 1);
+  if (x1 > x2)
+    return;
+
+  y = row_y(ctx, res_row(ctx, res));
+  top = y - ctx->lane_h + GUI_MARGIN + 1;
+  levels = MAX((y - HOLD_H - 1 - top) / WAIT_STEP, 1);
+  set_clip_rect(area, x1, top, x2, y + GUI_MARGIN);
+  rectfill(area, x1, top, x2, y + GUI_MARGIN, bitmap_mask_color(area));
+
+  /* Holds acquired after the columns may still have been waited for */
+  rh = trace_holds_res(&ctx->holds, res);
+  start_time = floor(px_time(ctx, x1));
+  end_time = ceil(px_time(ctx, x2 + 1));
+  max_wait = rh->max_wait / 1000000 + 1;
+  for (k = hold_preceding(ctx, rh, start_time - 1); k < rh->len; k++) {
+    hold = &rh->holds[k];
+    acquire_time = evt_ms(ctx, hold->acquire);
+    if (acquire_time - max_wait > end_time)
+      break;
+    task = snap_evt(ctx, hold->acquire)->task;
+    startpx = time_to_px(ctx, area->w, acquire_time);
+    endpx = time_to_px(ctx, area->w, hold_end_ms(ctx, hold));
+
+    rectfill(area, startpx, y, endpx, y - HOLD_H + 1,
+        get_resource_color(res));
+    snprintf(owner, sizeof(owner), "T%d", task);
+    if (endpx - startpx > text_length(font, owner) + 2)
+      textout_ex(area, font, owner, startpx + 2, y - HOLD_H + 2, BG_COL, -1);
+
+    if (trace_hold_handoff_ns(rh, &ctx->ts->trace, k) < 0)
+      continue;
+    rectfill(area, time_to_px(ctx, area->w, hold_end_ms(ctx, hold - 1)),
+        y - HOLD_H / 2 - 1, startpx, y - HOLD_H / 2 + 1, HANDOFF_COL);
+    vline(area, startpx, y - HOLD_H + 1, y, HANDOFF_COL);
+
+    wait_y = y - HOLD_H - 1 - WAIT_STEP * (task % levels);
+    rectfill(area, time_to_px(ctx, area->w, hold_ready_ms(ctx, hold)),
+        wait_y - 1, startpx, wait_y, WAITING_COL);
+  }
+
+  set_clip_rect(area, 0, 0, area->w - 1, area->h - 1);
+}
+
+/* documented in internals.h */
+void disp_trace(struct guictx *ctx, BITMAP *area, struct dirty_rect *dirty) {
+  int i, row;
+  long time_start, time_end;
+  const struct trace_evt *evt, *prev_evt, *cur_evt;
   long evt_time, prev_evt_time;
   struct timespec now;
+  long now_ms, cur_time;
+  int cur_y, r, x1;
+  struct dirty_rect d;
 
-  trace = &ctx->ts->trace;
-
+  lanes_layout(ctx, area->h);
+  time_start = min_disp_time(ctx);
   time_end = max_disp_time(ctx, area->w);
-  lh = get_line_height(ctx, area->h);
+  dirty_clear(&d);
 
+  /* Committed events are drawn from the index of the lanes shown */
   if (ctx->redraw) {
-    printf_log(LOG_DEBUG, "Clearing trace area...\n");
-    clear_to_color(area, BG_COL);
+    clear_to_color(area, bitmap_mask_color(area));
+    if (ctx->others)
+      others_reset(ctx, area->w);
+    ctx->cov_upto = 0;
+    for (row = 0; row <= ctx->lanes_shown; row++)
+      disp_lane(ctx, area, lane_task(ctx, row), time_start, time_end);
+    ctx->trace_from = ctx->cov_upto = ctx->snap.len;
+    dirty_add(&d, 0, 0, area->w - 1, area->h - 1);
+  }
+  else if (! taskset_isactive(ctx->ts)) {
+    return;
+  }
+
+  /* Events before `trace_from` are already drawn, and can't change */
+  prev_evt = cur_evt = NULL;
+  prev_evt_time = cur_time = now_ms = 0;
+  for (i = ctx->trace_from; i <= ctx->snap.len; i ++) {
+    evt = snap_evt(ctx, i);
+    evt_time = evt_ms(ctx, i);
+
+    assert(evt->valid || i == ctx->snap.len); /* not valid implies current */
 
-    for (t = -1; t < ctx->ts->tasks_count; t++) {
-      disp_timeline(ctx, area, (t+1 + 1) * lh - GUI_MARGIN, false, false);
+    if (prev_evt != NULL && evt_time >= time_start) {
+      disp_committed(ctx, area, i - 1, prev_evt_time, evt_time);
+      ctx->cov_upto = MAX(ctx->cov_upto, i);
+      dirty_add(&d, time_to_px(ctx, area->w, prev_evt_time), 0,
+          time_to_px(ctx, area->w, evt_time) + ACT_DEADL_W, area->h - 1);
     }
 
-    for (t = 0; t < ctx->ts->tasks_count; t++) {
-      disp_at_dt(ctx, area, &ctx->ts->tasks[t], lh);
+    if (evt_time > time_end) break;
+
+    if (i == ctx->snap.len && evt->valid && !ctx->ts->stopped) { /* current */
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      now_ms = time_diff_ms(&now, &ctx->ts->t0);
+      cur_evt = evt;
+      cur_time = evt_time;
+      dirty_add(&d, time_to_px(ctx, area->w, evt_time), 0,
+          time_to_px(ctx, area->w, now_ms), area->h - 1);
     }
+
+    prev_evt = evt;
+    prev_evt_time = evt_time;
+    ctx->trace_from = i;
   }
 
-  if (ctx->redraw || taskset_isactive(ctx->ts)) {
-    prev_evt = NULL;
-    for (i = evt_preceding(ctx, ctx->disp_zero); i <= trace->len; i ++) {
-      evt = &trace->events[i];
-      evt_time = time_diff_ms(&evt->time, &ctx->ts->t0);
+  others_draw(ctx, area, d.x1, d.x2);
+
+  /* The holds committed since also show where their owners waited */
+  if (ctx->res_shown > 0 && d.x1 <= d.x2) {
+    x1 = d.x1;
+    if (ctx->res_changed < LONG_MAX)
+      x1 = MAX(MIN(x1, time_to_px(ctx, area->w, ctx->res_changed)), 0);
+    for (r = 1; r <= ctx->res_shown; r++)
+      disp_res_lane(ctx, area, r, x1, d.x2);
+    dirty_add(&d, x1, 0, d.x2, area->h - 1);
+    ctx->res_changed = LONG_MAX;
+  }
 
-      assert(evt->valid || i == trace->len); /* not valid implies current */
+  /* The current event of a hidden task fills the aggregate lane */
+  if (cur_evt != NULL) {
+    cur_y = lane_y(ctx, cur_evt->task);
+    if (cur_y < 0 && ctx->others)
+      cur_y = others_y(ctx);
+    if (cur_y >= 0)
+      disp_evt(ctx, area, cur_evt, cur_time, now_ms, cur_y);
+  }
 
-      if (prev_evt != NULL && evt_time >= ctx->disp_zero) {
-        disp_evt(ctx, area, prev_evt, prev_evt_time, evt_time, lh);
-      }
+  if (d.x1 <= d.x2)
+    dirty_add(dirty, d.x1, d.y1, d.x2, d.y2);
+}
 
-      if (evt_time > time_end) break;
 
-      if (i == trace->len && evt->valid && !ctx->ts->stopped) {  /* current */
-        clock_gettime(CLOCK_MONOTONIC, &now);
-        disp_evt(ctx,area, evt, evt_time, time_diff_ms(&now, &ctx->ts->t0), lh);
-      }
+/****** TOOLTIP ******/
 
-      prev_evt = evt;
-      prev_evt_time = evt_time;
+/* documented in internals.h */
+int evt_at(struct guictx *ctx, int x, int y) {
+  const struct trace_keyed *lane;
+  const struct trace_evt *cur;
+  struct timespec now;
+  long now_ms;
+  int w, row, task, i;
+
+  w = ctx->layers.trace->w;
+  x -= LINESTART_X;
+  if (ctx->lane_h <= 0 || x < 0 || x >= w || y < 0
+      || y >= ctx->layers.trace->h)
+    return -1;
+
+  /* Not the aggregate lane, whose events are hidden */
+  row = y / ctx->lane_h;
+  if (row > ctx->lanes_shown)
+    return -1;
+  task = lane_task(ctx, row);
+
+  cur = snap_evt(ctx, ctx->snap.len);
+  if (cur->valid && ! ctx->ts->stopped && cur->task == task
+      && time_to_px(ctx, w, evt_ms(ctx, ctx->snap.len)) <= x) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    now_ms = time_diff_ms(&now, &ctx->ts->t0);
+    return (x <= time_to_px(ctx, w, now_ms)) ? ctx->snap.len : -1;
+  }
+
+  /* The last event of the lane starting by the right border of the pixel
+   * is drawn over the previous ones */
+  lane = trace_index_task(&ctx->index, task);
+  if (lane->len == 0)
+    return -1;
+  i = lane->evts[lane_preceding(ctx, lane, ceil(px_time(ctx, x + 1)) - 1)];
+  if (time_to_px(ctx, w, evt_ms(ctx, i)) > x
+      || time_to_px(ctx, w, evt_ms(ctx, i + 1)) < x)
+    return -1;
+  return i;
+}
+
+/* Write the description of the hovered event, return its number of lines */
+static int tooltip_text(struct guictx *ctx, char text[TIP_LINES][TIP_LEN]) {
+  const struct trace_evt *evt;
+  struct timespec end;
+  bool current;
+
+  evt = snap_evt(ctx, ctx->hover);
+  current = (ctx->hover == ctx->snap.len);
+  if (current)
+    clock_gettime(CLOCK_MONOTONIC, &end);
+  else
+    time_cpy(&end, &snap_evt(ctx, ctx->hover + 1)->time);
+
+  if (evt->task >= 0)
+    snprintf(text[0], TIP_LEN, "T%d, job %d", evt->task, evt->job);
+  else
+    snprintf(text[0], TIP_LEN, "idle");
+  snprintf(text[1], TIP_LEN, "%s R%d, %u ticks", evt_string(evt->type),
+      evt->res, evt->count);
+  snprintf(text[2], TIP_LEN, "start %.3f ms",
+      time_diff_ns(&evt->time, &ctx->ts->t0) / 1e6);
+  snprintf(text[3], TIP_LEN, "%s %.3f ms", current ? "running" : "lasted",
+      time_diff_ns(&end, &evt->time) / 1e6);
+  return TIP_LINES;
+}
+
+/* Return the resource of the lane at (`x`, `y`) of the main area, or 0 */
+static int res_at(struct guictx *ctx, int x, int y) {
+  int res;
+
+  x -= LINESTART_X;
+  if (ctx->lane_h <= 0 || x < 0 || x >= ctx->layers.trace->w || y < 0
+      || y >= ctx->layers.trace->h)
+    return 0;
+
+  res = y / ctx->lane_h - res_row(ctx, 0);
+  return (res >= 1 && res <= ctx->res_shown) ? res : 0;
+}
+
+/**
+ * Write the state of resource `res` at the pointer: its owner, the tasks
+ * waiting for it, the hand-off to the owner (or to the next one, while free)
+ * and the hand-offs so far. Return the number of lines.
+ */
+static int res_tooltip_text(struct guictx *ctx, int res,
+    char text[TIP_LINES][TIP_LEN])
+{
+  const struct trace_res_holds *rh;
+  const struct trace_hold *hold;
+  const struct trace_evt *owner;
+  long time, max_wait;
+  long long handoff;
+  uint32_t k, next;
+  int x, len;
+  bool waiting;
+
+  rh = trace_holds_res(&ctx->holds, res);
+  x = ctx->mouse_x - LINESTART_X;
+  time = ceil(px_time(ctx, x + 1)) - 1;  /* as evt_at */
+
+  /* The hold at the pointer, if any, else the next one */
+  k = hold_preceding(ctx, rh, time);
+  next = k + 1;
+  hold = NULL;
+  if (k < rh->len && evt_ms(ctx, rh->holds[k].acquire) <= time) {
+    if (time_to_px(ctx, ctx->layers.trace->w,
+          hold_end_ms(ctx, &rh->holds[k])) >= x)
+      hold = &rh->holds[k];
+  }
+  else {
+    next = k;
+  }
+
+  if (hold != NULL) {
+    owner = snap_evt(ctx, hold->acquire);
+    snprintf(text[0], TIP_LEN, "R%d held by T%d, job %d", res, owner->task,
+        owner->job);
+    handoff = trace_hold_handoff_ns(rh, &ctx->ts->trace, k);
+  }
+  else {
+    snprintf(text[0], TIP_LEN, "R%d free", res);
+    handoff = trace_hold_handoff_ns(rh, &ctx->ts->trace, next);
+  }
+
+  /* The owners of the later holds handed off, ready by then */
+  len = snprintf(text[1], TIP_LEN, "waiting:");
+  waiting = false;
+  max_wait = rh->max_wait / 1000000 + 1;
+  for (; next < rh->len && len < TIP_LEN; next++) {
+    hold = &rh->holds[next];
+    if (evt_ms(ctx, hold->acquire) - max_wait > time)
+      break;
+    if (hold_ready_ms(ctx, hold) <= time
+        && trace_hold_handoff_ns(rh, &ctx->ts->trace, next) >= 0) {
+      len += snprintf(text[1] + len, TIP_LEN - len, " T%d",
+          snap_evt(ctx, hold->acquire)->task);
+      waiting = true;
     }
   }
+  if (! waiting)
+    snprintf(text[1], TIP_LEN, "waiting: none");
+
+  if (handoff >= 0)
+    snprintf(text[2], TIP_LEN, "hand-off %.1f us", handoff / 1e3);
+  else
+    snprintf(text[2], TIP_LEN, "no hand-off");
+
+  if (rh->handoffs > 0) {
+    snprintf(text[3], TIP_LEN, "%lu hand-offs: avg %.1f, max %.1f us",
+        rh->handoffs, rh->handoff_sum / 1e3 / rh->handoffs,
+        rh->handoff_max / 1e3);
+  }
+  else {
+    snprintf(text[3], TIP_LEN, "no hand-offs yet");
+  }
+  return TIP_LINES;
+}
+
+/* Place the tooltip next to the pointer, within the frame */
+static void tooltip_place(struct guictx *ctx, BITMAP *frame,
+    char text[TIP_LINES][TIP_LEN], int lines, struct dirty_rect *r)
+{
+  int i, w, h, x, y;
+
+  w = 0;
+  for (i = 0; i < lines; i++)
+    w = MAX(w, text_length(font, text[i]));
+  w += 2 * GUI_MARGIN;
+  h = lines * (text_height(font) + 2) - 2 + 2 * GUI_MARGIN;
+
+  x = ctx->mouse_x + TIP_OFFSET;
+  if (x + w > frame->w)
+    x = ctx->mouse_x - TIP_OFFSET - w;
+  y = ctx->mouse_y + TIP_OFFSET;
+  if (y + h > frame->h)
+    y = ctx->mouse_y - TIP_OFFSET - h;
+
+  r->x1 = MAX(x, 0);
+  r->y1 = MAX(y, 0);
+  r->x2 = MIN(r->x1 + w, frame->w) - 1;
+  r->y2 = MIN(r->y1 + h, frame->h) - 1;
+}
+
+static void disp_tooltip(BITMAP *frame, char text[TIP_LINES][TIP_LEN],
+    int lines, const struct dirty_rect *r)
+{
+  int i;
+
+  rectfill(frame, r->x1, r->y1, r->x2, r->y2, BG_COL);
+  rect(frame, r->x1, r->y1, r->x2, r->y2, TEXT_COL);
+  for (i = 0; i < lines; i++) {
+    textprintf_ex(frame, font, r->x1 + GUI_MARGIN,
+        r->y1 + GUI_MARGIN + i * (text_height(font) + 2),
+        TEXT_COL, -1, "%s", text[i]);
+  }
 }
 
 
@@ -375,9 +1098,6 @@ static void disp_load_axes(struct guictx *ctx, BITMAP *area) {
       GUI_MARGIN, LOAD_PLOT_H / 2 + text_height(font) / 2,
       TEXT_COL, -1, "load");
 
-  /* time axis */
-  disp_timeline(ctx, area, area->h - GUI_MARGIN, false, true);
-
   /* y axis */
   rectfill(area,
       LINESTART_X - 2, area->h - GUI_MARGIN + 1,
@@ -408,19 +1128,18 @@ static int color_for_load(double load) {
   return CPULOAD_AVG_COL;
 }
 
-static double get_load(struct guictx *ctx, long time_ms) {
+/* documented in internals.h */
+double get_load(struct guictx *ctx, long time_ms) {
   int i;
-  const struct trace *trace;
   const struct trace_evt *evt, *prev_evt;
   long evt_time, prev_evt_time;
   struct timespec now;
   long now_ms;
   long start_time, tot_idle_time;
 
-  trace = &ctx->ts->trace;
   start_time = time_ms - ctx->cpuload_window;
 
-  if (trace->len <= 1  ||  start_time < 0  ||  time_ms > time_limit(ctx))
+  if (ctx->snap.len <= 1  ||  start_time < 0  ||  time_ms > time_limit(ctx))
     return NAN;
 
   clock_gettime(CLOCK_MONOTONIC, &now);
@@ -431,11 +1150,11 @@ static double get_load(struct guictx *ctx, long time_ms) {
 
   tot_idle_time = 0;
   prev_evt = NULL;
-  for (i = evt_preceding(ctx, start_time); i <= trace->len; i ++) {
-      evt = &trace->events[i];
+  for (i = evt_preceding(ctx, start_time); i <= ctx->snap.len; i ++) {
+      evt = snap_evt(ctx, i);
       evt_time = time_diff_ms(&evt->time, &ctx->ts->t0);
 
-      assert(evt->valid || i == trace->len); /* not valid implies current */
+      assert(evt->valid || i == ctx->snap.len); /* not valid implies current */
 
       if (prev_evt != NULL && evt->valid && prev_evt->task == -1) {
         assert(evt_time >= start_time);
@@ -445,7 +1164,8 @@ static double get_load(struct guictx *ctx, long time_ms) {
 
       if (evt_time > time_ms) break;
 
-      if (i == trace->len && evt->valid && !ctx->ts->stopped && evt->task == -1)
+      if (i == ctx->snap.len && evt->valid && !ctx->ts->stopped
+          && evt->task == -1)
       {
         tot_idle_time += (time_ms - MAX(evt_time, start_time));
       }
@@ -463,65 +1183,260 @@ static double get_load(struct guictx *ctx, long time_ms) {
   return 1.0 - (double)tot_idle_time / (double) ctx->cpuload_window;
 }
 
-static void disp_load(struct guictx *ctx, BITMAP *area) {
+/**
+ * Plot the cpu load on the (masked) load layer: all of it on a redraw,
+ * otherwise from the first pixel whose load could still change. The plot
+ * starts at `x0`, and is `plot_width` pixels wide.
+ */
+static void disp_load(struct guictx *ctx, BITMAP *area, int x0,
+    int plot_width, struct dirty_rect *dirty)
+{
   int px;
-  int plot_width;
+  int unsettled_px;
+  long time, settled_time;
   double cpuload;
 
-  plot_width = area->w - LINESTART_X - LINEEND_X_ROFF;
-
   if (ctx->redraw) {
-    clear_to_color(area, BG_COL);
-    disp_load_axes(ctx, area);
-  }
-
-  if (ctx->redraw || taskset_isactive(ctx->ts)) {
-    for (px = 0; px < plot_width; px ++) {
-      cpuload = get_load(ctx, px_to_time(ctx, plot_width, px));
-      if (! isnan(cpuload)) {
-        vline(area, 
-            px + LINESTART_X,
-            area->h - GUI_MARGIN - 1 - (cpuload * LOAD_PLOT_H),
-            area->h - GUI_MARGIN - 1,
-            makecol(30, 30, 30));
-        putpixel(area,
-            px + LINESTART_X,
-            area->h - GUI_MARGIN - 1 - (cpuload * LOAD_PLOT_H),
-            color_for_load(cpuload));
-      }
+    clear_to_color(area, bitmap_mask_color(area));
+    ctx->load_from = 0;
+  }
+  else if (! taskset_isactive(ctx->ts)) {
+    return;
+  }
+
+  /* The load up to the beginning of the current event is final */
+  settled_time = -1;
+  if (ctx->snap.len > 0) {
+    settled_time = time_diff_ms(&snap_evt(ctx, ctx->snap.len - 1)->time,
+        &ctx->ts->t0);
+  }
+
+  unsettled_px = -1;
+  for (px = ctx->load_from; px < plot_width; px ++) {
+    time = px_to_time(ctx, plot_width, px);
+    if (unsettled_px < 0 && time > settled_time)
+      unsettled_px = px;
+    cpuload = get_load(ctx, time);
+    if (isnan(cpuload)) {
+      /* Before the first full window, the load is never known */
+      if (time < ctx->cpuload_window)
+        continue;
+      break;
     }
+    /* Erase what an unsettled load left in this column */
+    vline(area, px + x0, 0, area->h - 1, bitmap_mask_color(area));
+    vline(area,
+        px + x0,
+        area->h - GUI_MARGIN - 1 - (cpuload * LOAD_PLOT_H),
+        area->h - GUI_MARGIN - 1,
+        CPULOAD_BG_COL);
+    putpixel(area,
+        px + x0,
+        area->h - GUI_MARGIN - 1 - (cpuload * LOAD_PLOT_H),
+        color_for_load(cpuload));
+    dirty_add(dirty, px + x0, 0, px + x0, area->h - 1);
   }
+  ctx->load_from = (unsettled_px >= 0) ? unsettled_px : px;
 }
 
 
 /****** EXPOSED API  ******/
 
-void display_trace(struct guictx *ctx, BITMAP *area) {
-  BITMAP *timeline_area, *trace_area, *lineheadings_area, *load_area;
+/* documented in internals.h */
+bool layers_create(struct layers *l, int w, int h) {
+  int trace_h;
+
+  trace_h = h - TIMELINE_H - LOAD_H;
+
+  l->frame = create_bitmap(w, h);
+  l->statics = create_bitmap(w, h);
+  l->trace = create_bitmap(w - LINESTART_X - LINEEND_X_ROFF, trace_h);
+  l->load = create_bitmap(w, LOAD_H);
+  if (l->statics != NULL) {
+    l->timeline = create_sub_bitmap(l->statics, 0, h - TIMELINE_H,
+        w, TIMELINE_H);
+    l->headings = create_sub_bitmap(l->statics, 0, 0, LINESTART_X, trace_h);
+    l->markers = create_sub_bitmap(l->statics, LINESTART_X, 0,
+        w - LINESTART_X - LINEEND_X_ROFF, trace_h);
+    l->axes = create_sub_bitmap(l->statics, 0, trace_h, w, LOAD_H);
+  }
+  else {
+    l->timeline = l->headings = l->markers = l->axes = NULL;
+  }
+  l->stopped = false;
+  dirty_clear(&l->tip);
 
-  timeline_area = create_sub_bitmap(area,
-      0, area->h - TIMELINE_H, area->w, TIMELINE_H);
+  return l->frame != NULL && l->statics != NULL && l->trace != NULL
+    && l->load != NULL && l->timeline != NULL && l->headings != NULL
+    && l->markers != NULL && l->axes != NULL;
+}
+
+/* documented in internals.h */
+void layers_destroy(struct layers *l) {
+  /* sub-bitmaps first */
+  if (l->timeline != NULL) destroy_bitmap(l->timeline);
+  if (l->headings != NULL) destroy_bitmap(l->headings);
+  if (l->markers != NULL) destroy_bitmap(l->markers);
+  if (l->axes != NULL) destroy_bitmap(l->axes);
+  if (l->frame != NULL) destroy_bitmap(l->frame);
+  if (l->statics != NULL) destroy_bitmap(l->statics);
+  if (l->trace != NULL) destroy_bitmap(l->trace);
+  if (l->load != NULL) destroy_bitmap(l->load);
+}
+
+/** Redraw the static parts of the main area */
+static void disp_statics(struct guictx *ctx, struct layers *l) {
+  clear_to_color(l->statics, BG_COL);
+  disp_timeline(ctx, l->timeline, TIMELINE_Y, true, true);
+  disp_load_axes(ctx, l->axes);
+  disp_timeline(ctx, l->axes, l->axes->h - GUI_MARGIN, false, true);
+  disp_headings(ctx, l->headings);
+  disp_trace_static(ctx, l->markers);
+  l->stopped = ctx->ts->stopped;
+}
 
-  lineheadings_area = create_sub_bitmap(area,
-      0, 0, LINESTART_X, area->h - TIMELINE_H - LOAD_H);
+void display_trace(struct guictx *ctx, BITMAP *area) {
+  struct layers *l = &ctx->layers;
+  struct dirty_rect dirty, d;
+  int trace_y, load_y;
+  char tip[TIP_LINES][TIP_LEN];
+  int tip_lines, res;
 
-  load_area = create_sub_bitmap(area,
-      0, area->h - LOAD_H - TIMELINE_H, area->w, LOAD_H);
+  trace_y = 0;
+  load_y = l->statics->h - LOAD_H - TIMELINE_H;
 
-  trace_area = create_sub_bitmap(area,
-      LINESTART_X, 0,
-      area->w - LINESTART_X - LINEEND_X_ROFF, area->h - TIMELINE_H - LOAD_H);
+  /* Markers beyond the end of the trace disappear when it stops */
+  if (l->stopped != ctx->ts->stopped)
+    ctx->redraw = true;
 
+  dirty_clear(&dirty);
   if (ctx->redraw) {
-    clear_to_color(timeline_area, BG_COL);
-    disp_timeline(ctx, timeline_area, TIMELINE_Y, true, true);
+    disp_statics(ctx, l);
+    dirty_add(&dirty, 0, 0, l->frame->w - 1, l->frame->h - 1);
+  }
+
+  dirty_clear(&d);
+  disp_trace(ctx, l->trace, &d);
+  dirty_add_from(&dirty, &d, LINESTART_X, trace_y, l->trace->w, l->trace->h);
+
+  dirty_clear(&d);
+  disp_load(ctx, l->load, LINESTART_X,
+      l->load->w - LINESTART_X - LINEEND_X_ROFF, &d);
+  dirty_add_from(&dirty, &d, 0, load_y, l->load->w, l->load->h);
+
+  /* The tooltip follows the pointer, over the composited frame. The hovered
+   * event is looked up every frame, as the trace under it may change. */
+  dirty_add(&dirty, l->tip.x1, l->tip.y1, l->tip.x2, l->tip.y2);
+  dirty_clear(&l->tip);
+  ctx->hover = evt_at(ctx, ctx->mouse_x, ctx->mouse_y - trace_y);
+  res = res_at(ctx, ctx->mouse_x, ctx->mouse_y - trace_y);
+  tip_lines = 0;
+  if (ctx->hover >= 0)
+    tip_lines = tooltip_text(ctx, tip);
+  else if (res > 0)
+    tip_lines = res_tooltip_text(ctx, res, tip);
+  if (tip_lines > 0) {
+    tooltip_place(ctx, l->frame, tip, tip_lines, &l->tip);
+    dirty_add(&dirty, l->tip.x1, l->tip.y1, l->tip.x2, l->tip.y2);
+  }
+
+  if (dirty.x1 > dirty.x2)
+    return;
+
+  /* Composite off-screen, then copy to the screen at once */
+  blit(l->statics, l->frame, dirty.x1, dirty.y1, dirty.x1, dirty.y1,
+      dirty.x2 - dirty.x1 + 1, dirty.y2 - dirty.y1 + 1);
+  overlay(l->trace, l->frame, LINESTART_X, trace_y, &dirty);
+  overlay(l->load, l->frame, 0, load_y, &dirty);
+  if (tip_lines > 0)
+    disp_tooltip(l->frame, tip, tip_lines, &l->tip);
+  blit(l->frame, area, dirty.x1, dirty.y1, dirty.x1, dirty.y1,
+      dirty.x2 - dirty.x1 + 1, dirty.y2 - dirty.y1 + 1);
+}
+
+
+/****** IMAGES ******/
+
+/* documented in internals.h */
+int render_plot_width(int image_w, int image_h) {
+  if (image_h - TIMELINE_H - LOAD_H < TRACE_H)
+    return 0;
+  return MAX(image_w - LINESTART_X - LINEEND_X_ROFF, 0);
+}
+
+/* documented in internals.h */
+int render_plot_x(void) {
+  return LINESTART_X;
+}
+
+/* documented in internals.h */
+bool render_margin(struct guictx *ctx, BITMAP *image) {
+  BITMAP *headings, *axes, *timeline;
+  int trace_h;
+  bool ok;
+
+  trace_h = image->h - TIMELINE_H - LOAD_H;
+  headings = create_sub_bitmap(image, 0, 0, LINESTART_X, trace_h);
+  axes = create_sub_bitmap(image, 0, trace_h, LINESTART_X, LOAD_H);
+  timeline = create_sub_bitmap(image, 0, trace_h + LOAD_H, LINESTART_X,
+      TIMELINE_H);
+
+  ok = headings != NULL && axes != NULL && timeline != NULL;
+  if (ok) {
+    disp_headings(ctx, headings);
+    disp_load_axes(ctx, axes);
+    disp_timeline_legend(ctx, timeline, TIMELINE_Y);
+  }
+
+  if (headings != NULL) destroy_bitmap(headings);
+  if (axes != NULL) destroy_bitmap(axes);
+  if (timeline != NULL) destroy_bitmap(timeline);
+  return ok;
+}
+
+/* documented in internals.h */
+bool render_tile(struct guictx *ctx, BITMAP *tile, int x) {
+  BITMAP *markers, *axes, *timeline, *trace_layer, *load_layer;
+  struct dirty_rect dirty;
+  int trace_h, w;
+  bool ok;
+
+  ctx->px_offset = x;
+  ctx->redraw = true;
+  /* The lane index is shared, but not the buffers */
+  ctx->others_cov = NULL;
+  ctx->others_w = 0;
+
+  w = tile->w;
+  trace_h = tile->h - TIMELINE_H - LOAD_H;
+  markers = create_sub_bitmap(tile, 0, 0, w, trace_h);
+  axes = create_sub_bitmap(tile, 0, trace_h, w, LOAD_H);
+  timeline = create_sub_bitmap(tile, 0, trace_h + LOAD_H, w, TIMELINE_H);
+  trace_layer = create_bitmap(w, trace_h);
+  load_layer = create_bitmap(w, LOAD_H);
+
+  ok = markers != NULL && axes != NULL && timeline != NULL
+    && trace_layer != NULL && load_layer != NULL;
+  if (ok) {
+    dirty_clear(&dirty);
+    disp_trace_static(ctx, markers);
+    disp_trace(ctx, trace_layer, &dirty);
+    masked_blit(trace_layer, markers, 0, 0, 0, 0, w, trace_h);
+
+    clear_to_color(axes, BG_COL);
+    disp_timeline(ctx, axes, axes->h - GUI_MARGIN, false, false);
+    disp_load(ctx, load_layer, 0, w, &dirty);
+    masked_blit(load_layer, axes, 0, 0, 0, 0, w, LOAD_H);
+
+    clear_to_color(timeline, BG_COL);
+    disp_timeline(ctx, timeline, TIMELINE_Y, true, false);
   }
-  disp_load(ctx, load_area);
-  disp_headings(ctx, lineheadings_area);
-  disp_trace(ctx, trace_area);
 
-  destroy_bitmap(load_area);
-  destroy_bitmap(timeline_area);
-  destroy_bitmap(lineheadings_area);
-  destroy_bitmap(trace_area);
+  if (markers != NULL) destroy_bitmap(markers);
+  if (axes != NULL) destroy_bitmap(axes);
+  if (timeline != NULL) destroy_bitmap(timeline);
+  if (trace_layer != NULL) destroy_bitmap(trace_layer);
+  if (load_layer != NULL) destroy_bitmap(load_layer);
+  free(ctx->others_cov);
+  return ok;
 }
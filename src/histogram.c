@@ -0,0 +1,117 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Implementation of the API in "histogram.h"
+ */
+
+#include <string.h>
+
+#include "histogram.h"
+
+
+/** Index of the bucket holding `v` */
+static int bucket_of(unsigned long long v) {
+  int e;
+
+  if (v < HIST_SUB_COUNT)
+    return v;
+  if (v >> HIST_MAX_BITS)
+    v = (1ULL << HIST_MAX_BITS) - 1;
+
+  /* v has its highest bit at position HIST_SUB_BITS - 1 + e, e >= 1 */
+  e = 63 - __builtin_clzll(v) - (HIST_SUB_BITS - 1);
+  return HIST_SUB_COUNT + (e - 1) * (HIST_SUB_COUNT / 2)
+    + (int) (v >> e) - HIST_SUB_COUNT / 2;
+}
+
+/** Lowest value of bucket `b` */
+static long long bucket_low(int b) {
+  int e;
+
+  if (b < HIST_SUB_COUNT)
+    return b;
+  b -= HIST_SUB_COUNT;
+  e = b / (HIST_SUB_COUNT / 2) + 1;
+  return (long long) (HIST_SUB_COUNT / 2 + b % (HIST_SUB_COUNT / 2)) << e;
+}
+
+/** Highest value of bucket `b` */
+static long long bucket_high(int b) {
+  int e;
+
+  if (b < HIST_SUB_COUNT)
+    return b;
+  e = (b - HIST_SUB_COUNT) / (HIST_SUB_COUNT / 2) + 1;
+  return bucket_low(b) + (1LL << e) - 1;
+}
+
+void histogram_init(struct histogram *h) {
+  memset(h, 0, sizeof(struct histogram));
+}
+
+void histogram_record(struct histogram *h, long long ns) {
+  int b;
+
+  if (ns < 0)
+    ns = 0;
+  b = bucket_of(ns);
+
+  /* Single writer: plain increments, published with atomic stores */
+  __atomic_store_n(&h->buckets[b], h->buckets[b] + 1, __ATOMIC_RELAXED);
+  if (ns > h->max)
+    __atomic_store_n(&h->max, ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELEASE);
+}
+
+long long histogram_percentile(const struct histogram *h, double percent) {
+  unsigned long count, target, seen;
+  long long max, v;
+  double rank;
+  int b;
+
+  count = __atomic_load_n(&h->count, __ATOMIC_ACQUIRE);
+  max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+  if (count == 0)
+    return 0;
+
+  /* The rank of the value, rounded up */
+  rank = percent / 100.0 * count;
+  target = (unsigned long) rank;
+  if (target < rank || target < 1)
+    target ++;
+
+  seen = 0;
+  for (b = 0; b < HIST_BUCKETS; b++) {
+    seen += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+    if (seen >= target) {
+      v = bucket_high(b);
+      return (v < max ? v : max);
+    }
+  }
+  return max;
+}
+
+void histogram_export(const struct histogram *h, const char *label, FILE *f) {
+  int b;
+
+  for (b = 0; b < HIST_BUCKETS; b++) {
+    if (h->buckets[b] > 0) {
+      fprintf(f, "%s %lld %lld %u\n", label, bucket_low(b), bucket_high(b),
+          h->buckets[b]);
+    }
+  }
+}
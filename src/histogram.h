@@ -0,0 +1,75 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This module implements high-dynamic-range histograms of durations [ns].
+ *
+ * Buckets are log-linear: values below 2^HIST_SUB_BITS have a bucket each,
+ * then every power of two is split into 2^(HIST_SUB_BITS-1) equal buckets,
+ * so that any value is known within a relative error of 2^-(HIST_SUB_BITS-1).
+ * Memory is fixed and recording is O(1).
+ *
+ * A histogram has a single writer; it may be read concurrently (e.g. by the
+ * GUI) without locks, at the price of a slightly stale view.
+ */
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdio.h>
+
+
+/* Precision: relative error is at most 2^-(HIST_SUB_BITS-1) */
+#ifndef HIST_SUB_BITS
+#define HIST_SUB_BITS 7
+#endif
+
+/* Values are clamped below 2^HIST_MAX_BITS ns (about 18 minutes) */
+#ifndef HIST_MAX_BITS
+#define HIST_MAX_BITS 40
+#endif
+
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS \
+  (HIST_SUB_COUNT + (HIST_MAX_BITS - HIST_SUB_BITS) * (HIST_SUB_COUNT / 2))
+
+struct histogram {
+  unsigned long count;                  /* number of recorded values */
+  long long max;                        /* exact maximum [ns] */
+  unsigned int buckets[HIST_BUCKETS];
+};
+
+/** Clear the histogram */
+void histogram_init(struct histogram *h);
+
+/** Record a value [ns]; negative values count as zero */
+void histogram_record(struct histogram *h, long long ns);
+
+/**
+ * Return the value [ns] below or equal to which `percent`% of the recorded
+ * values fall (the upper bound of its bucket, but never above the maximum),
+ * or 0 if the histogram is empty.
+ */
+long long histogram_percentile(const struct histogram *h, double percent);
+
+/**
+ * Write the non-empty buckets of `h`, one "<label> <low> <high> <count>" line
+ * each, `low` and `high` [ns] being the bounds of the bucket. Lines with
+ * the same label and bounds can be summed to merge runs.
+ */
+void histogram_export(const struct histogram *h, const char *label, FILE *f);
+
+#endif
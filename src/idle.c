@@ -27,10 +27,7 @@
 
 #include "common.h"
 #include "idle.h"
-
-/* from task.c */
-void tick_pp(struct taskset *ts, int id, int res, int type,
-    unsigned long *last_tick);
+#include "logger.h"
 
 
 static void idle_body(struct idle_task *it) {
@@ -43,6 +40,7 @@ static void idle_body(struct idle_task *it) {
         "Task activation failed: pthread_setname_np returned error: ");
     return;
   }
+  logger_thread_init("idle");
 
   sleeptime.tv_sec = 0;
   sleeptime.tv_nsec = 1;  /* Will be rounded _up_ to resolution */
@@ -50,9 +48,9 @@ static void idle_body(struct idle_task *it) {
   printf_log(LOG_INFO, "Idle task started!\n");
 
   while (! it->quit) {
-    run_assert(0 == sem_wait(&it->ts->task_lock));
+    taskset_lock(it->ts);
     tick_pp(it->ts, -1, 0, EVT_RUN, &it->last_tick);
-    run_assert(0 == sem_post(&it->ts->task_lock));
+    taskset_unlock(it->ts);
 
     if (options.idle_yield)
       run_assert(0 == pthread_yield());
@@ -66,6 +64,7 @@ static void idle_body(struct idle_task *it) {
 
 static void *idle_function(void* it) {
   idle_body((struct idle_task*) it);
+  logger_thread_exit();
   return NULL;
 }
 
@@ -0,0 +1,215 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Implementation of the API in "jobs.h"
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobs.h"
+#include "taskset.h"
+#include "time_utils.h"
+#include "bsearch_left.h"
+#include "common.h"
+
+
+/* documented in header file */
+void job_table_init(struct job_table *jt, int capacity, int res_count) {
+  jt->capacity = capacity;
+  jt->res_count = res_count;
+  jt->first = 0;
+  jt->len = 0;
+  jt->overwritten = 0;
+
+  jt->records = malloc(capacity * sizeof(struct job_record));
+  jt->blocked = malloc((size_t) capacity * res_count * sizeof(long long));
+  if (jt->records == NULL || jt->blocked == NULL) {
+    printf_log(LOG_ERROR, "Out of memory while allocating %d job records.\n",
+        capacity);
+    exit(1);
+  }
+  /* Touch every page now, rather than while running */
+  memset(jt->records, 0, capacity * sizeof(struct job_record));
+  memset(jt->blocked, 0, (size_t) capacity * res_count * sizeof(long long));
+}
+
+/* documented in header file */
+void job_table_free(struct job_table *jt) {
+  free(jt->records);
+  free(jt->blocked);
+  jt->records = NULL;
+  jt->blocked = NULL;
+  jt->len = 0;
+}
+
+/* documented in header file */
+struct job_record *job_table_append(struct job_table *jt, int job) {
+  int i;
+  struct job_record *jr;
+
+  if (jt->len < jt->capacity) {
+    i = (jt->first + jt->len) % jt->capacity;
+    jt->len ++;
+  }
+  else {
+    i = jt->first;
+    jt->first = (jt->first + 1) % jt->capacity;
+    jt->overwritten ++;
+  }
+
+  jr = &jt->records[i];
+  memset(jr, 0, sizeof(struct job_record));
+  jr->job = job;
+  jr->blocked = &jt->blocked[(size_t) i * jt->res_count];
+  memset(jr->blocked, 0, jt->res_count * sizeof(long long));
+  return jr;
+}
+
+/* documented in header file */
+void job_record_preempted(struct job_record *jr, int preemptor) {
+  int i;
+
+  jr->preemptions ++;
+  if (preemptor < 0)
+    return;
+  for (i = 0; i < jr->preemptors_count && i < JOB_MAX_PREEMPTORS; i++) {
+    if (jr->preemptors[i] == preemptor)
+      return;
+  }
+  if (jr->preemptors_count < JOB_MAX_PREEMPTORS)
+    jr->preemptors[jr->preemptors_count] = preemptor;
+  jr->preemptors_count ++;
+}
+
+/** Time `t` relative to `t0` [ns], or -1 if `t` was never set */
+static long long rel_ns(const struct timespec *t, const struct timespec *t0) {
+  if (t->tv_sec == 0 && t->tv_nsec == 0)
+    return -1;
+  return time_diff_ns(t, t0);
+}
+
+/* documented in header file */
+int jobs_export(const struct taskset *ts, FILE *f) {
+  int t, i, r, p;
+  long long release, start, completion, blocked;
+  const struct job_table *jt;
+  const struct job_record *jr;
+
+  fprintf(f, "task,job,release,start,completion,start_latency,response,"
+      "preemptions,preemptors,blocked");
+  for (r = 1; r < ts->resources.len; r++)
+    fprintf(f, ",blocked_R%d", r);
+  fprintf(f, ",minflt,majflt,aborted,dmiss\n");
+
+  for (t = 0; t < ts->tasks_count; t++) {
+    jt = &ts->tasks[t].job_table;
+    if (jt->overwritten > 0) {
+      printf_log(LOG_WARNING, "T%d: the oldest %ld job records were "
+          "overwritten, you may want a higher --jobs-size.\n",
+          t, jt->overwritten);
+    }
+
+    for (i = 0; i < jt->len; i++) {
+      jr = &jt->records[(jt->first + i) % jt->capacity];
+      release = rel_ns(&jr->release, &ts->t0);
+      start = rel_ns(&jr->start, &ts->t0);
+      completion = (jr->aborted ? -1 : rel_ns(&jr->completion, &ts->t0));
+
+      fprintf(f, "%d,%d,%lld,%lld,%lld,%lld,%lld,%d,", t, jr->job,
+          release, start, completion,
+          (start >= 0 ? start - release : -1),
+          (completion >= 0 ? completion - release : -1),
+          jr->preemptions);
+      for (p = 0; p < jr->preemptors_count && p < JOB_MAX_PREEMPTORS; p++)
+        fprintf(f, "%sT%d", (p > 0 ? ";" : ""), jr->preemptors[p]);
+      if (jr->preemptors_count > JOB_MAX_PREEMPTORS)
+        fprintf(f, ";...");
+
+      blocked = 0;
+      for (r = 1; r < jt->res_count; r++)
+        blocked += jr->blocked[r];
+      fprintf(f, ",%lld", blocked);
+      for (r = 1; r < ts->resources.len; r++)
+        fprintf(f, ",%lld", (r < jt->res_count ? jr->blocked[r] : 0));
+      fprintf(f, ",%ld,%ld,%d,%d\n", jr->minflt, jr->majflt,
+          jr->aborted, jr->dmiss);
+    }
+  }
+
+  return (ferror(f) ? -1 : 0);
+}
+
+/** Compare a time with the time of a trace event, for bsearch_left */
+static int evt_time_cmp(const void *time_key, const void *evt_item) {
+  return time_cmp(time_key, &((const struct trace_evt *)evt_item)->time);
+}
+
+/** Priority the jobs of task `t` run at: their server's, if aperiodic */
+static int run_priority(const struct taskset *ts, int t) {
+  const struct task *task = &ts->tasks[t];
+
+  return (task->kind == TASK_APERIODIC ? task->host->priority
+      : task->priority);
+}
+
+/* documented in header file */
+long long jobs_max_inversion(const struct taskset *ts, int t) {
+  const struct trace *tr = &ts->trace;
+  const struct job_table *jt = &ts->tasks[t].job_table;
+  const struct job_record *jr;
+  const struct timespec *start, *end;
+  long long inversion, max;
+  size_t len, k;
+  int prio, i;
+
+  /* The last event is complete too, once the taskset is stopped */
+  len = tr->len;
+  if (tr->len < tr->size && tr->events[tr->len].valid)
+    len ++;
+
+  max = 0;
+  prio = run_priority(ts, t);
+  for (i = 0; i < jt->len; i++) {
+    jr = &jt->records[(jt->first + i) % jt->capacity];
+    if (jr->completion.tv_sec == 0 && jr->completion.tv_nsec == 0)
+      continue;
+
+    inversion = 0;
+    k = bsearch_left(&jr->release, tr->events, len, sizeof(struct trace_evt),
+        evt_time_cmp);
+    for (; k < len; k++) {
+      start = &tr->events[k].time;
+      end = (k + 1 < len ? &tr->events[k + 1].time : &jr->completion);
+      if (time_cmp(start, &jr->completion) >= 0)
+        break;
+      if (! evt_running(&tr->events[k])
+          || run_priority(ts, tr->events[k].task) >= prio)
+        continue;
+
+      if (time_cmp(start, &jr->release) < 0)
+        start = &jr->release;
+      if (time_cmp(end, &jr->completion) > 0)
+        end = &jr->completion;
+      if (time_cmp(end, start) > 0)
+        inversion += time_diff_ns(end, start);
+    }
+    if (inversion > max)
+      max = inversion;
+  }
+  return max;
+}
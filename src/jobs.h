@@ -0,0 +1,101 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This module keeps a table of per-job metrics for each task.
+ *
+ * Records are filled in by the task body and by `tick_pp` while the job
+ * runs, so that response times, blocking and preemptions need not be
+ * reconstructed from the trace. Each table is a ring of fixed capacity,
+ * allocated (and touched) before the taskset starts: when it is full, the
+ * oldest records are overwritten.
+ */
+
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+struct taskset;
+
+
+/* Default number of records per task (see `options.jobs_size`) */
+#ifndef JOBS_TABLE_SIZE
+#define JOBS_TABLE_SIZE 1000
+#endif
+
+/* Distinct preempting tasks remembered for each job */
+#ifndef JOB_MAX_PREEMPTORS
+#define JOB_MAX_PREEMPTORS 8
+#endif
+
+/** The metrics of one job */
+struct job_record {
+  int job;                      /* index of the job */
+  struct timespec release;      /* nominal release time */
+  struct timespec start;        /* time the job first ran */
+  struct timespec completion;   /* time the job completed (or was aborted) */
+  int preemptions;              /* times the job was preempted */
+  int preemptors_count;         /* distinct preempting tasks */
+  int preemptors[JOB_MAX_PREEMPTORS];   /* the first of them */
+  long long *blocked;           /* per resource, time waiting for it [ns] */
+  long minflt;                  /* minor page faults */
+  long majflt;                  /* major page faults */
+  bool aborted;                 /* aborted because of OVERRUN_ABORT */
+  bool dmiss;                   /* completed after its deadline */
+};
+
+/** The ring of job records of a task */
+struct job_table {
+  struct job_record *records;   /* `capacity` records */
+  long long *blocked;           /* `capacity * res_count` blocking times */
+  int res_count;                /* number of resources, including R0 */
+  int capacity;
+  int first;                    /* index of the oldest record */
+  int len;                      /* number of valid records */
+  long overwritten;             /* records lost because the ring was full */
+};
+
+/** Allocate and prefault a table of `capacity` records */
+void job_table_init(struct job_table *jt, int capacity, int res_count);
+
+/** Free the memory used by the table */
+void job_table_free(struct job_table *jt);
+
+/** Return a new, cleared record for job `job`, overwriting the oldest if full */
+struct job_record *job_table_append(struct job_table *jt, int job);
+
+/** Account a preemption of the job by task `preemptor` (-1 if unknown) */
+void job_record_preempted(struct job_record *jr, int preemptor);
+
+/**
+ * Write the records of all the tasks of `ts` as CSV, times being in [ns]
+ * relative to the activation of the taskset. Return 0 on success.
+ */
+int jobs_export(const struct taskset *ts, FILE *f);
+
+/**
+ * Return the longest priority inversion [ns] of a recorded job of task `t`:
+ * the time that tasks of lower priority ran, according to the trace, from the
+ * release to the completion of the job. This is blocking as suffered under
+ * any protocol, also when it is not spent waiting on a mutex (as with
+ * ceilings, which keep the job from running at all).
+ */
+long long jobs_max_inversion(const struct taskset *ts, int t);
+
+#endif
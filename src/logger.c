@@ -0,0 +1,257 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logger.h"
+#include "common.h"
+
+
+enum queue_state {
+  QUEUE_FREE,           /* available for registration */
+  QUEUE_USED,           /* owned by a running thread */
+  QUEUE_CLOSING         /* its thread exited: free once drained */
+};
+
+struct log_msg {
+  enum loglevel level;
+  char text[LOGGER_MSG_LEN];
+};
+
+/** The queue of a thread. `head` is only written by the thread, `tail` and
+ *  `reported` only by the background thread. */
+struct log_queue {
+  int state;                    /* one of the QUEUE_* constants */
+  char name[16];                /* cached thread name */
+  unsigned int head;            /* index of the next message to be written */
+  unsigned int tail;            /* index of the next message to be read */
+  unsigned long dropped;        /* messages dropped because of a full queue */
+  unsigned long reported;       /* dropped messages already reported */
+  struct log_queue *next;       /* in the list of all queues */
+  struct log_msg msgs[LOGGER_QUEUE_SIZE];
+};
+
+/* All queues ever allocated, newest first. Queues are only ever pushed, and
+ * reused once free, so the list is walked without locks. */
+static struct log_queue *queues = NULL;
+static __thread struct log_queue *my_queue = NULL;
+
+static pthread_t logger_tid;
+static volatile bool logger_running = false;
+static volatile bool logger_quit = false;
+
+
+/** Write a line to the log file, as printf_log_nosync does */
+static void write_msg(const char *name, enum loglevel level,
+    const char *text) {
+  fprintf(options.logfile, "%6s: %s%s", name, loglevel_string(level), text);
+}
+
+
+/** Write the pending messages of all queues */
+static void drain(void) {
+  struct log_queue *q;
+  unsigned int head;
+  unsigned long dropped;
+  int state;
+
+  for (q = __atomic_load_n(&queues, __ATOMIC_ACQUIRE); q != NULL;
+      q = q->next) {
+    state = __atomic_load_n(&q->state, __ATOMIC_ACQUIRE);
+    if (state == QUEUE_FREE)
+      continue;
+
+    head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    dropped = __atomic_load_n(&q->dropped, __ATOMIC_RELAXED);
+    if (q->tail == head && dropped == q->reported && state != QUEUE_CLOSING)
+      continue;
+
+    /* One message at a time, not to hold RT tasks back for long */
+    for (; q->tail != head; q->tail++) {
+      logfile_lock();
+      write_msg(q->name, q->msgs[q->tail % LOGGER_QUEUE_SIZE].level,
+          q->msgs[q->tail % LOGGER_QUEUE_SIZE].text);
+      logfile_unlock();
+    }
+    __atomic_store_n(&q->tail, head, __ATOMIC_RELEASE);  /* frees the slots */
+    logfile_lock();
+    if (dropped != q->reported) {
+      fprintf(options.logfile, "%6s: %s%lu log messages dropped (queue "
+          "full).\n", q->name, loglevel_string(LOG_WARNING),
+          dropped - q->reported);
+      q->reported = dropped;
+    }
+    if (options.logfile_flush) fflush(options.logfile);
+    logfile_unlock();
+
+    if (state == QUEUE_CLOSING)
+      __atomic_store_n(&q->state, QUEUE_FREE, __ATOMIC_RELEASE);
+  }
+}
+
+
+static void *logger_function(void *arg) {
+  struct timespec period;
+
+  pthread_setname_np(pthread_self(), "logger");
+
+  period.tv_sec = 0;
+  period.tv_nsec = LOGGER_PERIOD * 1000000L;
+  while (! logger_quit) {
+    drain();
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &period, NULL);
+  }
+  drain();
+  return NULL;
+}
+
+
+/* documented in header file */
+void logger_start(void) {
+  int s;
+
+  if (logger_running)
+    return;
+
+  logger_quit = false;
+  s = pthread_create(&logger_tid, NULL, logger_function, NULL);
+  if (s) {
+    printf_log_perror(LOG_WARNING, s, "Logging synchronously: pthread_create "
+        "returned error: ");
+    return;
+  }
+  logger_running = true;
+  atexit(logger_stop);
+}
+
+
+/* documented in header file */
+void logger_stop(void) {
+  if (! logger_running || pthread_equal(pthread_self(), logger_tid))
+    return;
+
+  logger_quit = true;
+  run_assert(0 == pthread_join(logger_tid, NULL));
+  logger_running = false;
+  fflush(options.logfile);
+}
+
+
+/** Set up `q`, just taken by the calling thread */
+static void queue_take(struct log_queue *q, const char *name) {
+  strncpy(q->name, name, sizeof(q->name) - 1);
+  q->name[sizeof(q->name) - 1] = '\0';
+  q->head = q->tail;
+  q->dropped = 0;
+  q->reported = 0;
+  my_queue = q;
+}
+
+
+/* documented in header file */
+void logger_thread_init(const char *name) {
+  struct log_queue *q;
+  int expected;
+
+  if (! logger_running || my_queue != NULL)
+    return;
+
+  /* A queue freed by a thread that exited */
+  for (q = __atomic_load_n(&queues, __ATOMIC_ACQUIRE); q != NULL;
+      q = q->next) {
+    expected = QUEUE_FREE;
+    if (__atomic_compare_exchange_n(&q->state, &expected, QUEUE_USED, false,
+          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      queue_take(q, name);
+      return;
+    }
+  }
+
+  /* Otherwise a new one, touched now rather than while logging */
+  q = malloc(sizeof(struct log_queue));
+  if (q == NULL) {
+    printf_log(LOG_WARNING, "Out of memory for a log queue: thread %s logs "
+        "synchronously.\n", name);
+    return;
+  }
+  memset(q, 0, sizeof(struct log_queue));
+  q->state = QUEUE_USED;
+  queue_take(q, name);
+
+  q->next = __atomic_load_n(&queues, __ATOMIC_RELAXED);
+  while (! __atomic_compare_exchange_n(&queues, &q->next, q, true,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
+}
+
+
+/* documented in header file */
+void logger_thread_exit(void) {
+  if (my_queue == NULL)
+    return;
+
+  __atomic_store_n(&my_queue->state, QUEUE_CLOSING, __ATOMIC_RELEASE);
+  my_queue = NULL;
+}
+
+
+/** Queue the message for `printf_log_write`; false if not to be queued */
+static bool log_enqueue(enum loglevel level, const char *fmt, va_list args) {
+  struct log_queue *q = my_queue;
+  struct log_msg *msg;
+  unsigned int head, tail;
+
+  if (q == NULL || level < LOG_INFO)
+    return false;
+
+  head = q->head;
+  tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+  if (head - tail >= LOGGER_QUEUE_SIZE) {
+    __atomic_store_n(&q->dropped, q->dropped + 1, __ATOMIC_RELAXED);
+    return true;
+  }
+
+  msg = &q->msgs[head % LOGGER_QUEUE_SIZE];
+  msg->level = level;
+  if (vsnprintf(msg->text, LOGGER_MSG_LEN, fmt, args) >= LOGGER_MSG_LEN)
+    msg->text[LOGGER_MSG_LEN - 2] = '\n';  /* truncated */
+  __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+/* documented in common.h */
+void printf_log_write(enum loglevel level, const char *fmt, ...) {
+  va_list args;
+  bool queued;
+
+  va_start(args, fmt);
+  queued = log_enqueue(level, fmt, args);
+  va_end(args);
+  if (queued)
+    return;
+
+  va_start(args, fmt);
+  logfile_lock();
+  vprintf_log_nosync(level, 0, fmt, args);
+  logfile_unlock();
+  va_end(args);
+}
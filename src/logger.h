@@ -0,0 +1,75 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This module implements asynchronous logging for the application threads.
+ *
+ * Each registered thread owns a single-producer single-consumer queue of
+ * messages: printf_log() formats the message into the queue, without locks
+ * nor system calls, and a background thread periodically writes the queued
+ * messages to the log file. When a queue is full, messages are dropped and
+ * counted, rather than blocking the (real-time) producer.
+ *
+ * Errors and warnings, as well as messages from unregistered threads (e.g.
+ * the main thread), are still written synchronously (see common.h), so that
+ * they are not lost when the program exits right after them. The background
+ * thread takes the log file lock once per message, and the lock inherits
+ * priority, so a task writing synchronously waits for at most one message.
+ */
+
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+#include <stdbool.h>
+
+
+/* Messages per queue */
+#ifndef LOGGER_QUEUE_SIZE
+#define LOGGER_QUEUE_SIZE 128
+#endif
+
+/* Maximum length of a message, including the terminating null byte */
+#ifndef LOGGER_MSG_LEN
+#define LOGGER_MSG_LEN 128
+#endif
+
+/* Period of the background thread [ms] */
+#ifndef LOGGER_PERIOD
+#define LOGGER_PERIOD 10
+#endif
+
+/**
+ * Start the background thread. Pending messages are written and the thread
+ * is stopped at exit.
+ */
+void logger_start(void);
+
+/** Write all pending messages and stop the background thread */
+void logger_stop(void);
+
+/**
+ * Register the calling thread, with the given name, so that its messages are
+ * queued. The queue of an exited thread is reused, or else a new one is
+ * allocated: to be called at thread start, not on the real-time path. Does
+ * nothing if the logger is not running or out of memory: messages are then
+ * written synchronously.
+ */
+void logger_thread_init(const char *name);
+
+/** Unregister the calling thread: its queue is freed once drained */
+void logger_thread_exit(void);
+
+#endif
@@ -30,12 +30,28 @@
 #include <semaphore.h>
 #include <sched.h>
 #include <pthread.h>
+#include <malloc.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
 
 #include "common.h"
+#include "periodic.h"
 #include "taskset.h"
+#include "runner.h"
+#include "generator.h"
+#include "probe.h"
+#include "logger.h"
+#include "shmring.h"
 #include "gui.h"
 
 
+/* Amount of heap prefaulted by rt_prepare [bytes] */
+#ifndef HEAP_PREFAULT_SIZE
+#define HEAP_PREFAULT_SIZE (4 * 1024 * 1024)
+#endif
+
+
 /** Print the command line help */
 void help(const char* cmd_name) {
   printf("\
@@ -45,12 +61,27 @@ Runs some threads and displays their schedule.\n\
 Mandatory arguments to long options are mandatory for short options too.\n\
   -h, --help            Display this help and exit.\n\
 \n\
-  -v, --verbose         Verbose output. Useful for debugging purposes.\n\
+  -v, --verbose         Verbose output. Useful for debugging purposes (debug\n\
+                        messages need an INSTRUMENT_LEVEL 2 build).\n\
   -q, --quiet           Quiet mode: will only log warnings and fatal errors.\n\
   -g, --no-gui          Don't start the GUI.\n\
   -f, --taskfile=FILE   Read task definition from FILE (default or \"-\": stdin).\n\
   -t, --tracefile=FILE  Output trace to FILE (default or \"-\": stdout).\n\
       --no-trace        Disable output of the trace.\n\
+      --trace-size=NUM  Record up to NUM events (default: 10000).\n\
+      --jobs=FILE       At exit, write the metrics of each job (release,\n\
+                        start, completion, preemptions, blocking...) to\n\
+                        FILE as CSV.\n\
+      --jobs-size=NUM   Keep the metrics of the last NUM jobs of each task\n\
+                        (default: 1000).\n\
+      --hist=FILE       At exit, write the histograms of response time,\n\
+                        release latency and blocking time of each task to\n\
+                        FILE. Files from several runs can be merged by\n\
+                        summing the counts of identical buckets.\n\
+      --shm=NAME        Publish the trace to the shared-memory segment NAME\n\
+                        (e.g. /scheduletrace), to be watched live by\n\
+                        `scheduletrace-view NAME` from another process.\n\
+                        Ignored with --compare-protocols.\n\
       --trace-flush     Flush the output after writing each trace event.\n\
       --log-flush       Flush the logging output after each write.\n\
       --no-log-sync     Disable synchronization of logging statements \n\
@@ -59,12 +90,98 @@ Mandatory arguments to long options are mandatory for short options too.\n\
 \n\
   -W, --width=NUM       Set window width to NUM.\n\
   -H, --height=NUM      Set window height to NUM.\n\
+      --max-fps=NUM     Redraw the window at most NUM times per second\n\
+                        (default: %d). It is only redrawn on input, or when\n\
+                        new events become visible.\n\
+      --render=FILE     Run headless, then render the trace to the PNG image\n\
+                        FILE, as large as set by -W and -H.\n\
+      --render-range=FROM:TO\n\
+                        Render the trace from FROM to TO ms (default: all).\n\
+      --resource-lanes  Show a lane per resource: its owner, the tasks\n\
+                        waiting for it and the hand-offs (key L toggles it).\n\
 \n\
+", cmd_name, GUI_DEFAULT_MAX_FPS);
+
+  printf("\
 Controlling behaviour:\n\
   -p  --protocol=PROTO  Use the specified protocol for the mutex variables\n\
                         that emulate shared resources.\n\
-                        PROTO can be NONE (default), INHERIT, or PROTECT.\n\
+                        PROTO can be NONE (default), INHERIT, PROTECT,\n\
+                        or CEILING (immediate priority ceiling, implemented\n\
+                        in user space by raising the priority only when\n\
+                        needed).\n\
                         See PTHREAD_MUTEXATTR_GETPROTOCOL(3P) for details.\n\
+      --lock-bench      Before starting, measure the cost of lock/unlock\n\
+                        under each protocol. Per-resource costs of the\n\
+                        selected protocol are always logged at exit.\n\
+      --overrun=POLICY  What to do when a job overruns its deadline.\n\
+                        POLICY can be CONTINUE (default: the job completes\n\
+                        and following jobs start late), SKIP (the job\n\
+                        completes, then the missed activations are skipped),\n\
+                        or ABORT (the job is aborted at its deadline).\n\
+      --arrivals=FILE   Replay the arrivals of sporadic and aperiodic tasks\n\
+                        from FILE, one \"<TASK_ID> <TIME_MS>\" per line.\n\
+                        By default, arrivals are generated pseudo-randomly.\n\
+      --seed=NUM        Seed for generated arrivals (default: 1).\n\
+      --release-engine  Release periodic jobs from a single high-priority\n\
+                        timer thread, which records the actual release\n\
+                        times, instead of letting each task sleep on its own.\n\
+      --timer=BACKEND   How periodic tasks wait for their activation.\n\
+                        BACKEND can be nanosleep (default), timerfd, posix\n\
+                        (a POSIX timer signalling the task thread), or\n\
+                        hybrid (sleep, then spin until the activation).\n\
+      --timer-spin=US   Spinning time of the hybrid timer (default: 50).\n\
+      --timer-slack=NS  Set the timer slack of the tasks (see PR_SET_TIMERSLACK\n\
+                        in PRCTL(2): it is ignored for real-time threads).\n\
+");
+
+  printf("\
+      --duration=MS     Without GUI, stop the taskset after MS milliseconds\n\
+                        (default: 1000).\n\
+      --compare-protocols\n\
+                        Without GUI, run the taskset once per mutex protocol\n\
+                        (NONE, INHERIT, PROTECT, CEILING), each for the same\n\
+                        duration, then print the worst-case response time,\n\
+                        blocking (time lower-priority tasks ran during a\n\
+                        job, as traced), mutex wait and deadline misses of\n\
+                        each task side by side. The --jobs and --hist files\n\
+                        get the protocol name appended.\n\
+      --run-dir=DIR     Run every taskset file in DIR, headless, each in a\n\
+                        child process pinned to a CPU of its own, in\n\
+                        parallel on the CPUs given by --cpus. Traces, logs,\n\
+                        job metrics and histograms are written to --out-dir.\n\
+      --cpus=LIST       CPUs for --run-dir, e.g. \"0-3,6\" (default: the first\n\
+                        available). They should be isolated from the rest of\n\
+                        the system (see isolcpus in KERNEL-PARAMETERS(7)).\n\
+      --out-dir=DIR     Output directory for --run-dir (default: results).\n\
+      --generate=DIR    Write synthetic tasksets to DIR and exit. Utilizations\n\
+                        are drawn with UUniFast, and each taskset records the\n\
+                        seed (see --seed) it can be generated again from.\n\
+      --gen=LIST        Generation parameters, as comma-separated KEY=VALUE:\n\
+                          count=NUM      tasksets to write (default: 100)\n\
+                          tasks=NUM      tasks per taskset (default: 5)\n\
+                          util=U         total utilization (default: 0.5)\n\
+                          periods=MIN-MAX  periods [ms] (default: 10-1000)\n\
+                          dist=DIST      loguniform (default) or harmonic\n\
+                          dl=FRAC        minimum D/T (default: 1, implicit)\n\
+                          res=NUM        shared resources (default: 0)\n\
+                          cs=FRAC        share of each job holding one of\n\
+                                         them (default: 0.1)\n\
+                          prio=RM|DM     priority assignment (default: RM)\n\
+                          ops=NUM        section operations per ms (default:\n\
+                                         measured on this machine)\n\
+      --probe-effect=MAX\n\
+                        Instead of running the taskset, measure how much\n\
+                        tracing inflates the cpu time of the jobs of each\n\
+                        task, for several amounts of work between two ticks\n\
+                        and recording configurations. Exit with an error if\n\
+                        the inflation at 100 units of work per tick exceeds\n\
+                        MAX.\n\
+      --no-mlock        Don't lock the process memory with mlockall() and\n\
+                        don't prefault the heap (by default, this is done\n\
+                        to keep page faults out of the jobs).\n\
+      --stack-size=KB   Stack size of task threads (default: 256 KiB), all\n\
+                        but the last 32 KiB prefaulted at creation.\n\
       --no-affinity     Don't set the CPU affinity of the running tasks.\n\
                         By default, tasks are forced to run on a single\n\
                         processor (the first available is chosen): this flag\n\
@@ -76,7 +193,7 @@ Controlling behaviour:\n\
       --idle-sleep      If set, the idle job will invoke clock_nanosleep() with\n\
                         a 1-ns sleep time at every operation.\n\
 \n\
-", cmd_name);
+");
 
 /*
   -r, --run=SEC         Start taskset immediately, then stop it after (approxi-\n\
@@ -101,11 +218,39 @@ void see_help(const char* cmd_name) {
 #define IDLE_YIELD      261
 #define IDLE_SLEEP      262
 #define LOG_FLUSH       263
+#define OVERRUN         264
+#define ARRIVALS        265
+#define SEED            266
+#define LOCK_BENCH      267
+#define RELEASE_ENGINE  268
+#define TIMER           269
+#define TIMER_SPIN      270
+#define TIMER_SLACK     271
+#define NO_MLOCK        272
+#define STACK_SIZE      273
+#define TRACE_EVENTS    274
+#define JOBS            275
+#define JOBS_SIZE       276
+#define HIST            277
+#define DURATION        278
+#define COMPARE_PROTO   279
+#define RUN_DIR         280
+#define CPUS            281
+#define OUT_DIR         282
+#define GENERATE        283
+#define GEN             284
+#define PROBE_EFFECT    285
+#define MAX_FPS         286
+#define RENDER          287
+#define RENDER_RANGE    288
+#define SHM             289
+#define RES_LANES       290
 
 /** Populate options struct, parsing the command line arguments. */
 void options_init(int argc, char **argv) {
   int s;        /* return value of library functions */
   int c;        /* the parsed option in the parsing loop */
+  pthread_mutexattr_t attr;  /* of the log file mutex */
   char short_options[] = "hvqgf:t:W:H:p:";
   struct option long_options[] = {
     {"help", no_argument, NULL, 'h'},
@@ -124,6 +269,33 @@ void options_init(int argc, char **argv) {
     {"no-affinity", no_argument, NULL, NO_AFFINITY},
     {"idle-yield", no_argument, NULL, IDLE_YIELD},
     {"idle-sleep", no_argument, NULL, IDLE_SLEEP},
+    {"overrun", required_argument, NULL, OVERRUN},
+    {"arrivals", required_argument, NULL, ARRIVALS},
+    {"seed", required_argument, NULL, SEED},
+    {"lock-bench", no_argument, NULL, LOCK_BENCH},
+    {"release-engine", no_argument, NULL, RELEASE_ENGINE},
+    {"timer", required_argument, NULL, TIMER},
+    {"timer-spin", required_argument, NULL, TIMER_SPIN},
+    {"timer-slack", required_argument, NULL, TIMER_SLACK},
+    {"no-mlock", no_argument, NULL, NO_MLOCK},
+    {"stack-size", required_argument, NULL, STACK_SIZE},
+    {"trace-size", required_argument, NULL, TRACE_EVENTS},
+    {"jobs", required_argument, NULL, JOBS},
+    {"jobs-size", required_argument, NULL, JOBS_SIZE},
+    {"hist", required_argument, NULL, HIST},
+    {"duration", required_argument, NULL, DURATION},
+    {"compare-protocols", no_argument, NULL, COMPARE_PROTO},
+    {"run-dir", required_argument, NULL, RUN_DIR},
+    {"cpus", required_argument, NULL, CPUS},
+    {"out-dir", required_argument, NULL, OUT_DIR},
+    {"generate", required_argument, NULL, GENERATE},
+    {"gen", required_argument, NULL, GEN},
+    {"probe-effect", required_argument, NULL, PROBE_EFFECT},
+    {"max-fps", required_argument, NULL, MAX_FPS},
+    {"render", required_argument, NULL, RENDER},
+    {"render-range", required_argument, NULL, RENDER_RANGE},
+    {"shm", required_argument, NULL, SHM},
+    {"resource-lanes", no_argument, NULL, RES_LANES},
     {NULL, 0, NULL, 0}
   };
 
@@ -137,11 +309,40 @@ void options_init(int argc, char **argv) {
   options.taskfile = stdin;
   options.tracefile_name = "-";
   options.tracefile = stdout;
+  options.arrivals_name = NULL;
+  options.arrivals_file = NULL;
+  options.seed = 1;
   options.tracefile_flush = false;
   options.logfile_flush = false;
   options.gui_w = GUI_DEFAULT_W;
   options.gui_h = GUI_DEFAULT_H;
+  options.gui_max_fps = GUI_DEFAULT_MAX_FPS;
+  options.gui_res_lanes = false;
+  options.render_name = NULL;
+  options.render_from = 0;
+  options.render_to = -1;
+  options.shm_name = NULL;
   options.mutex_protocol = PTHREAD_PRIO_NONE;
+  options.lock_bench = false;
+  options.release_engine = false;
+  options.with_mlock = true;
+  options.stack_size = TASK_STACK_SIZE;
+  options.trace_size = TRACE_SIZE;
+  options.jobs_name = NULL;
+  options.jobs_size = JOBS_TABLE_SIZE;
+  options.hist_name = NULL;
+  options.duration = 1000;
+  options.compare_protocols = false;
+  options.run_dir = NULL;
+  CPU_ZERO(&options.run_cpus);
+  options.out_dir = "results";
+  options.gen_dir = NULL;
+  options.gen_params = "";
+  options.probe_max = 0;
+  options.timer_backend = TIMER_NANOSLEEP;
+  options.timer_slack = -1;
+  options.timer_spin = 50;
+  options.overrun_policy = OVERRUN_CONTINUE;
   options.with_affinity = true;
   CPU_ZERO(&options.task_cpuset);
   options.idle_rt_sched = true;
@@ -202,6 +403,36 @@ void options_init(int argc, char **argv) {
           abort();
         }
         break;
+      case MAX_FPS:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%d", &options.gui_max_fps);
+        if (s < 1 || options.gui_max_fps <= 0) {
+          printf("Invalid maximum frame rate (not a positive integer): %s\n",
+              optarg);
+          abort();
+        }
+        break;
+      case RENDER:
+        assert(optarg != NULL);
+        options.render_name = optarg;
+        options.with_gui = false;
+        break;
+      case RENDER_RANGE:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%ld:%ld", &options.render_from, &options.render_to);
+        if (s < 2 || options.render_from < 0
+            || options.render_to <= options.render_from) {
+          printf("Invalid time range (not FROM:TO, in ms): %s\n", optarg);
+          abort();
+        }
+        break;
+      case SHM:
+        assert(optarg != NULL);
+        options.shm_name = optarg;
+        break;
+      case RES_LANES:
+        options.gui_res_lanes = true;
+        break;
       case 'p':
         assert(optarg != NULL);
         if (strcasecmp(optarg, "NONE") == 0)
@@ -210,12 +441,165 @@ void options_init(int argc, char **argv) {
           options.mutex_protocol = PTHREAD_PRIO_INHERIT;
         else if (strcasecmp(optarg, "PROTECT") == 0)
           options.mutex_protocol = PTHREAD_PRIO_PROTECT;
+        else if (strcasecmp(optarg, "CEILING") == 0)
+          options.mutex_protocol = MUTEX_PROTOCOL_CEILING;
         else {
           printf("Invalid value for protocol: %s\n", optarg);
           see_help(argv[0]);
           abort();
         }
         break;
+      case LOCK_BENCH:
+        options.lock_bench = true;
+        break;
+      case RELEASE_ENGINE:
+        options.release_engine = true;
+        break;
+      case TIMER:
+        assert(optarg != NULL);
+        if (strcasecmp(optarg, "nanosleep") == 0)
+          options.timer_backend = TIMER_NANOSLEEP;
+        else if (strcasecmp(optarg, "timerfd") == 0)
+          options.timer_backend = TIMER_TIMERFD;
+        else if (strcasecmp(optarg, "posix") == 0)
+          options.timer_backend = TIMER_POSIX;
+        else if (strcasecmp(optarg, "hybrid") == 0)
+          options.timer_backend = TIMER_HYBRID;
+        else {
+          printf("Invalid value for timer: %s\n", optarg);
+          see_help(argv[0]);
+          abort();
+        }
+        break;
+      case TIMER_SPIN:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%ld", &options.timer_spin);
+        if (s < 1 || options.timer_spin < 0) {
+          printf("Invalid value for timer spin (not a positive integer): "
+              "%s\n", optarg);
+          abort();
+        }
+        break;
+      case NO_MLOCK:
+        options.with_mlock = false;
+        break;
+      case STACK_SIZE:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%d", &options.stack_size);
+        if (s < 1 || options.stack_size <= 0) {
+          printf("Invalid value for stack size (not a positive integer): "
+              "%s\n", optarg);
+          abort();
+        }
+        break;
+      case TRACE_EVENTS:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%d", &options.trace_size);
+        if (s < 1 || options.trace_size < 2) {
+          printf("Invalid value for trace size (not an integer above 1): "
+              "%s\n", optarg);
+          abort();
+        }
+        break;
+      case JOBS:
+        assert(optarg != NULL);
+        options.jobs_name = optarg;
+        break;
+      case HIST:
+        assert(optarg != NULL);
+        options.hist_name = optarg;
+        break;
+      case DURATION:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%ld", &options.duration);
+        if (s < 1 || options.duration <= 0) {
+          printf("Invalid value for duration (not a positive integer): %s\n",
+              optarg);
+          abort();
+        }
+        break;
+      case COMPARE_PROTO:
+        options.compare_protocols = true;
+        options.with_gui = false;
+        break;
+      case RUN_DIR:
+        assert(optarg != NULL);
+        options.run_dir = optarg;
+        options.with_gui = false;
+        break;
+      case CPUS:
+        assert(optarg != NULL);
+        if (runner_parse_cpus(optarg, &options.run_cpus) < 1) {
+          printf("Invalid CPU list: %s\n", optarg);
+          abort();
+        }
+        break;
+      case OUT_DIR:
+        assert(optarg != NULL);
+        options.out_dir = optarg;
+        break;
+      case GENERATE:
+        assert(optarg != NULL);
+        options.gen_dir = optarg;
+        break;
+      case GEN:
+        assert(optarg != NULL);
+        options.gen_params = optarg;
+        break;
+      case PROBE_EFFECT:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%lf", &options.probe_max);
+        if (s < 1 || options.probe_max <= 0) {
+          printf("Invalid maximum inflation (not a positive number): %s\n",
+              optarg);
+          abort();
+        }
+        options.with_gui = false;
+        break;
+      case JOBS_SIZE:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%d", &options.jobs_size);
+        if (s < 1 || options.jobs_size <= 0) {
+          printf("Invalid value for jobs size (not a positive integer): "
+              "%s\n", optarg);
+          abort();
+        }
+        break;
+      case TIMER_SLACK:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%ld", &options.timer_slack);
+        if (s < 1 || options.timer_slack < 0) {
+          printf("Invalid value for timer slack (not a positive integer): "
+              "%s\n", optarg);
+          abort();
+        }
+        break;
+      case OVERRUN:
+        assert(optarg != NULL);
+        if (strcasecmp(optarg, "CONTINUE") == 0)
+          options.overrun_policy = OVERRUN_CONTINUE;
+        else if (strcasecmp(optarg, "SKIP") == 0)
+          options.overrun_policy = OVERRUN_SKIP;
+        else if (strcasecmp(optarg, "ABORT") == 0)
+          options.overrun_policy = OVERRUN_ABORT;
+        else {
+          printf("Invalid value for overrun policy: %s\n", optarg);
+          see_help(argv[0]);
+          abort();
+        }
+        break;
+      case ARRIVALS:
+        assert(optarg != NULL);
+        options.arrivals_name = optarg;
+        break;
+      case SEED:
+        assert(optarg != NULL);
+        s = sscanf(optarg, "%lu", &options.seed);
+        if (s < 1) {
+          printf("Invalid value for seed (not an integer): %s\n", optarg);
+          abort();
+        }
+        break;
       case NO_AFFINITY:
         options.with_affinity = false;
         break;
@@ -240,11 +624,18 @@ void options_init(int argc, char **argv) {
   }
 
   if (options.logfile_sync) {
-    s = sem_init(&options.logfile_sem, 0, 1);
-    if (s < 0) {
-      perror("Error initializing logging semaphore");
+    /* Tasks write errors and warnings under it, so it inherits priority */
+    s = pthread_mutexattr_init(&attr);
+    if (s == 0)
+      s = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    if (s == 0)
+      s = pthread_mutex_init(&options.logfile_mutex, &attr);
+    if (s != 0) {
+      errno = s;
+      perror("Error initializing logging mutex");
       exit(1);
     }
+    pthread_mutexattr_destroy(&attr);
   }
   /* From this point on, printf_log can be used */
   if (! options.logfile_sync) {
@@ -252,6 +643,11 @@ void options_init(int argc, char **argv) {
         " become messy.\n");
   }
 
+  if (options.run_dir != NULL || options.gen_dir != NULL) {
+    options.tracefile = NULL;
+    return;  /* no taskset here: each experiment opens its own files */
+  }
+
   if (strcmp(options.taskfile_name, "-") != 0) {
     options.taskfile = fopen(options.taskfile_name, "r");
     if (options.taskfile == NULL) {
@@ -261,6 +657,15 @@ void options_init(int argc, char **argv) {
     }
   }
 
+  if (options.arrivals_name != NULL) {
+    options.arrivals_file = fopen(options.arrivals_name, "r");
+    if (options.arrivals_file == NULL) {
+      printf_log_perror(LOG_ERROR, errno, "Error while opening file \"%s\": ",
+          options.arrivals_name);
+      exit(1);
+    }
+  }
+
   if (options.tracefile_name != NULL
       && strcmp(options.tracefile_name, "-") != 0)
   {
@@ -301,8 +706,189 @@ void options_init(int argc, char **argv) {
 }
 
 
+/**
+ * Prepare the process for real-time execution: lock all its current and
+ * future memory, keep the heap from being returned to the system, and
+ * prefault some heap for later allocations.
+ */
+void rt_prepare(void) {
+  char *heap;
+
+  if (! options.with_mlock)
+    return;
+
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+    printf_log_perror(LOG_WARNING, errno,
+        "Memory not locked: mlockall returned error: ");
+    return;
+  }
+
+  heap = malloc(HEAP_PREFAULT_SIZE);
+  if (heap != NULL) {
+    memset(heap, 0, HEAP_PREFAULT_SIZE);
+    free(heap);
+  }
+  printf_log(LOG_INFO, "Memory locked, %d KiB of heap prefaulted.\n",
+      HEAP_PREFAULT_SIZE / 1024);
+}
+
+
+/**
+ * Write some results to file `name` using `export`, which returns 0 on
+ * success; `what` describes the results in log messages.
+ */
+void export_results(const struct taskset *ts, const char *name,
+    int (*export)(const struct taskset *, FILE *), const char *what) {
+  FILE *f;
+  int s;
+
+  f = fopen(name, "w");
+  if (f == NULL) {
+    printf_log_perror(LOG_ERROR, errno, "Error while opening file \"%s\": ",
+        name);
+    return;
+  }
+  s = export(ts, f);
+  if (fclose(f) != 0 || s != 0) {
+    printf_log(LOG_ERROR, "Error while writing %s to \"%s\".\n", what, name);
+    return;
+  }
+  printf_log(LOG_INFO, "Wrote %s to \"%s\".\n", what, name);
+}
+
+
+/**
+ * Write the results requested with --jobs and --hist, appending `suffix` to
+ * the file names.
+ */
+void export_all_results(const struct taskset *ts, const char *suffix) {
+  char name[PATH_MAX];
+
+  if (options.jobs_name != NULL) {
+    snprintf(name, sizeof(name), "%s%s", options.jobs_name, suffix);
+    export_results(ts, name, jobs_export, "job metrics");
+  }
+  if (options.hist_name != NULL) {
+    snprintf(name, sizeof(name), "%s%s", options.hist_name, suffix);
+    export_results(ts, name, taskset_export_histograms, "histograms");
+  }
+}
+
+
+/** Activate the taskset, let it run for `options.duration`, then stop it */
+void run_headless(struct taskset *ts) {
+  struct timespec t;
+
+  taskset_activate(ts);
+
+  t.tv_sec = options.duration / 1000;
+  t.tv_nsec = (options.duration % 1000) * 1000000L;
+  while (clock_nanosleep(CLOCK_MONOTONIC, 0, &t, &t) == EINTR)
+    ;
+
+  printf_log(LOG_INFO, "Quitting tasks!\n");
+  taskset_quit(ts);
+  taskset_join(ts);
+}
+
+
+/* Per-task results of a run, as reported by compare_protocols */
+struct run_summary {
+  long long wcrt;       /* worst-case response time [ns] */
+  long long blocking;   /* worst-case priority inversion of a job [ns] */
+  long long mutex_wait; /* worst-case mutex wait of a job [ns] */
+  int dmiss;
+  int jobs;
+};
+
+/**
+ * Run the taskset headless once for each mutex protocol, then print the
+ * per-task results side by side.
+ */
+void compare_protocols(struct taskset *ts) {
+  const int protocols[] = {PTHREAD_PRIO_NONE, PTHREAD_PRIO_INHERIT,
+    PTHREAD_PRIO_PROTECT, MUTEX_PROTOCOL_CEILING};
+  const int count = sizeof(protocols) / sizeof(protocols[0]);
+  struct run_summary *results;
+  struct run_summary *r;
+  char suffix[16];
+  int p, t;
+
+  results = malloc(count * ts->tasks_count * sizeof(struct run_summary));
+  if (results == NULL) {
+    printf_log(LOG_ERROR, "Out of memory while comparing protocols.\n");
+    exit(1);
+  }
+
+  for (p = 0; p < count; p++) {
+    options.mutex_protocol = protocols[p];
+    printf_log(LOG_INFO, "Running the taskset with the %s protocol.\n",
+        mutex_protocol_string(protocols[p]));
+
+    taskset_reset(ts);
+    taskset_create(ts);
+    run_headless(ts);
+    taskset_print_stats(ts);
+
+    snprintf(suffix, sizeof(suffix), ".%s", mutex_protocol_string(protocols[p]));
+    export_all_results(ts, suffix);
+
+    for (t = 0; t < ts->tasks_count; t++) {
+      r = &results[p * ts->tasks_count + t];
+      r->wcrt = ts->tasks[t].hist_response.max;
+      r->blocking = jobs_max_inversion(ts, t);
+      r->mutex_wait = ts->tasks[t].hist_blocking.max;
+      r->dmiss = ts->tasks[t].dmiss;
+      r->jobs = ts->tasks[t].jobs - ts->tasks[t].skipped;
+    }
+  }
+
+  printf("Protocol comparison, %ld ms per run. For each protocol: worst-case "
+      "response time [us], worst-case blocking [us] (time lower-priority "
+      "tasks ran during a job, from the trace), worst-case mutex wait [us], "
+      "misses/jobs.\n", options.duration);
+  printf("%-6s", "task");
+  for (p = 0; p < count; p++)
+    printf(" | %-38s", mutex_protocol_string(protocols[p]));
+  printf("\n");
+  for (t = 0; t < ts->tasks_count; t++) {
+    printf("T%-5d", t);
+    for (p = 0; p < count; p++) {
+      r = &results[p * ts->tasks_count + t];
+      printf(" | %10.1f %8.1f %8.1f %4d/%-4d", r->wcrt / 1000.0,
+          r->blocking / 1000.0, r->mutex_wait / 1000.0, r->dmiss, r->jobs);
+    }
+    printf("\n");
+  }
+
+  free(results);
+}
+
+
+/** Run a single experiment of the runner (see runner.h) */
+int run_experiment(void) {
+  struct taskset ts;
+
+  logger_start();
+  rt_prepare();
+  taskset_init_file(&ts);
+  taskset_print(&ts);
+  taskset_create(&ts);
+  run_headless(&ts);
+  taskset_print_stats(&ts);
+  export_all_results(&ts, "");
+  taskset_free(&ts);
+  return 0;
+}
+
+
 int main(int argc, char **argv) {
   struct taskset ts;
+  struct gen_params gp;
+  int s;
 
   options_init(argc, argv);
 
@@ -311,33 +897,76 @@ int main(int argc, char **argv) {
     exit(0);
   }
 
+  if (options.gen_dir != NULL) {
+    gen_params_init(&gp);
+    gp.seed = options.seed;
+    if (gen_params_parse(&gp, options.gen_params) != 0)
+      exit(1);
+    s = generate_tasksets(&gp, options.gen_dir);
+    exit(s == 0 ? 0 : 1);
+  }
+
+  if (options.run_dir != NULL) {
+    s = runner_run(options.run_dir, &options.run_cpus, options.out_dir,
+        run_experiment);
+    exit(s == 0 ? 0 : 1);
+  }
+
+  logger_start();
+  rt_prepare();
+
   printf_log(LOG_INFO, "Starting scheduletrace...\n");
 
   if (strcmp(options.taskfile_name, "-") == 0) {
     printf_log(LOG_INFO, "Will read taskset description from STDIN.\n");
   }
 
+  if (options.lock_bench) {
+    resources_bench(sched_get_priority_min(TASK_SCHED_POLICY));
+  }
+
   taskset_init_file(&ts);
   taskset_print(&ts);
-  taskset_create(&ts);
+  s = 0;
 
-  printf_log(LOG_INFO, "Taskset successfully initialized!\n");
+  if (options.probe_max > 0) {
+    s = probe_effect(&ts, options.probe_max);
+    exit(s);
+  }
+
+  if (options.shm_name != NULL && ! options.compare_protocols) {
+    ts.trace.ring = shmring_create(options.shm_name, &ts);
+    if (ts.trace.ring == NULL)
+      exit(1);
+  }
 
-  if (options.with_gui) {
+  if (options.compare_protocols) {
+    compare_protocols(&ts);
+  }
+  else if (options.with_gui) {
+    taskset_create(&ts);
+    printf_log(LOG_INFO, "Taskset successfully initialized!\n");
     printf_log(LOG_INFO, "Starting GUI\n");
     gui_run(&ts);
   }
   else {
+    taskset_create(&ts);
+    printf_log(LOG_INFO, "Taskset successfully initialized!\n");
     printf_log(LOG_INFO, "GUI _not_ started upon user request.\n");
+    run_headless(&ts);
+    if (options.render_name != NULL && gui_render(&ts, options.render_name))
+      s = 1;
+  }
 
-    taskset_activate(&ts);
-
-    sleep(1);
-    printf_log(LOG_INFO, "Quitting tasks!\n");
-    taskset_quit(&ts);
-    taskset_join(&ts);
+  if (ts.activated && ! options.compare_protocols) {
+    taskset_print_stats(&ts);
+    export_all_results(&ts, "");
   }
 
+  if (ts.trace.ring != NULL)
+    shmring_destroy(ts.trace.ring);
+  taskset_free(&ts);
+
   printf_log(LOG_INFO, "Exiting scheduletrace.\n");
-  exit(0);
+  exit(s);
 }
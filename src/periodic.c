@@ -14,10 +14,22 @@
  */
 
 #include <time.h>
+#include <errno.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 
 #include "time_utils.h"
 #include "periodic.h"
 
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 
 /* 
  * These functions are largely inspired by prof. Giorgio Buttazzo's slides
@@ -43,8 +55,111 @@ void set_period_ms(struct timespec *at, struct timespec *dl,
 }
 
 
-void wait_for_period_ms(struct timespec *at, struct timespec *dl, long period) {
-  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, at, NULL);
+const char *timer_backend_string(int backend) {
+  switch (backend) {
+    case TIMER_NANOSLEEP: return "nanosleep";
+    case TIMER_TIMERFD:   return "timerfd";
+    case TIMER_POSIX:     return "posix";
+    case TIMER_HYBRID:    return "hybrid";
+    default:              return "unknown";
+  }
+}
+
+
+int set_timer_slack(long slack_ns) {
+  return prctl(PR_SET_TIMERSLACK, slack_ns, 0, 0, 0) < 0 ? -1 : 0;
+}
+
+
+int period_timer_init(struct period_timer *pt, int backend, long spin_ns) {
+  struct sigevent sev;
+
+  pt->backend = backend;
+  pt->spin_ns = spin_ns;
+  pt->fd = -1;
+
+  switch (backend) {
+    case TIMER_TIMERFD:
+      pt->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+      return (pt->fd < 0 ? -1 : 0);
+
+    case TIMER_POSIX:
+      /* The signal is only waited for, never handled */
+      sigemptyset(&pt->sigset);
+      sigaddset(&pt->sigset, PERIOD_TIMER_SIGNAL);
+      errno = pthread_sigmask(SIG_BLOCK, &pt->sigset, NULL);
+      if (errno)
+        return -1;
+
+      sev.sigev_notify = SIGEV_THREAD_ID;
+      sev.sigev_signo = PERIOD_TIMER_SIGNAL;
+      sev.sigev_value.sival_ptr = pt;
+      sev.sigev_notify_thread_id = syscall(SYS_gettid);
+      return timer_create(CLOCK_MONOTONIC, &sev, &pt->timerid);
+
+    default:
+      return 0;
+  }
+}
+
+
+void period_timer_free(struct period_timer *pt) {
+  if (pt->backend == TIMER_TIMERFD && pt->fd >= 0)
+    close(pt->fd);
+  else if (pt->backend == TIMER_POSIX)
+    timer_delete(pt->timerid);
+}
+
+
+void period_timer_wait(struct period_timer *pt, const struct timespec *t) {
+  struct itimerspec its;
+  struct timespec now;
+  uint64_t expirations;
+  siginfo_t info;
+
+  switch (pt->backend) {
+    case TIMER_TIMERFD:
+      its.it_interval.tv_sec = 0;
+      its.it_interval.tv_nsec = 0;
+      time_cpy(&its.it_value, t);
+      if (timerfd_settime(pt->fd, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+        while (read(pt->fd, &expirations, sizeof(expirations)) < 0
+            && errno == EINTR)
+          ;
+      }
+      break;
+
+    case TIMER_POSIX:
+      its.it_interval.tv_sec = 0;
+      its.it_interval.tv_nsec = 0;
+      time_cpy(&its.it_value, t);
+      if (timer_settime(pt->timerid, TIMER_ABSTIME, &its, NULL) == 0) {
+        while (sigwaitinfo(&pt->sigset, &info) < 0 && errno == EINTR)
+          ;
+      }
+      break;
+
+    case TIMER_HYBRID:
+      time_cpy(&now, t);
+      time_add_ns(&now, -pt->spin_ns);
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &now, NULL);
+      do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+      } while (time_cmp(&now, t) < 0);
+      break;
+
+    default:
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, t, NULL);
+  }
+}
+
+
+void wait_for_period_ms(struct period_timer *pt,
+    struct timespec *at, struct timespec *dl, long period) {
+  if (pt == NULL)
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, at, NULL);
+  else
+    period_timer_wait(pt, at);
   time_add_ms(at, period);
   time_add_ms(dl, period);
 }
@@ -55,3 +170,18 @@ int deadline_miss(const struct timespec *dl) {
   clock_gettime(CLOCK_MONOTONIC, &now);
   return (time_cmp(&now, dl) > 0);
 }
+
+
+int skip_missed_periods_ms(struct timespec *at, struct timespec *dl,
+    long period) {
+  struct timespec now;
+  int skipped = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  while (time_cmp(&now, at) > 0) {
+    time_add_ms(at, period);
+    time_add_ms(dl, period);
+    skipped ++;
+  }
+  return skipped;
+}
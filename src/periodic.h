@@ -17,6 +17,52 @@
 #ifndef __PERIODIC_H__
 #define __PERIODIC_H__
 
+#include <time.h>
+#include <signal.h>
+
+/* Signal delivered by TIMER_POSIX timers to the waiting thread */
+#ifndef PERIOD_TIMER_SIGNAL
+#define PERIOD_TIMER_SIGNAL (SIGRTMIN + 1)
+#endif
+
+/** How a thread waits for its next activation (see `options.timer_backend`) */
+enum timer_backend {
+  TIMER_NANOSLEEP,      /* clock_nanosleep(TIMER_ABSTIME) */
+  TIMER_TIMERFD,        /* read() on an absolute timerfd */
+  TIMER_POSIX,          /* sigwaitinfo() on a SIGEV_THREAD_ID POSIX timer */
+  TIMER_HYBRID          /* clock_nanosleep until `spin_ns` earlier, then spin */
+};
+
+/** The per-thread state of a timer backend */
+struct period_timer {
+  int backend;          /* one of the TIMER_* constants */
+  long spin_ns;         /* TIMER_HYBRID only: spinning time */
+  int fd;               /* TIMER_TIMERFD only */
+  timer_t timerid;      /* TIMER_POSIX only */
+  sigset_t sigset;      /* TIMER_POSIX only: contains PERIOD_TIMER_SIGNAL */
+};
+
+/** Converts a TIMER_* constant to its corresponding string */
+const char *timer_backend_string(int backend);
+
+/**
+ * Set the timer slack of the calling thread, in [ns].
+ * Return 0 on success, or -1 (with errno set) on failure.
+ */
+int set_timer_slack(long slack_ns);
+
+/**
+ * Initialize a timer of the given backend, to be used only by the calling
+ * thread. Return 0 on success, or -1 (with errno set) on failure.
+ */
+int period_timer_init(struct period_timer *pt, int backend, long spin_ns);
+
+/** Release the resources of a timer */
+void period_timer_free(struct period_timer *pt);
+
+/** Put the calling thread to sleep until absolute time `t` */
+void period_timer_wait(struct period_timer *pt, const struct timespec *t);
+
 /**
  * Initialize absolute activation time and deadline.
  * If not NULL, t0 is used as first activation in place of the current timestamp
@@ -26,14 +72,24 @@ void set_period_ms(struct timespec *at, struct timespec *dl,
         long period, long deadline, const struct timespec *t0, long phase);
 
 /**
- * Put the thread to sleep until next activation time, then shift both
- * activation time and deadline by one period.
+ * Put the thread to sleep until next activation time using timer `pt`
+ * (or clock_nanosleep if NULL), then shift both activation time and deadline
+ * by one period.
  */
-void wait_for_period_ms(struct timespec *at, struct timespec *dl, long period);
+void wait_for_period_ms(struct period_timer *pt,
+        struct timespec *at, struct timespec *dl, long period);
 
 /**
  * Whether the given deadline has been missed
  */
 int deadline_miss(const struct timespec *dl);
 
+/**
+ * Shift both activation time and deadline by as many periods as needed for
+ * the activation time to be in the future.
+ * Return the number of periods skipped.
+ */
+int skip_missed_periods_ms(struct timespec *at, struct timespec *dl,
+        long period);
+
 #endif
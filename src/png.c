@@ -0,0 +1,504 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "png.h"
+
+
+/* Maximum size of the IDAT chunks */
+#define PNG_CHUNK_SIZE (64 * 1024)
+
+/* Rows of a strip, the unit of work of the compressing threads */
+#ifndef PNG_STRIP_ROWS
+#define PNG_STRIP_ROWS 16
+#endif
+
+#ifndef PNG_MAX_THREADS
+#define PNG_MAX_THREADS 64
+#endif
+
+/* Longest deflate match */
+#define MAX_MATCH 258
+
+/* Largest number of bytes before the Adler-32 sums must be reduced */
+#define ADLER_NMAX 5552
+#define ADLER_BASE 65521
+
+static const unsigned char PNG_SIGNATURE[8] = {
+  0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+};
+
+/* Base lengths and extra bits of the deflate length codes 257..285 */
+static const int LEN_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+  67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int LEN_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+  4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+/** A strip of rows, compressed into deflate blocks of its own */
+struct png_strip {
+  unsigned char *data;  /* the compressed strip */
+  size_t len, size;
+  size_t raw;           /* length of the uncompressed (filtered) strip */
+  uint32_t bits;        /* pending bits, least significant first */
+  int nbits;
+  uint32_t adler_a, adler_b;    /* of the uncompressed strip */
+  bool failed;          /* out of memory */
+};
+
+/** The image being compressed, shared by the threads */
+struct png_job {
+  int w, h;
+  png_row_fn row;
+  void *arg;
+  pthread_mutex_t row_lock;     /* `row` is called by one thread at a time */
+  struct png_strip *strips;
+  int nstrips;
+  int next_strip;       /* the first strip not yet taken, atomically updated */
+  bool failed;
+};
+
+/** The IDAT chunks being written */
+struct png_stream {
+  FILE *f;
+  unsigned char chunk[PNG_CHUNK_SIZE];  /* data of the next IDAT chunk */
+  size_t len;
+};
+
+
+static uint32_t crc_table[256];
+
+static void crc_init(void) {
+  uint32_t c;
+  int n, k;
+
+  for (n = 0; n < 256; n++) {
+    c = n;
+    for (k = 0; k < 8; k++)
+      c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    crc_table[n] = c;
+  }
+}
+
+static uint32_t crc_update(uint32_t crc, const unsigned char *buf, size_t len) {
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void write_chunk(FILE *f, const char *type, const unsigned char *data,
+    size_t len)
+{
+  unsigned char buf[4];
+  uint32_t crc;
+
+  put_u32(buf, len);
+  fwrite(buf, 1, 4, f);
+  fwrite(type, 1, 4, f);
+  if (len > 0)
+    fwrite(data, 1, len, f);
+
+  crc = crc_update(0xffffffffu, (const unsigned char *) type, 4);
+  if (len > 0)
+    crc = crc_update(crc, data, len);
+  put_u32(buf, crc ^ 0xffffffffu);
+  fwrite(buf, 1, 4, f);
+}
+
+
+/****** DEFLATE ******/
+
+static void put_byte(struct png_strip *s, unsigned char b) {
+  unsigned char *data;
+  size_t size;
+
+  if (s->len == s->size) {
+    size = (s->size > 0) ? 2 * s->size : PNG_CHUNK_SIZE;
+    data = realloc(s->data, size);
+    if (data == NULL) {
+      s->failed = true;
+      return;
+    }
+    s->data = data;
+    s->size = size;
+  }
+  s->data[s->len++] = b;
+}
+
+static void put_bits(struct png_strip *s, uint32_t value, int n) {
+  s->bits |= value << s->nbits;
+  s->nbits += n;
+  while (s->nbits >= 8) {
+    put_byte(s, s->bits & 0xff);
+    s->bits >>= 8;
+    s->nbits -= 8;
+  }
+}
+
+static void flush_bits(struct png_strip *s) {
+  if (s->nbits > 0)
+    put_byte(s, s->bits & 0xff);
+  s->bits = 0;
+  s->nbits = 0;
+}
+
+/* Huffman codes are packed starting from their most significant bit */
+static void put_code(struct png_strip *s, uint32_t code, int n) {
+  uint32_t rev;
+  int i;
+
+  rev = 0;
+  for (i = 0; i < n; i++)
+    rev |= ((code >> i) & 1) << (n - 1 - i);
+  put_bits(s, rev, n);
+}
+
+/* Write a literal/length symbol, with the fixed Huffman codes */
+static void put_symbol(struct png_strip *s, int sym) {
+  if (sym < 144)
+    put_code(s, 0x30 + sym, 8);
+  else if (sym < 256)
+    put_code(s, 0x190 + sym - 144, 9);
+  else if (sym < 280)
+    put_code(s, sym - 256, 7);
+  else
+    put_code(s, 0xc0 + sym - 280, 8);
+}
+
+static void put_match(struct png_strip *s, int len, int dist) {
+  int i;
+
+  for (i = 28; LEN_BASE[i] > len; i--)
+    ;
+  put_symbol(s, 257 + i);
+  if (LEN_EXTRA[i] > 0)
+    put_bits(s, len - LEN_BASE[i], LEN_EXTRA[i]);
+  put_code(s, dist - 1, 5);  /* distance codes 0 and 2 have no extra bits */
+}
+
+/**
+ * Compress `buf[start..end)`, where the bytes from `first` on are (already
+ * written) data that matches may refer to.
+ */
+static void compress(struct png_strip *s, const unsigned char *buf,
+    size_t first, size_t start, size_t end)
+{
+  static const size_t DISTS[] = {1, 3};
+  size_t i, l, best, best_dist;
+  int d;
+
+  i = start;
+  while (i < end) {
+    best = 0;
+    best_dist = 0;
+    for (d = 0; d < 2; d++) {
+      if (i < first + DISTS[d])
+        continue;
+      for (l = 0; i + l < end && l < MAX_MATCH
+          && buf[i + l] == buf[i + l - DISTS[d]]; l++)
+        ;
+      if (l > best) {
+        best = l;
+        best_dist = DISTS[d];
+      }
+    }
+
+    if (best >= 3) {
+      put_match(s, best, best_dist);
+      i += best;
+    }
+    else {
+      put_symbol(s, buf[i]);
+      i++;
+    }
+  }
+}
+
+static void adler_update(struct png_strip *s, const unsigned char *buf,
+    size_t len)
+{
+  size_t i, n;
+
+  s->raw += len;
+  while (len > 0) {
+    n = (len < ADLER_NMAX) ? len : ADLER_NMAX;
+    for (i = 0; i < n; i++) {
+      s->adler_a += buf[i];
+      s->adler_b += s->adler_a;
+    }
+    s->adler_a %= ADLER_BASE;
+    s->adler_b %= ADLER_BASE;
+    buf += n;
+    len -= n;
+  }
+}
+
+/**
+ * Append the sums of a strip `len2` bytes long to those of the data before:
+ * a = a1 + a2 - 1, b = b1 + b2 + len2 * (a1 - 1)
+ */
+static void adler_combine(uint32_t *a, uint32_t *b, uint32_t a2, uint32_t b2,
+    size_t len2)
+{
+  uint64_t rem;
+
+  rem = len2 % ADLER_BASE;
+  *b = (*b + b2 + rem * ((*a + ADLER_BASE - 1) % ADLER_BASE)) % ADLER_BASE;
+  *a = (*a + a2 + ADLER_BASE - 1) % ADLER_BASE;
+}
+
+
+/****** STRIPS ******/
+
+static void get_row(struct png_job *job, int y, unsigned char *rgb) {
+  pthread_mutex_lock(&job->row_lock);
+  job->row(job->arg, y, rgb);
+  pthread_mutex_unlock(&job->row_lock);
+}
+
+/**
+ * Compress strip `i` of the image. Each strip ends on a byte boundary, with
+ * an empty stored block unless it is the last one, so that the strips can be
+ * concatenated. Matches never refer to the strip before.
+ */
+static void compress_strip(struct png_job *job, int i, unsigned char *prev,
+    unsigned char *cur, unsigned char *line)
+{
+  struct png_strip *s = &job->strips[i];
+  size_t stride, x;
+  int y, y0, y1;
+
+  stride = (size_t) job->w * 3;
+  y0 = i * PNG_STRIP_ROWS;
+  y1 = (y0 + PNG_STRIP_ROWS < job->h) ? y0 + PNG_STRIP_ROWS : job->h;
+  s->adler_a = 1;
+  s->adler_b = 0;
+
+  put_bits(s, (y1 == job->h), 1);       /* last block */
+  put_bits(s, 1, 2);    /* fixed Huffman codes */
+
+  /* The row above, for the "up" filter */
+  if (y0 > 0)
+    get_row(job, y0 - 1, prev);
+  else
+    memset(prev, 0, stride);
+
+  for (y = y0; y < y1; y++) {
+    get_row(job, y, cur);
+
+    if (y > y0)
+      memcpy(line, line + 1 + stride, 3);  /* the tail of the previous row */
+    line[3] = (y > 0) ? 2 : 0;  /* filter: up, none for the first row */
+    for (x = 0; x < stride; x++)
+      line[4 + x] = cur[x] - prev[x];
+
+    adler_update(s, line + 3, 1 + stride);
+    compress(s, line, (y > y0) ? 0 : 3, 3, 4 + stride);
+
+    memcpy(prev, cur, stride);
+  }
+
+  put_symbol(s, 256);   /* end of block */
+  if (y1 < job->h) {
+    put_bits(s, 0, 3);  /* not last, stored */
+    flush_bits(s);
+    put_byte(s, 0x00);  /* zero length, and its complement */
+    put_byte(s, 0x00);
+    put_byte(s, 0xff);
+    put_byte(s, 0xff);
+  }
+  flush_bits(s);
+}
+
+static void *png_thread(void *arg) {
+  struct png_job *job = arg;
+  unsigned char *prev, *cur, *line;
+  size_t stride;
+  int i;
+
+  stride = (size_t) job->w * 3;
+  prev = malloc(stride);
+  cur = malloc(stride);
+  line = malloc(3 + 1 + stride);  /* previous 3 bytes, filter type, data */
+
+  if (prev == NULL || cur == NULL || line == NULL) {
+    __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+  }
+  else {
+    while ((i = __atomic_fetch_add(&job->next_strip, 1, __ATOMIC_RELAXED))
+        < job->nstrips)
+      compress_strip(job, i, prev, cur, line);
+  }
+
+  free(prev);
+  free(cur);
+  free(line);
+  return NULL;
+}
+
+/** Compress all strips of `job`, with up to `threads` threads */
+static void compress_strips(struct png_job *job, int threads) {
+  pthread_t tids[PNG_MAX_THREADS];
+  int i, created;
+
+  /* The calling thread is one of the pool */
+  threads = (threads < job->nstrips) ? threads : job->nstrips;
+  threads = (threads < PNG_MAX_THREADS) ? threads : PNG_MAX_THREADS;
+  created = 0;
+  for (i = 1; i < threads; i++) {
+    if (pthread_create(&tids[created], NULL, png_thread, job) != 0)
+      break;
+    created ++;
+  }
+  png_thread(job);
+  for (i = 0; i < created; i++)
+    pthread_join(tids[i], NULL);
+}
+
+
+/****** FILE ******/
+
+static void flush_idat(struct png_stream *s) {
+  if (s->len > 0)
+    write_chunk(s->f, "IDAT", s->chunk, s->len);
+  s->len = 0;
+}
+
+static void put_data(struct png_stream *s, const unsigned char *data,
+    size_t len)
+{
+  size_t n;
+
+  while (len > 0) {
+    n = PNG_CHUNK_SIZE - s->len;
+    n = (len < n) ? len : n;
+    memcpy(s->chunk + s->len, data, n);
+    s->len += n;
+    if (s->len == PNG_CHUNK_SIZE)
+      flush_idat(s);
+    data += n;
+    len -= n;
+  }
+}
+
+/** Write the compressed image to the open stream `s` */
+static void write_image(struct png_stream *s, const struct png_job *job) {
+  unsigned char ihdr[13], buf[4];
+  uint32_t adler_a, adler_b;
+  int i;
+
+  s->len = 0;
+
+  fwrite(PNG_SIGNATURE, 1, sizeof(PNG_SIGNATURE), s->f);
+  put_u32(ihdr, job->w);
+  put_u32(ihdr + 4, job->h);
+  ihdr[8] = 8;          /* bit depth */
+  ihdr[9] = 2;          /* color type: RGB */
+  ihdr[10] = 0;         /* compression: deflate */
+  ihdr[11] = 0;         /* filter method */
+  ihdr[12] = 0;         /* no interlace */
+  write_chunk(s->f, "IHDR", ihdr, sizeof(ihdr));
+
+  /* zlib header (deflate, 32K window), the strips and the Adler-32 sum */
+  buf[0] = 0x78;
+  buf[1] = 0x01;
+  put_data(s, buf, 2);
+  adler_a = 1;
+  adler_b = 0;
+  for (i = 0; i < job->nstrips; i++) {
+    put_data(s, job->strips[i].data, job->strips[i].len);
+    adler_combine(&adler_a, &adler_b, job->strips[i].adler_a,
+        job->strips[i].adler_b, job->strips[i].raw);
+  }
+  put_u32(buf, adler_b << 16 | adler_a);
+  put_data(s, buf, 4);
+  flush_idat(s);
+  write_chunk(s->f, "IEND", NULL, 0);
+}
+
+
+/* documented in header file */
+int png_write(const char *path, int w, int h, png_row_fn row, void *arg,
+    int threads)
+{
+  struct png_stream *s;
+  struct png_job job;
+  int i, e;
+
+  job.w = w;
+  job.h = h;
+  job.row = row;
+  job.arg = arg;
+  job.nstrips = (h + PNG_STRIP_ROWS - 1) / PNG_STRIP_ROWS;
+  job.next_strip = 0;
+  job.failed = false;
+  job.strips = calloc(job.nstrips, sizeof(*job.strips));
+  s = malloc(sizeof(*s));
+
+  if (s == NULL || job.strips == NULL) {
+    e = ENOMEM;
+  }
+  else {
+    pthread_mutex_init(&job.row_lock, NULL);
+    compress_strips(&job, threads);
+    pthread_mutex_destroy(&job.row_lock);
+
+    for (i = 0; i < job.nstrips; i++)
+      job.failed = job.failed || job.strips[i].failed;
+
+    if (job.failed) {
+      e = ENOMEM;
+    }
+    else if ((s->f = fopen(path, "wb")) == NULL) {
+      e = errno;
+    }
+    else {
+      crc_init();
+      write_image(s, &job);
+      e = ferror(s->f) ? EIO : 0;
+      if (fclose(s->f) != 0 && e == 0)
+        e = errno;
+    }
+  }
+
+  if (job.strips != NULL) {
+    for (i = 0; i < job.nstrips; i++)
+      free(job.strips[i].data);
+  }
+  free(job.strips);
+  free(s);
+  errno = e;
+  return (e == 0) ? 0 : -1;
+}
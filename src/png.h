@@ -0,0 +1,47 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This module writes PNG images, without external libraries.
+ *
+ * Image data is compressed with a simple deflate encoder, using the fixed
+ * Huffman codes and matches at distance 1 and 3 (the previous byte and the
+ * previous pixel) only. Rows are filtered with the "up" filter, so that
+ * flat areas, like those of a schedule, turn into long runs of zeroes.
+ *
+ * Strips of rows are compressed concurrently, each into blocks of its own
+ * that end on a byte boundary, and then concatenated into the image data.
+ */
+
+#ifndef __PNG_H__
+#define __PNG_H__
+
+/**
+ * Fill `rgb` with row `y` of the image, as 3 bytes (red, green, blue) per
+ * pixel.
+ */
+typedef void (*png_row_fn)(void *arg, int y, unsigned char *rgb);
+
+/**
+ * Write a `w`x`h` 8-bit RGB image to the file `path`, compressing it with up
+ * to `threads` threads. `row` is asked for each row, maybe more than once and
+ * out of order, but never by two threads at the same time.
+ * Return 0 on success, -1 on failure (with errno set).
+ */
+int png_write(const char *path, int w, int h, png_row_fn row, void *arg,
+    int threads);
+
+#endif
@@ -0,0 +1,264 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "probe.h"
+#include "time_utils.h"
+#include "common.h"
+
+
+enum probe_config {
+  PROBE_TRACED,
+  PROBE_PRINTED,
+  PROBE_CONFIGS
+};
+
+static const char *PROBE_CONFIG_NAMES[PROBE_CONFIGS] = {
+  "traced", "printed"
+};
+
+/* Units of work between two ticks */
+static const unsigned int PROBE_WORK[] = {1, 10, 100, 1000};
+#define PROBE_WORKS (sizeof(PROBE_WORK) / sizeof(PROBE_WORK[0]))
+
+/* Trace events a job may add: START, COMPLETION, DEADLINE, and ACQUIRE, RUN
+ * and RELEASE for each section (plus one if preempted) */
+#define PROBE_JOB_EVENTS(task) (4 * (task)->sections_count + 3)
+
+
+/** The measures on a task, taken by `probe_thread` */
+struct probe_run {
+  struct task *task;
+  FILE *printed;                /* where to print events, NULL to skip */
+  double inflation[PROBE_CONFIGS][PROBE_WORKS];
+};
+
+
+/** Run the operations of the sections of `task` as plain synthetic work */
+static void probe_untraced(const struct task *task, unsigned int units) {
+  unsigned long op;
+  int s;
+
+  for (s = 0; s < task->sections_count; s++) {
+    for (op = task->sections[s].avg; op > 0; op--)
+      synthetic_work(units);
+  }
+}
+
+
+/** Run a job of `task` through task_job(), with `units` of work per tick */
+static void probe_traced(struct task *task, unsigned int units) {
+  struct taskset *ts = task->ts;
+
+  taskset_lock(ts);
+  if (ts->trace.len + PROBE_JOB_EVENTS(task) >= ts->trace.size) {
+    ts->trace.len = 0;  /* rewind, rather than filling up */
+    ts->next_evt = trace_next(&ts->trace);
+  }
+  taskset_unlock(ts);
+
+  /* No deadline to miss or to abort the job at: only ticks are measured */
+  clock_gettime(CLOCK_MONOTONIC, &task->rel);
+  time_cpy(&task->dl, &task->rel);
+  time_add_ms(&task->dl, PROBE_NO_DEADLINE);
+  task->op_work = units;
+  task_job(task);
+}
+
+
+/**
+ * Return the inflation factor of the jobs of `task`: the ratio of the minimum
+ * thread cpu times of PROBE_RUNS jobs with and without tracing.
+ * Runs are interleaved, so that both see the same machine conditions.
+ */
+static double probe_measure(struct task *task, unsigned int units) {
+  struct timespec start, end;
+  long long t, min[2];
+  int i, traced;
+
+  min[0] = min[1] = -1;
+  for (i = 0; i < PROBE_RUNS; i++) {
+    for (traced = 0; traced < 2; traced++) {
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+      if (traced)
+        probe_traced(task, units);
+      else
+        probe_untraced(task, units);
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+      t = time_diff_ns(&end, &start);
+      if (min[traced] < 0 || t < min[traced])
+        min[traced] = t;
+    }
+  }
+  return (double) min[1] / (min[0] > 0 ? min[0] : 1);
+}
+
+
+/** Take all the measures on a task, at its priority if run in its thread */
+static void *probe_thread(void *arg) {
+  struct probe_run *run = arg;
+  struct task *task = run->task;
+  FILE *tracefile;
+  int c, w;
+
+  resources_thread_init(task->priority);
+  tracefile = options.tracefile;
+  for (c = 0; c < PROBE_CONFIGS; c++) {
+    options.tracefile = (c == PROBE_PRINTED ? run->printed : NULL);
+    for (w = 0; w < PROBE_WORKS; w++) {
+      run->inflation[c][w] = -1;
+      if (c != PROBE_PRINTED || run->printed != NULL)
+        run->inflation[c][w] = probe_measure(task, PROBE_WORK[w]);
+    }
+  }
+  options.tracefile = tracefile;
+  task->op_work = 0;
+  return NULL;
+}
+
+
+/**
+ * Run `probe_thread` for `run` in a thread with the scheduling policy and
+ * priority of the task, or in the calling thread if it can't be created.
+ */
+static void probe_task(struct probe_run *run) {
+  int s;
+  pthread_t tid;
+  pthread_attr_t tattr;
+  struct sched_param sched_param;
+
+  s = pthread_attr_init(&tattr);
+  assert(s == 0);
+  pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&tattr, TASK_SCHED_POLICY);
+  sched_param.sched_priority = run->task->priority;
+  pthread_attr_setschedparam(&tattr, &sched_param);
+  if (options.with_affinity)
+    pthread_attr_setaffinity_np(&tattr, sizeof(cpu_set_t),
+        &options.task_cpuset);
+
+  s = pthread_create(&tid, &tattr, probe_thread, run);
+  pthread_attr_destroy(&tattr);
+  if (s) {
+    printf_log_perror(LOG_WARNING, s, "Probing T%d in the calling thread, "
+        "not at its priority: pthread_create returned error: ",
+        run->task->id);
+    probe_thread(run);
+    return;
+  }
+  pthread_join(tid, NULL);
+}
+
+
+/* documented in header file */
+int probe_effect(struct taskset *ts, double max_inflation) {
+  struct probe_run run;
+  struct task *task;
+  struct task_section *sections, *capped;
+  double worst;
+  int t, c, w, s;
+  int failed;
+
+  if (options.with_affinity
+      && sched_setaffinity(0, sizeof(cpu_set_t), &options.task_cpuset) < 0) {
+    printf_log_perror(LOG_WARNING, errno, "Probe not pinned to the task CPU: "
+        "sched_setaffinity returned error: ");
+  }
+
+  run.printed = fopen("/dev/null", "w");
+  if (run.printed == NULL) {
+    printf_log_perror(LOG_WARNING, errno, "Not measuring the printed "
+        "configuration: can't open /dev/null: ");
+  }
+
+  ts->next_evt = trace_next(&ts->trace);
+
+  printf("Probe effect: job cpu time with tracing / without, by units of "
+      "work per tick.\n");
+  printf("%-6s %-10s", "task", "config");
+  for (w = 0; w < PROBE_WORKS; w++)
+    printf(" %8u", PROBE_WORK[w]);
+  printf("\n");
+
+  failed = 0;
+  worst = 0;
+  for (t = 0; t < ts->tasks_count; t++) {
+    task = &ts->tasks[t];
+    /* servers have no sections of their own, aperiodic jobs need one */
+    if (task->sections_count == 0 || task->kind == TASK_APERIODIC)
+      continue;
+
+    /* Shorten long sections to keep the measure quick */
+    capped = malloc(task->sections_count * sizeof(struct task_section));
+    if (capped == NULL) {
+      printf_log(LOG_ERROR, "Out of memory while probing T%d.\n", t);
+      exit(1);
+    }
+    for (s = 0; s < task->sections_count; s++) {
+      capped[s] = task->sections[s];
+      if (capped[s].avg > PROBE_MAX_OPS)
+        capped[s].avg = PROBE_MAX_OPS;
+    }
+    sections = task->sections;
+    task->sections = capped;
+
+    run.task = task;
+    probe_task(&run);
+
+    task->sections = sections;
+    free(capped);
+
+    for (c = 0; c < PROBE_CONFIGS; c++) {
+      printf("T%-5d %-10s", t, PROBE_CONFIG_NAMES[c]);
+      for (w = 0; w < PROBE_WORKS; w++) {
+        if (run.inflation[c][w] < 0) {
+          printf(" %8s", "-");
+          continue;
+        }
+        printf(" %8.2f", run.inflation[c][w]);
+
+        if (PROBE_WORK[w] == PROBE_CHECK_WORK) {
+          if (run.inflation[c][w] > worst)
+            worst = run.inflation[c][w];
+          if (run.inflation[c][w] > max_inflation)
+            failed = 1;
+        }
+      }
+      printf("\n");
+    }
+  }
+  fflush(stdout);
+  if (run.printed != NULL)
+    fclose(run.printed);
+
+  if (failed) {
+    printf_log(LOG_ERROR, "Inflation up to %.2f at %d units of work per tick, "
+        "above the maximum of %.2f.\n", worst, PROBE_CHECK_WORK,
+        max_inflation);
+  }
+  else {
+    printf_log(LOG_INFO, "Inflation up to %.2f at %d units of work per tick, "
+        "within the maximum of %.2f.\n", worst, PROBE_CHECK_WORK,
+        max_inflation);
+  }
+  return failed;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This module measures the probe effect of the recorder: how much tracing
+ * inflates the execution time of jobs.
+ *
+ * Each task is probed in a thread with its scheduling policy and priority.
+ * The operations of its sections run as units of synthetic work (a short
+ * busy loop), once alone and once as a real job of the task, through
+ * task_job(): the task body then ticks, acquires and releases resources and
+ * records the job as it does while running. Times are measured with the
+ * thread cpu clock, and the inflation factor is their ratio.
+ *
+ * The measure is repeated for several granularities (units of work between
+ * two ticks) and recording configurations:
+ *  - traced:  events are recorded in the trace only;
+ *  - printed: every event is also printed, to /dev/null.
+ * Aperiodic tasks are not probed, as their jobs run on a server's budget.
+ */
+
+#ifndef __PROBE_H__
+#define __PROBE_H__
+
+#include "taskset.h"
+
+
+/* Operations run per section, at most: inflation is a ratio, so long
+ * sections are shortened to keep the measure quick */
+#ifndef PROBE_MAX_OPS
+#define PROBE_MAX_OPS 20000
+#endif
+
+/* Relative deadline of probed jobs [ms]: far enough never to be missed */
+#ifndef PROBE_NO_DEADLINE
+#define PROBE_NO_DEADLINE 3600000
+#endif
+
+/* Each measure is the minimum of this many runs */
+#ifndef PROBE_RUNS
+#define PROBE_RUNS 5
+#endif
+
+/* Granularity [units of work per tick] the threshold is checked at */
+#ifndef PROBE_CHECK_WORK
+#define PROBE_CHECK_WORK 100
+#endif
+
+/**
+ * Measure the probe effect on the tasks of `ts`, initialized but not created,
+ * and print a report to stdout.
+ * Return 0 if no inflation factor at PROBE_CHECK_WORK units of work per tick
+ * exceeds `max_inflation`, 1 otherwise.
+ */
+int probe_effect(struct taskset *ts, double max_inflation);
+
+#endif
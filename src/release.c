@@ -0,0 +1,263 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Implementation of the API in "release.h"
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <linux/futex.h>
+
+#include "release.h"
+#include "logger.h"
+#include "task.h"
+#include "time_utils.h"
+#include "common.h"
+
+
+static long futex(unsigned int *uaddr, int op, unsigned int val) {
+  return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+/** Whether the release of `a` comes before the one of `b` */
+static inline bool heap_before(const struct task *a, const struct task *b) {
+  return time_cmp(&a->release.next, &b->release.next) < 0;
+}
+
+/** Restore the heap property moving down the element at `i` */
+static void heap_sift_down(struct release_engine *re, int i) {
+  int child;
+  struct task *t;
+
+  while ((child = 2 * i + 1) < re->heap_len) {
+    if (child + 1 < re->heap_len
+        && heap_before(re->heap[child + 1], re->heap[child]))
+      child ++;
+    if (! heap_before(re->heap[child], re->heap[i]))
+      break;
+    t = re->heap[i];
+    re->heap[i] = re->heap[child];
+    re->heap[child] = t;
+    i = child;
+  }
+}
+
+/** Release the current job of `task`, recording the activation event */
+static void release_task(struct task *task, const struct timespec *now) {
+  task_record_release(task, task->release.issued,
+      time_diff_ns(now, &task->release.next));
+  task->release.issued ++;
+
+  __atomic_add_fetch(&task->release.pending, 1, __ATOMIC_RELEASE);
+  futex(&task->release.pending, FUTEX_WAKE_PRIVATE, 1);
+}
+
+/** Arm the timer for the earliest release; return 0 on success */
+static int engine_arm(struct release_engine *re) {
+  struct itimerspec its;
+
+  its.it_interval.tv_sec = 0;
+  its.it_interval.tv_nsec = 0;
+  time_cpy(&its.it_value, &re->heap[0]->release.next);
+  return timerfd_settime(re->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/** Main loop of the engine */
+static void engine_loop(struct taskset *ts) {
+  struct release_engine *re = &ts->release_engine;
+  struct timespec now;
+  uint64_t expirations;
+  ssize_t s;
+
+  s = pthread_setname_np(pthread_self(), "release");
+  if (s)
+    printf_log_perror(LOG_WARNING, s, "pthread_setname_np returned error: ");
+  logger_thread_init("release");
+
+  printf_log(LOG_INFO, "Release engine started for %d periodic task%s.\n",
+      re->heap_len, (re->heap_len == 1 ? "" : "s"));
+
+  while (! re->quit && re->heap_len > 0) {
+    if (engine_arm(re) < 0) {
+      printf_log_perror(LOG_ERROR, errno, "timerfd_settime returned error: ");
+      break;
+    }
+    s = read(re->timerfd, &expirations, sizeof(expirations));
+    if (s < 0 && errno != EINTR) {
+      printf_log_perror(LOG_ERROR, errno, "Error reading from timerfd: ");
+      break;
+    }
+    if (re->quit)
+      break;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (time_cmp(&re->heap[0]->release.next, &now) <= 0) {
+      release_task(re->heap[0], &now);
+      time_add_ms(&re->heap[0]->release.next, re->heap[0]->period);
+      heap_sift_down(re, 0);
+    }
+  }
+}
+
+static void *engine_function(void *ts) {
+  engine_loop((struct taskset *) ts);
+  logger_thread_exit();
+  return NULL;
+}
+
+
+/* handle errors that may happen in release_engine_start */
+#define handle_error(en, fname) \
+  do { \
+    printf_log_perror(LOG_ERROR, en, \
+        "Couldn't start release engine: Got an error while calling %s: ", \
+        fname); \
+    exit(1); \
+  } while (0)
+
+/* documented in header file */
+void release_engine_start(struct taskset *ts) {
+  struct release_engine *re = &ts->release_engine;
+  pthread_attr_t tattr;
+  struct sched_param sched_param;
+  struct task *task;
+  int i;
+  int s;
+
+  re->quit = false;
+  re->heap_len = 0;
+  re->heap = malloc((ts->tasks_count + 1) * sizeof(struct task *));
+  if (re->heap == NULL) {
+    printf_log(LOG_ERROR, "Out of memory while starting release engine.\n");
+    exit(1);
+  }
+
+  /* Phases are all in the future of t0: no need to sift while filling */
+  for (i = 0; i < ts->tasks_count; i++) {
+    task = &ts->tasks[i];
+    if (task->kind != TASK_PERIODIC)
+      continue;
+    task->release.pending = 0;
+    task->release.issued = 0;
+    time_cpy(&task->release.next, &ts->t0);
+    time_add_ms(&task->release.next, task->phase);
+    re->heap[re->heap_len++] = task;
+  }
+  for (i = re->heap_len / 2 - 1; i >= 0; i--)
+    heap_sift_down(re, i);
+
+  re->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (re->timerfd < 0) handle_error(errno, "timerfd_create");
+
+  s = pthread_attr_init(&tattr);
+  if (s) handle_error(s, "pthread_attr_init");
+
+  s = pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+  if (s) handle_error(s, "pthread_attr_setinheritsched");
+
+  s = pthread_attr_setschedpolicy(&tattr, TASK_SCHED_POLICY);
+  if (s) handle_error(s, "pthread_attr_setschedpolicy");
+
+  sched_param.sched_priority = RELEASE_ENGINE_PRIORITY;
+  s = pthread_attr_setschedparam(&tattr, &sched_param);
+  if (s) handle_error(s, "pthread_attr_setschedparam");
+
+  /* Share the tasks' CPU, so that releases preempt them as timers would */
+  if (options.with_affinity) {
+    s = pthread_attr_setaffinity_np(
+        &tattr, sizeof(cpu_set_t), &options.task_cpuset);
+    if (s) handle_error(s, "pthread_attr_setaffinity_np");
+  }
+
+  s = pthread_create(&re->tid, &tattr, engine_function, ts);
+  if (s) handle_error(s, "pthread_create");
+
+  pthread_attr_destroy(&tattr);
+  re->running = true;
+}
+#undef handle_error
+
+/* documented in header file */
+void release_engine_stop(struct taskset *ts) {
+  struct release_engine *re = &ts->release_engine;
+  struct itimerspec its;
+  int i;
+
+  if (! re->running)
+    return;
+
+  re->quit = true;
+
+  /* Expire the timer right away, to wake up the engine */
+  its.it_interval.tv_sec = 0;
+  its.it_interval.tv_nsec = 0;
+  its.it_value.tv_sec = 0;
+  its.it_value.tv_nsec = 1;
+  timerfd_settime(re->timerfd, 0, &its, NULL);
+
+  /* A spurious release lets waiting tasks notice `quit` */
+  for (i = 0; i < re->heap_len; i++) {
+    __atomic_add_fetch(&re->heap[i]->release.pending, 1, __ATOMIC_RELEASE);
+    futex(&re->heap[i]->release.pending, FUTEX_WAKE_PRIVATE, INT_MAX);
+  }
+}
+
+/* documented in header file */
+void release_engine_join(struct taskset *ts) {
+  struct release_engine *re = &ts->release_engine;
+  int s;
+
+  if (! re->running)
+    return;
+
+  s = pthread_join(re->tid, NULL);
+  if (s) printf_log_perror(LOG_WARNING, s,
+      "Error calling pthread_join for <%s>: ", "release");
+
+  close(re->timerfd);
+  free(re->heap);
+  re->heap = NULL;
+  re->running = false;
+}
+
+/* documented in header file */
+bool release_wait(struct task *task) {
+  unsigned int v;
+
+  v = __atomic_load_n(&task->release.pending, __ATOMIC_ACQUIRE);
+  while (true) {
+    if (v == 0) {
+      futex(&task->release.pending, FUTEX_WAIT_PRIVATE, 0);
+      v = __atomic_load_n(&task->release.pending, __ATOMIC_ACQUIRE);
+    }
+    else if (__atomic_compare_exchange_n(&task->release.pending, &v, v - 1,
+          false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return ! task->quit;
+    }
+  }
+}
+
+/* documented in header file */
+int release_discard(struct task *task) {
+  return __atomic_exchange_n(&task->release.pending, 0, __ATOMIC_ACQ_REL);
+}
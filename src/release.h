@@ -0,0 +1,86 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This module implements the optional release engine (`--release-engine`).
+ *
+ * Instead of each periodic task sleeping until its own next activation, a
+ * single high-priority thread keeps the next release time of every periodic
+ * task in a binary min-heap and sleeps on one `timerfd` armed for the
+ * earliest of them. When it expires, the engine records an EVT_ACTIVATION
+ * for each due task (with the actual release delay as `arg`), then wakes it
+ * up through a per-task futex counting the pending releases.
+ *
+ * Sporadic tasks and servers keep timing their own activations.
+ */
+
+#ifndef __RELEASE_H__
+#define __RELEASE_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+struct task;     /* can't include task.h, which needs the structs below */
+struct taskset;
+
+
+#ifndef RELEASE_ENGINE_PRIORITY
+#define RELEASE_ENGINE_PRIORITY 99
+#endif
+
+/** The release state of a periodic task */
+struct release {
+  unsigned int pending;         /* futex word: releases not yet consumed */
+  int issued;                   /* number of releases issued so far */
+  struct timespec next;         /* nominal time of the next release */
+};
+
+/** The release engine of a taskset */
+struct release_engine {
+  bool running;                 /* whether the engine thread was started */
+  bool quit;                    /* instructs the engine to stop */
+  pthread_t tid;
+  int timerfd;
+  struct task **heap;           /* periodic tasks, by earliest `release.next` */
+  int heap_len;
+};
+
+/**
+ * Start the engine thread for the periodic tasks of `ts`. To be called after
+ * `ts->t0` is set and before the tasks are activated.
+ */
+void release_engine_start(struct taskset *ts);
+
+/** Instruct the engine to stop and wake up the tasks waiting for a release */
+void release_engine_stop(struct taskset *ts);
+
+/** Wait for the engine thread to terminate */
+void release_engine_join(struct taskset *ts);
+
+/**
+ * Block until the engine releases a job of `task`, and consume the release.
+ * Return false if the task was woken up because it has to quit.
+ */
+bool release_wait(struct task *task);
+
+/**
+ * Drop the pending releases of `task` (for OVERRUN_SKIP), so that its next
+ * job is the next one released. Return the number of releases dropped.
+ */
+int release_discard(struct task *task);
+
+#endif
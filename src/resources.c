@@ -19,18 +19,48 @@
  */
 
 #include <string.h>
+#include <errno.h>
+#include <stdbool.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
 
 #include "resources.h"
 #include "common.h"
+#include "time_utils.h"
+#include "task.h"
 
 
-/** Initializes a lock according to compile- and run-time parameters */
-void lock_init(pthread_mutex_t *lock, int prioceiling) {
+/* Immediate-ceiling bookkeeping of the calling thread */
+static __thread int ceil_prio = -1;     /* current priority, -1 if unknown */
+static __thread int ceil_base;          /* priority when holding nothing */
+static __thread int ceil_depth;         /* number of held resources */
+static __thread int ceil_held[CEILING_MAX_NESTING];     /* held resources */
+
+
+/* documented in header file */
+const char *mutex_protocol_string(int protocol) {
+  switch (protocol) {
+    case PTHREAD_PRIO_NONE:     return "NONE";
+    case PTHREAD_PRIO_PROTECT:  return "PROTECT";
+    case PTHREAD_PRIO_INHERIT:  return "INHERIT";
+    case MUTEX_PROTOCOL_CEILING: return "CEILING";
+    default:                    return "UNKNOWN";
+  }
+}
+
+/** Initializes a lock with the given protocol (CEILING uses plain mutexes) */
+static void lock_init_protocol(pthread_mutex_t *lock, int protocol,
+    int prioceiling)
+{
   int s;
   pthread_mutexattr_t mattr;
 
+  if (protocol == MUTEX_PROTOCOL_CEILING)
+    protocol = PTHREAD_PRIO_NONE;
+
   s = pthread_mutexattr_init(&mattr);
   if (s) {
     printf_log_perror(LOG_WARNING, s,
@@ -46,18 +76,18 @@ void lock_init(pthread_mutex_t *lock, int prioceiling) {
     return;
   }
 
-  assert(options.mutex_protocol == PTHREAD_PRIO_NONE
-      || options.mutex_protocol == PTHREAD_PRIO_INHERIT
-      || options.mutex_protocol == PTHREAD_PRIO_PROTECT);
+  assert(protocol == PTHREAD_PRIO_NONE
+      || protocol == PTHREAD_PRIO_INHERIT
+      || protocol == PTHREAD_PRIO_PROTECT);
 
-  s = pthread_mutexattr_setprotocol(&mattr, options.mutex_protocol);
+  s = pthread_mutexattr_setprotocol(&mattr, protocol);
   if (s) {
     printf_log_perror(LOG_WARNING, s,
         "Error in lock_init while calling pthread_mutexattr_setprotocol: ");
     return;
   }
 
-  if (options.mutex_protocol == PTHREAD_PRIO_PROTECT) {
+  if (protocol == PTHREAD_PRIO_PROTECT) {
     s = pthread_mutexattr_setprioceiling(&mattr, prioceiling);
     if (s) {
       printf_log_perror(LOG_WARNING, s,
@@ -77,12 +107,45 @@ void lock_init(pthread_mutex_t *lock, int prioceiling) {
   assert(s == 0);
 }
 
-void resources_init(struct resource_set *resources) {
-  int r;
+/** Initializes a lock according to compile- and run-time parameters */
+void lock_init(pthread_mutex_t *lock, int prioceiling) {
+  lock_init_protocol(lock, options.mutex_protocol, prioceiling);
+}
 
+void resources_init(struct resource_set *resources) {
   resources->len = 0;
-  for (r = 1; r < MAX_RESOURCES; r++) {
-    resources->prioceilings[r-1] = -1;
+  resources->size = 0;
+  resources->protocol = options.mutex_protocol;
+  resources->prioceilings = NULL;
+  resources->locks = NULL;
+  resources->stats = NULL;
+}
+
+/** Grow the arrays so that resource `r` fits */
+static void resources_grow(struct resource_set *resources, int r) {
+  int size;
+
+  size = (resources->size == 0 ? 16 : resources->size);
+  while (size < r)
+    size *= 2;
+
+  resources->prioceilings = realloc(resources->prioceilings,
+      size * sizeof(int));
+  resources->locks = realloc(resources->locks,
+      size * sizeof(pthread_mutex_t));
+  resources->stats = realloc(resources->stats,
+      size * sizeof(struct resource_stats));
+  if (resources->prioceilings == NULL || resources->locks == NULL
+      || resources->stats == NULL) {
+    printf_log(LOG_ERROR, "Out of memory while allocating %d resources.\n",
+        size);
+    exit(1);
+  }
+
+  for (; resources->size < size; resources->size ++) {
+    resources->prioceilings[resources->size] = -1;
+    memset(&resources->stats[resources->size], 0,
+        sizeof(struct resource_stats));
   }
 }
 
@@ -91,11 +154,8 @@ static inline int max(int a, int b) {
 }
 
 void resources_update(struct resource_set *resources, int r, int prio) {
-  if (r >= MAX_RESOURCES) {
-    printf_log(LOG_ERROR, "Resources number %d exceeds max resources (%d).\n",
-        r, MAX_RESOURCES);
-    exit(1);
-  }
+  if (r > resources->size)
+    resources_grow(resources, r);
 
   resources->len = max(r + 1, resources->len);
   if (r > 0) {
@@ -103,15 +163,27 @@ void resources_update(struct resource_set *resources, int r, int prio) {
   }
 }
 
+/** Initialize locks, without logging */
+static void locks_setup(struct resource_set *resources) {
+  int r;
+
+  for (r = 1;  r < resources->len; r++) {
+    lock_init_protocol(&resources->locks[r-1], resources->protocol,
+        resources->prioceilings[r-1]);
+  }
+}
+
 void resources_locks_init(struct resource_set *resources) {
   int r;
 
-  printf_log(LOG_INFO, "Initializing locks for resources:\n");
+  printf_log(LOG_INFO, "Initializing %s locks for resources:\n",
+      mutex_protocol_string(resources->protocol));
   for (r = 1;  r < resources->len; r++) {
     printf_log(LOG_INFO, "  Resource R%d with priority ceiling %d;\n",
         r, resources->prioceilings[r-1]);
-    lock_init(&resources->locks[r-1], resources->prioceilings[r-1]);
   }
+
+  locks_setup(resources);
 }
 
 void resources_locks_free(struct resource_set *resources) {
@@ -125,22 +197,267 @@ void resources_locks_free(struct resource_set *resources) {
   }
 }
 
-void resource_acquire(struct resource_set *resources, int r) {
+void resources_free(struct resource_set *resources) {
+  resources_locks_free(resources);
+  free(resources->prioceilings);
+  free(resources->locks);
+  free(resources->stats);
+  resources_init(resources);
+}
+
+void resources_locks_reset(struct resource_set *resources) {
+  resources_locks_free(resources);
+  resources->protocol = options.mutex_protocol;
+  memset(resources->stats, 0, resources->size * sizeof(struct resource_stats));
+  resources_locks_init(resources);
+}
+
+/* documented in header file */
+void resources_thread_init(int priority) {
+  ceil_prio = priority;
+  ceil_depth = 0;
+}
+
+/** Set the priority of the calling thread, keeping `ceil_prio` up to date */
+static void ceil_setprio(int prio) {
   int s;
 
+  s = pthread_setschedprio(pthread_self(), prio);
+  if (s)
+    printf_log_perror(LOG_WARNING, s, "Error in pthread_setschedprio: ");
+  else
+    ceil_prio = prio;
+}
+
+/**
+ * Record that the calling thread is about to lock resource `r`, raising it
+ * to the ceiling of `r` if needed. Return whether priority changed.
+ */
+static bool ceil_raise(struct resource_set *resources, int r) {
+  int ceiling;
+  int policy;
+  struct sched_param param;
+
+  if (ceil_prio < 0) {
+    /* thread not initialized with resources_thread_init */
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0)
+      ceil_prio = param.sched_priority;
+  }
+  if (ceil_depth >= CEILING_MAX_NESTING) {
+    printf_log(LOG_ERROR, "More than %d nested CEILING resources.\n",
+        CEILING_MAX_NESTING);
+    exit(1);
+  }
+
+  if (ceil_depth == 0)
+    ceil_base = ceil_prio;
+  ceil_held[ceil_depth++] = r;
+
+  ceiling = resources->prioceilings[r-1];
+  if (ceiling > ceil_prio) {
+    ceil_setprio(ceiling);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Forget resource `r`, just unlocked by the calling thread, and go back to
+ * the highest of its base priority and the ceilings of what it still holds.
+ */
+static void ceil_restore(struct resource_set *resources, int r) {
+  int i;
+  int prio;
+
+  for (i = ceil_depth - 1; i >= 0 && ceil_held[i] != r; i--)
+    ;
+  if (i < 0) {
+    printf_log(LOG_WARNING, "CEILING: releasing R%d, which is not held.\n", r);
+    return;
+  }
+  for (ceil_depth--; i < ceil_depth; i++)
+    ceil_held[i] = ceil_held[i + 1];
+
+  prio = ceil_base;
+  for (i = 0; i < ceil_depth; i++)
+    prio = max(prio, resources->prioceilings[ceil_held[i] - 1]);
+
+  /* Lowering the priority may let a waiting thread preempt us right away,
+   * so do it only after the resource is unlocked. */
+  if (prio != ceil_prio)
+    ceil_setprio(prio);
+}
+
+long long resource_acquire(struct resource_set *resources, int r) {
+  int s;
+  bool raised = false;
+  bool waited = false;
+  long long elapsed = 0;
+  struct timespec t1, t2;
+  struct resource_stats *stats;
+
   if (r > 0) {
-    s = pthread_mutex_lock(&resources->locks[r-1]);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (resources->protocol == MUTEX_PROTOCOL_CEILING)
+      raised = ceil_raise(resources, r);
+    s = pthread_mutex_trylock(&resources->locks[r-1]);
+    if (s == EBUSY) {
+      waited = true;
+      s = pthread_mutex_lock(&resources->locks[r-1]);
+    }
     if (s)
       printf_log_perror(LOG_WARNING, s, "Error in pthread_mutex_lock: ");
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    /* The lock is held, so no-one else is updating these counters */
+    stats = &resources->stats[r-1];
+    elapsed = time_diff_ns(&t2, &t1);
+    stats->acquisitions ++;
+    stats->prio_changes += (raised ? 1 : 0);
+    stats->acquire_ns += elapsed;
+    if (elapsed > stats->acquire_max_ns)
+      stats->acquire_max_ns = elapsed;
   }
+
+  return (waited ? elapsed : 0);
 }
 
 void resource_release(struct resource_set *resources, int r) {
   int s;
+  long long elapsed;
+  struct timespec t1, t2;
+  struct resource_stats *stats;
 
   if (r > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &t1);
     s = pthread_mutex_unlock(&resources->locks[r-1]);
     if (s)
       printf_log_perror(LOG_WARNING, s, "Error in pthread_mutex_unlock: ");
+    if (resources->protocol == MUTEX_PROTOCOL_CEILING)
+      ceil_restore(resources, r);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    /* The lock is released: the next holder may be updating other fields */
+    stats = &resources->stats[r-1];
+    elapsed = time_diff_ns(&t2, &t1);
+    __atomic_fetch_add(&stats->release_ns, elapsed, __ATOMIC_RELAXED);
+    if (elapsed > __atomic_load_n(&stats->release_max_ns, __ATOMIC_RELAXED))
+      __atomic_store_n(&stats->release_max_ns, elapsed, __ATOMIC_RELAXED);
+  }
+}
+
+/* documented in header file */
+void resources_print_stats(const struct resource_set *resources) {
+  int r;
+  const struct resource_stats *st;
+
+  if (resources->len <= 1)
+    return;
+
+  printf_log(LOG_INFO, "Resource usage (%s protocol, times in ns):\n",
+      mutex_protocol_string(resources->protocol));
+  for (r = 1; r < resources->len; r++) {
+    st = &resources->stats[r-1];
+    if (st->acquisitions == 0) {
+      printf_log(LOG_INFO, "  R%d: never acquired\n", r);
+      continue;
+    }
+    printf_log(LOG_INFO, "  R%d: %lu acquisitions, acquire avg %lld max %lld, "
+        "release avg %lld max %lld, %lu priority raises\n",
+        r, st->acquisitions,
+        st->acquire_ns / (long long)st->acquisitions, st->acquire_max_ns,
+        st->release_ns / (long long)st->acquisitions, st->release_max_ns,
+        st->prio_changes);
+  }
+}
+
+struct bench_arg {
+  int prio;
+  int ceiling;
+  int protocol;
+  long long ns;          /* result: average cost of a lock/unlock pair */
+};
+
+/** Body of the calibration thread: time lock/unlock pairs on one resource */
+static void *bench_thread(void *arg) {
+  int i;
+  struct bench_arg *b = arg;
+  struct resource_set resources;
+  struct timespec t1, t2;
+
+  resources_init(&resources);
+  resources.protocol = b->protocol;
+  resources_update(&resources, 1, b->ceiling);
+  locks_setup(&resources);
+  resources_thread_init(b->prio);
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  for (i = 0; i < RESOURCES_BENCH_ITERATIONS; i++) {
+    resource_acquire(&resources, 1);
+    resource_release(&resources, 1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t2);
+  b->ns = time_diff_ns(&t2, &t1) / RESOURCES_BENCH_ITERATIONS;
+
+  resources_locks_free(&resources);
+  free(resources.prioceilings);
+  free(resources.locks);
+  free(resources.stats);
+  return NULL;
+}
+
+/** Run `bench_thread` at priority `prio`; return the cost or -1 on error */
+static long long bench_run(int protocol, int prio, int ceiling) {
+  int s;
+  pthread_t tid;
+  pthread_attr_t tattr;
+  struct sched_param sched_param;
+  struct bench_arg b;
+
+  b.prio = prio;
+  b.ceiling = ceiling;
+  b.protocol = protocol;
+  b.ns = -1;
+
+  s = pthread_attr_init(&tattr);
+  assert(s == 0);
+  pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&tattr, TASK_SCHED_POLICY);
+  sched_param.sched_priority = prio;
+  pthread_attr_setschedparam(&tattr, &sched_param);
+  if (options.with_affinity)
+    pthread_attr_setaffinity_np(&tattr, sizeof(cpu_set_t),
+        &options.task_cpuset);
+
+  s = pthread_create(&tid, &tattr, bench_thread, &b);
+  pthread_attr_destroy(&tattr);
+  if (s) {
+    printf_log_perror(LOG_WARNING, s,
+        "Lock benchmark not run: pthread_create returned error: ");
+    return -1;
+  }
+  pthread_join(tid, NULL);
+  return b.ns;
+}
+
+/* documented in header file */
+void resources_bench(int prio) {
+  int i;
+  long long raising, at_ceiling;
+  const int protocols[] = {PTHREAD_PRIO_NONE, PTHREAD_PRIO_INHERIT,
+    PTHREAD_PRIO_PROTECT, MUTEX_PROTOCOL_CEILING};
+
+  printf_log(LOG_INFO, "Cost of an uncontended lock/unlock pair [ns], "
+      "from priority %d:\n", prio);
+  printf_log(LOG_INFO, "  protocol  ceiling %-3d  ceiling %-3d\n",
+      prio + 1, prio);
+
+  for (i = 0; i < sizeof(protocols) / sizeof(protocols[0]); i++) {
+    raising = bench_run(protocols[i], prio, prio + 1);
+    at_ceiling = bench_run(protocols[i], prio, prio);
+    if (raising < 0 || at_ceiling < 0)
+      return;
+    printf_log(LOG_INFO, "  %-8s  %11lld  %11lld\n",
+        mutex_protocol_string(protocols[i]), raising, at_ceiling);
   }
 }
@@ -25,6 +25,17 @@
  * NOTE: although provided here, `struct resource_set` should be treated as
  * an opaque type. This has also the advantage of avoiding index confusion,
  * as internally the `locks` array does not include resource 0.
+ *
+ * Besides the pthread protocols, the module implements the immediate
+ * priority ceiling protocol in user space (`MUTEX_PROTOCOL_CEILING`): locks
+ * are plain mutexes, and the acquiring thread is raised to the resource
+ * ceiling with pthread_setschedprio() only if its current priority is lower,
+ * so uncontended locks avoid the kernel round-trips of PTHREAD_PRIO_PROTECT.
+ * Each thread remembers the resources it holds and the priority to go back
+ * to, so nested sections unwind correctly in any order. There is no system
+ * ceiling shared among threads: on a single CPU (the default affinity) the
+ * raised priority alone keeps other users of the resource from running, as
+ * under the Stack Resource Policy, but across CPUs nothing is held back.
  */
 
 #ifndef __RESOURCES_H__
@@ -32,14 +43,36 @@
 
 #include <pthread.h>
 
-#ifndef MAX_RESOURCES
-#define MAX_RESOURCES 15
+/* Value of `options.mutex_protocol` selecting the user-space ceiling */
+#define MUTEX_PROTOCOL_CEILING (-1)
+
+/* Maximum number of CEILING resources held at the same time by a thread */
+#ifndef CEILING_MAX_NESTING
+#define CEILING_MAX_NESTING 32
 #endif
 
+/* Iterations of the lock/unlock loop in `resources_bench` */
+#ifndef RESOURCES_BENCH_ITERATIONS
+#define RESOURCES_BENCH_ITERATIONS 100000
+#endif
+
+/** Counters on the usage of a resource, updated by acquire/release */
+struct resource_stats {
+  unsigned long acquisitions;
+  unsigned long prio_changes;   /* CEILING only: acquisitions raising prio */
+  long long acquire_ns;         /* total time in acquire, blocking included */
+  long long acquire_max_ns;
+  long long release_ns;         /* total time in release */
+  long long release_max_ns;
+};
+
 struct resource_set {
   int len;
-  int prioceilings[MAX_RESOURCES - 1];
-  pthread_mutex_t locks[MAX_RESOURCES - 1];
+  int size;                     /* number of allocated (non-dummy) resources */
+  int protocol;                 /* PTHREAD_PRIO_* or MUTEX_PROTOCOL_CEILING */
+  int *prioceilings;            /* `size` ceilings, from resource 1 on */
+  pthread_mutex_t *locks;       /* `size` locks, from resource 1 on */
+  struct resource_stats *stats; /* `size` counters, from resource 1 on */
 };
 
 
@@ -48,7 +81,7 @@ void resources_init(struct resource_set *resources);
 
 /**
  * Update the resources given that resource `r` will be used by a task
- * of priority `prio` 
+ * of priority `prio`, growing the set if needed.
  */
 void resources_update(struct resource_set *resources, int r, int prio);
 
@@ -57,8 +90,40 @@ void resources_locks_init(struct resource_set *resources);
 
 void resources_locks_free(struct resource_set *resources);
 
-void resource_acquire(struct resource_set *resources, int r);
+/** Free the locks and the arrays of the set, leaving it empty */
+void resources_free(struct resource_set *resources);
+
+/**
+ * Re-initialize the locks, using the current `options.mutex_protocol`, and
+ * clear the usage counters. Not to be called while the resources are in use.
+ */
+void resources_locks_reset(struct resource_set *resources);
+
+/**
+ * Lock resource `r`. Return the time [ns] spent waiting for it to be released
+ * by another holder, or 0 if it was free.
+ */
+long long resource_acquire(struct resource_set *resources, int r);
 
 void resource_release(struct resource_set *resources, int r);
 
+/**
+ * Tell the CEILING implementation the priority the calling thread runs at.
+ * To be called by each task thread before using any resource.
+ */
+void resources_thread_init(int priority);
+
+/** Converts a PTHREAD_PRIO_* or MUTEX_PROTOCOL_CEILING constant to a string */
+const char *mutex_protocol_string(int protocol);
+
+/** Log the usage counters of every resource */
+void resources_print_stats(const struct resource_set *resources);
+
+/**
+ * Measure the cost of an uncontended lock/unlock pair under each protocol,
+ * from a thread of priority `prio`, on a resource with ceiling `prio + 1`
+ * and on one with ceiling `prio` (no raise needed). Log the comparison.
+ */
+void resources_bench(int prio);
+
 #endif
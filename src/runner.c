@@ -0,0 +1,340 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Implementation of the API in "runner.h"
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "runner.h"
+#include "time_utils.h"
+#include "common.h"
+
+
+/* documented in header file */
+int runner_parse_cpus(const char *str, cpu_set_t *cpus) {
+  long first, last, cpu;
+  char *end;
+
+  CPU_ZERO(cpus);
+  while (*str != '\0') {
+    first = strtol(str, &end, 10);
+    if (end == str)
+      return -1;
+    last = first;
+    if (*end == '-') {
+      str = end + 1;
+      last = strtol(str, &end, 10);
+      if (end == str)
+        return -1;
+    }
+    if (first < 0 || last < first || last >= CPU_SETSIZE)
+      return -1;
+    for (cpu = first; cpu <= last; cpu++)
+      CPU_SET(cpu, cpus);
+
+    if (*end == ',')
+      end++;
+    else if (*end != '\0')
+      return -1;
+    str = end;
+  }
+  return CPU_COUNT(cpus);
+}
+
+
+/** scandir() filter: skip hidden files, "." and ".." */
+static int experiment_filter(const struct dirent *d) {
+  return d->d_name[0] != '.';
+}
+
+
+/**
+ * Set up the options of the child process running `exp`: open the taskset
+ * file and the output files, and pin the tasks to the experiment's CPU.
+ * Return 0 on success.
+ */
+static int experiment_setup(const struct experiment *exp, const char *dir,
+    const char *out_dir) {
+  static char taskfile[PATH_MAX], logfile[PATH_MAX], tracefile[PATH_MAX];
+  static char jobs[PATH_MAX], hist[PATH_MAX];
+  FILE *log;
+
+  snprintf(logfile, sizeof(logfile), "%s/%s.log", out_dir, exp->name);
+  log = fopen(logfile, "w");
+  if (log == NULL) {
+    printf_log_perror(LOG_ERROR, errno, "Error while opening file \"%s\": ",
+        logfile);
+    return -1;
+  }
+  options.logfile = log;
+
+  snprintf(taskfile, sizeof(taskfile), "%s/%s", dir, exp->name);
+  options.taskfile_name = taskfile;
+  options.taskfile = fopen(taskfile, "r");
+  if (options.taskfile == NULL) {
+    printf_log_perror(LOG_ERROR, errno, "Error while opening file \"%s\": ",
+        taskfile);
+    return -1;
+  }
+
+  if (options.arrivals_name != NULL) {
+    options.arrivals_file = fopen(options.arrivals_name, "r");
+    if (options.arrivals_file == NULL) {
+      printf_log_perror(LOG_ERROR, errno, "Error while opening file \"%s\": ",
+          options.arrivals_name);
+      return -1;
+    }
+  }
+
+  if (options.tracefile_name != NULL) {
+    snprintf(tracefile, sizeof(tracefile), "%s/%s.trace", out_dir, exp->name);
+    options.tracefile_name = tracefile;
+    options.tracefile = fopen(tracefile, "w");
+    if (options.tracefile == NULL) {
+      printf_log_perror(LOG_ERROR, errno, "Error while opening file \"%s\": ",
+          tracefile);
+      return -1;
+    }
+    fprintf(options.tracefile, "== Beginning of scheduletrace TRACE ==\n");
+  }
+
+  snprintf(jobs, sizeof(jobs), "%s/%s.jobs", out_dir, exp->name);
+  snprintf(hist, sizeof(hist), "%s/%s.hist", out_dir, exp->name);
+  options.jobs_name = jobs;
+  options.hist_name = hist;
+
+  options.with_gui = false;
+  options.with_affinity = true;
+  CPU_ZERO(&options.task_cpuset);
+  CPU_SET(exp->cpu, &options.task_cpuset);
+
+  /* Pin the whole child, so that the threads it creates besides the tasks
+   * (the logger, the release engine) don't disturb the other experiments */
+  if (sched_setaffinity(0, sizeof(cpu_set_t), &options.task_cpuset) < 0) {
+    printf_log_perror(LOG_ERROR, errno, "sched_setaffinity returned error: ");
+    return -1;
+  }
+  return 0;
+}
+
+
+/** Start `exp` in a child process pinned to `cpu`. Return 0 on success. */
+static int experiment_start(struct experiment *exp, int cpu, const char *dir,
+    const char *out_dir, int (*run)(void)) {
+  pid_t pid;
+
+  exp->cpu = cpu;
+  clock_gettime(CLOCK_MONOTONIC, &exp->start);
+
+  fflush(NULL);  /* don't let the child write out our buffers again */
+  pid = fork();
+  if (pid < 0) {
+    printf_log_perror(LOG_ERROR, errno, "Can't start \"%s\": fork: ",
+        exp->name);
+    return -1;
+  }
+  if (pid == 0) {
+    if (experiment_setup(exp, dir, out_dir) != 0)
+      exit(1);
+    printf_log(LOG_INFO, "Experiment \"%s\" on CPU %d\n", exp->name, cpu);
+    exit(run());
+  }
+
+  exp->pid = pid;
+  printf_log(LOG_INFO, "Started \"%s\" on CPU %d (pid %d)\n", exp->name, cpu,
+      (int) pid);
+  return 0;
+}
+
+
+/** Write the summary of all the experiments to `out_dir`/runner.csv */
+static void runner_summary(const struct experiment *exps, int count,
+    const char *out_dir) {
+  char name[PATH_MAX];
+  FILE *f;
+  int i, s;
+
+  snprintf(name, sizeof(name), "%s/runner.csv", out_dir);
+  f = fopen(name, "w");
+  if (f == NULL) {
+    printf_log_perror(LOG_ERROR, errno, "Error while opening file \"%s\": ",
+        name);
+    return;
+  }
+  fprintf(f, "experiment,cpu,exit_status,signal,elapsed_ns\n");
+  for (i = 0; i < count; i++) {
+    s = exps[i].status;
+    fprintf(f, "%s,%d,%d,%d,%lld\n", exps[i].name, exps[i].cpu,
+        WIFEXITED(s) ? WEXITSTATUS(s) : -1, WIFSIGNALED(s) ? WTERMSIG(s) : 0,
+        exps[i].elapsed);
+  }
+  if (fclose(f) != 0) {
+    printf_log(LOG_ERROR, "Error while writing \"%s\".\n", name);
+    return;
+  }
+  printf_log(LOG_INFO, "Wrote the summary of the experiments to \"%s\".\n",
+      name);
+}
+
+
+/* documented in header file */
+int runner_run(const char *dir, const cpu_set_t *cpus, const char *out_dir,
+    int (*run)(void)) {
+  struct dirent **list;
+  struct experiment *exps;
+  struct timespec now;
+  struct stat st;
+  cpu_set_t available;
+  char path[PATH_MAX];
+  int *free_cpus;
+  int free_count, count, next, running, failed;
+  int cpu, status, i, n;
+  pid_t pid;
+
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &available) < 0) {
+    printf_log_perror(LOG_ERROR, errno, "sched_getaffinity returned error: ");
+    return -1;
+  }
+  free_cpus = malloc(CPU_SETSIZE * sizeof(int));
+  if (free_cpus == NULL) {
+    printf_log(LOG_ERROR, "Out of memory.\n");
+    return -1;
+  }
+  free_count = 0;
+  for (cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--) {
+    if (CPU_COUNT(cpus) == 0 && free_count == 0
+        && CPU_ISSET(cpu, &available)) {
+      free_cpus[0] = cpu;  /* the first available, if no list was given */
+      continue;
+    }
+    if (! CPU_ISSET(cpu, cpus))
+      continue;
+    if (CPU_ISSET(cpu, &available))
+      free_cpus[free_count++] = cpu;
+    else
+      printf_log(LOG_WARNING, "CPU %d is not available: not used.\n", cpu);
+  }
+  if (CPU_COUNT(cpus) == 0)
+    free_count = 1;
+  if (free_count == 0) {
+    printf_log(LOG_ERROR, "No CPU available for the experiments.\n");
+    free(free_cpus);
+    return -1;
+  }
+
+  n = scandir(dir, &list, experiment_filter, alphasort);
+  if (n < 0) {
+    printf_log_perror(LOG_ERROR, errno, "Error while reading directory "
+        "\"%s\": ", dir);
+    free(free_cpus);
+    return -1;
+  }
+  if (mkdir(out_dir, 0777) < 0 && errno != EEXIST) {
+    printf_log_perror(LOG_ERROR, errno, "Error while creating directory "
+        "\"%s\": ", out_dir);
+    free(free_cpus);
+    return -1;
+  }
+
+  exps = calloc(n > 0 ? n : 1, sizeof(struct experiment));
+  if (exps == NULL) {
+    printf_log(LOG_ERROR, "Out of memory.\n");
+    free(free_cpus);
+    return -1;
+  }
+  count = 0;
+  for (i = 0; i < n; i++) {
+    snprintf(path, sizeof(path), "%s/%s", dir, list[i]->d_name);
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+      exps[count].name = strdup(list[i]->d_name);
+      exps[count].cpu = -1;
+      count++;
+    }
+    free(list[i]);
+  }
+  free(list);
+  printf_log(LOG_INFO, "Running %d experiments from \"%s\" on %d CPUs.\n",
+      count, dir, free_count);
+
+  next = 0;
+  running = 0;
+  failed = 0;
+  while (next < count || running > 0) {
+    while (next < count && free_count > 0) {
+      if (experiment_start(&exps[next], free_cpus[free_count - 1], dir,
+            out_dir, run) == 0) {
+        free_count--;
+        running++;
+      }
+      else {
+        exps[next].status = W_EXITCODE(1, 0);
+        failed++;
+      }
+      next++;
+    }
+    if (running == 0)
+      continue;
+
+    pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      printf_log_perror(LOG_ERROR, errno, "waitpid returned error: ");
+      break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 0; i < next && exps[i].pid != pid; i++)
+      ;
+    if (i == next)
+      continue;  /* not one of ours */
+
+    exps[i].pid = 0;
+    exps[i].status = status;
+    exps[i].elapsed = time_diff_ns(&now, &exps[i].start);
+    free_cpus[free_count++] = exps[i].cpu;
+    running--;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+      printf_log(LOG_INFO, "\"%s\" done in %.3f s\n", exps[i].name,
+          exps[i].elapsed / 1e9);
+    }
+    else {
+      failed++;
+      printf_log(LOG_WARNING, "\"%s\" failed (%s %d), see its log.\n",
+          exps[i].name, WIFEXITED(status) ? "exit status" : "signal",
+          WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status));
+    }
+  }
+
+  runner_summary(exps, count, out_dir);
+  printf_log(LOG_INFO, "%d of %d experiments succeeded.\n", count - failed,
+      count);
+
+  for (i = 0; i < count; i++)
+    free(exps[i].name);
+  free(exps);
+  free(free_cpus);
+  return failed;
+}
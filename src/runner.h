@@ -0,0 +1,66 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This module runs a batch of independent experiments in parallel.
+ *
+ * Every taskset file of a directory is an experiment. Each experiment runs
+ * headless in a child process pinned, with all its threads, to a CPU of its
+ * own, taken from a given list: as soon as an experiment ends, its CPU is
+ * handed to the next one in the queue, so that all the listed CPUs stay busy.
+ *
+ * For each experiment NAME, the output directory receives NAME.trace (the
+ * trace), NAME.log (the log, including the final statistics), NAME.jobs (the
+ * job metrics) and NAME.hist (the histograms). A summary of all the
+ * experiments is written to runner.csv.
+ */
+
+#ifndef __RUNNER_H__
+#define __RUNNER_H__
+
+#include <sched.h>
+#include <sys/types.h>
+#include <time.h>
+
+
+/** An experiment, queued, running or done */
+struct experiment {
+  char *name;                   /* name of the taskset file */
+  int cpu;                      /* CPU of the tasks, -1 if not started yet */
+  pid_t pid;                    /* child process, 0 if not running */
+  struct timespec start;        /* when the child was started */
+  long long elapsed;            /* wall-clock run time [ns] */
+  int status;                   /* as returned by waitpid() */
+};
+
+/**
+ * Parse a CPU list like "0-3,6" into `cpus`.
+ * Return the number of CPUs in the list, or -1 on failure.
+ */
+int runner_parse_cpus(const char *str, cpu_set_t *cpus);
+
+/**
+ * Run each taskset file of directory `dir` in a child process pinned to one
+ * of `cpus` (if empty, the first CPU available), writing the results to
+ * `out_dir`.
+ * `run` is called in the child, after the options have been set up for the
+ * experiment, and runs the taskset; its return value is the exit status.
+ * Return the number of experiments which failed, or -1 on error.
+ */
+int runner_run(const char *dir, const cpu_set_t *cpus, const char *out_dir,
+    int (*run)(void));
+
+#endif
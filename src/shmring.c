@@ -0,0 +1,390 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmring.h"
+#include "taskset.h"
+#include "common.h"
+
+
+/** Size of a segment with `capacity` slots and the given tables */
+static size_t segment_size(unsigned int capacity, int tasks, int sections) {
+  return sizeof(struct shmring_header)
+    + (size_t) tasks * sizeof(struct shmring_task)
+    + (size_t) sections * sizeof(struct shmring_section)
+    + (size_t) capacity * sizeof(struct shmring_evt);
+}
+
+/** Point `ring` to the tables and slots of the segment mapped at `hdr` */
+static void ring_layout(struct shmring *ring, struct shmring_header *hdr) {
+  ring->hdr = hdr;
+  ring->tasks = (struct shmring_task *) (hdr + 1);
+  ring->sections = (struct shmring_section *)
+    (ring->tasks + hdr->tasks_count);
+  ring->events = (struct shmring_evt *)
+    (ring->sections + hdr->sections_count);
+}
+
+static void evt_to_shm(struct shmring_evt *dst, const struct trace_evt *src) {
+  dst->valid = src->valid;
+  dst->type = src->type;
+  dst->task = src->task;
+  dst->res = src->res;
+  dst->count = src->count;
+  dst->job = src->job;
+  dst->arg = src->arg;
+  dst->sec = src->time.tv_sec;
+  dst->nsec = src->time.tv_nsec;
+  dst->tick = src->tick;
+}
+
+static void evt_from_shm(struct trace_evt *dst, const struct shmring_evt *src) {
+  dst->valid = src->valid;
+  dst->type = src->type;
+  dst->task = src->task;
+  dst->res = src->res;
+  dst->count = src->count;
+  dst->job = src->job;
+  dst->arg = src->arg;
+  dst->time.tv_sec = src->sec;
+  dst->time.tv_nsec = src->nsec;
+  dst->tick = src->tick;
+}
+
+/** Fill the task and section tables, sized by the header, from `ts` */
+static void tasks_to_shm(struct shmring *ring, const struct taskset *ts) {
+  const struct task *task;
+  struct shmring_task *st;
+  struct shmring_section *ss;
+  int t, s;
+
+  ss = ring->sections;
+  for (t = 0; t < ts->tasks_count; t++) {
+    task = &ts->tasks[t];
+    st = &ring->tasks[t];
+    st->kind = task->kind;
+    st->period = task->period;
+    st->deadline = task->deadline;
+    st->priority = task->priority;
+    st->phase = task->phase;
+    st->avg_interarrival = task->avg_interarrival;
+    st->budget = task->budget;
+    st->server_policy = task->server_policy;
+    st->server_id = task->server_id;
+    st->sections_count = task->sections_count;
+    st->sections_first = ss - ring->sections;
+    for (s = 0; s < task->sections_count; s++, ss++) {
+      ss->res = task->sections[s].res;
+      ss->avg = task->sections[s].avg;
+    }
+  }
+}
+
+
+/* documented in header file */
+struct shmring *shmring_create(const char *name, const struct taskset *ts) {
+  struct shmring *ring;
+  unsigned int capacity;
+  void *addr;
+  int fd, t, sections;
+
+  ring = malloc(sizeof(*ring));
+  if (ring == NULL) {
+    printf_log(LOG_ERROR, "Out of memory while creating the event ring.\n");
+    return NULL;
+  }
+
+  /* As many slots as trace events, at least */
+  for (capacity = 1; capacity < options.trace_size; capacity *= 2)
+    ;
+  sections = 0;
+  for (t = 0; t < ts->tasks_count; t++)
+    sections += ts->tasks[t].sections_count;
+  ring->size = segment_size(capacity, ts->tasks_count, sections);
+
+  shm_unlink(name);  /* a stale segment of a previous run */
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    printf_log_perror(LOG_ERROR, errno, "Can't create the event ring %s: "
+        "shm_open returned error: ", name);
+    free(ring);
+    return NULL;
+  }
+  if (ftruncate(fd, ring->size) < 0) {
+    printf_log_perror(LOG_ERROR, errno, "Can't size the event ring %s: "
+        "ftruncate returned error: ", name);
+    close(fd);
+    shm_unlink(name);
+    free(ring);
+    return NULL;
+  }
+  addr = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    printf_log_perror(LOG_ERROR, errno, "Can't map the event ring %s: "
+        "mmap returned error: ", name);
+    shm_unlink(name);
+    free(ring);
+    return NULL;
+  }
+
+  /* Touch every page now, rather than while tracing */
+  memset(addr, 0, ring->size);
+  ((struct shmring_header *) addr)->tasks_count = ts->tasks_count;
+  ((struct shmring_header *) addr)->sections_count = sections;
+  ring_layout(ring, addr);
+  ring->name = strdup(name);
+
+  ring->hdr->version = SHMRING_VERSION;
+  ring->hdr->evt_size = sizeof(struct shmring_evt);
+  ring->hdr->capacity = capacity;
+  ring->hdr->mutex_protocol = options.mutex_protocol;
+  ring->hdr->overrun_policy = options.overrun_policy;
+  ring->hdr->state = SHMRING_READY;
+  if (ring->name == NULL) {
+    printf_log(LOG_ERROR, "Out of memory while creating the event ring.\n");
+    shm_unlink(name);
+    shmring_detach(ring);
+    return NULL;
+  }
+  tasks_to_shm(ring, ts);
+  __atomic_store_n(&ring->hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+  printf_log(LOG_INFO, "Publishing events to the shared-memory ring %s "
+      "(%u events, %zu KiB).\n", name, capacity, ring->size / 1024);
+  return ring;
+}
+
+
+/* documented in header file */
+void shmring_destroy(struct shmring *ring) {
+  if (ring->name != NULL) {
+    shm_unlink(ring->name);
+    free(ring->name);
+  }
+  shmring_detach(ring);
+}
+
+
+/* documented in header file */
+void shmring_write_begin(struct shmring *ring) {
+  __atomic_store_n(&ring->hdr->seq, ring->hdr->seq + 1, __ATOMIC_RELAXED);
+  /* No update may become visible before the sequence is odd */
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+/* documented in header file */
+void shmring_write_end(struct shmring *ring, const struct trace_evt *cur) {
+  evt_to_shm(&ring->hdr->cur, cur);
+  __atomic_store_n(&ring->hdr->seq, ring->hdr->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/* documented in header file */
+void shmring_push(struct shmring *ring, const struct trace_evt *evt) {
+  struct shmring_header *hdr = ring->hdr;
+
+  evt_to_shm(&ring->events[hdr->head & (hdr->capacity - 1)], evt);
+  /* Readers check slots against `head`: the slot is written first */
+  __atomic_store_n(&hdr->head, hdr->head + 1, __ATOMIC_RELEASE);
+}
+
+
+/* documented in header file */
+void shmring_set_state(struct shmring *ring, enum shmring_state state,
+    const struct timespec *t0)
+{
+  ring->hdr->state = state;
+  if (t0 != NULL) {
+    ring->hdr->t0_sec = t0->tv_sec;
+    ring->hdr->t0_nsec = t0->tv_nsec;
+  }
+}
+
+
+/* documented in header file */
+struct shmring *shmring_attach(const char *name) {
+  struct shmring *ring;
+  struct shmring_header *hdr;
+  struct stat st;
+  void *addr;
+  int fd;
+
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &st) < 0 || st.st_size < sizeof(struct shmring_header)) {
+    close(fd);
+    return NULL;  /* still being created */
+  }
+  addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    printf_log_perror(LOG_ERROR, errno, "Can't map the event ring %s: "
+        "mmap returned error: ", name);
+    return NULL;
+  }
+
+  hdr = addr;
+  if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC) {
+    munmap(addr, st.st_size);
+    return NULL;  /* still being initialized */
+  }
+  if (hdr->version != SHMRING_VERSION
+      || hdr->evt_size != sizeof(struct shmring_evt)
+      || hdr->capacity == 0 || (hdr->capacity & (hdr->capacity - 1)) != 0
+      || hdr->tasks_count < 0 || hdr->sections_count < 0
+      || st.st_size < segment_size(hdr->capacity, hdr->tasks_count,
+        hdr->sections_count)) {
+    printf_log(LOG_ERROR, "The event ring %s has an unknown layout "
+        "(version %u).\n", name, hdr->version);
+    munmap(addr, st.st_size);
+    return NULL;
+  }
+
+  ring = malloc(sizeof(*ring));
+  if (ring == NULL) {
+    printf_log(LOG_ERROR, "Out of memory while attaching the event ring.\n");
+    munmap(addr, st.st_size);
+    return NULL;
+  }
+  ring_layout(ring, hdr);
+  ring->size = st.st_size;
+  ring->name = NULL;
+  return ring;
+}
+
+
+/* documented in header file */
+void shmring_detach(struct shmring *ring) {
+  munmap(ring->hdr, ring->size);
+  free(ring);
+}
+
+
+/* documented in header file */
+void shmring_snapshot(const struct shmring *ring, struct shmring_snap *snap) {
+  const struct shmring_header *hdr = ring->hdr;
+  struct timespec backoff;
+  unsigned int seq;
+  int tries;
+
+  backoff.tv_sec = 0;
+  backoff.tv_nsec = TRACE_SNAP_SLEEP;
+  for (tries = 1; ; tries++) {
+    seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+    if (seq % 2 == 0) {
+      /* The copy may be torn, but then the sequence has changed */
+      snap->state = hdr->state;
+      snap->t0.tv_sec = hdr->t0_sec;
+      snap->t0.tv_nsec = hdr->t0_nsec;
+      snap->head = hdr->head;
+      evt_from_shm(&snap->cur, &hdr->cur);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (seq == __atomic_load_n(&hdr->seq, __ATOMIC_RELAXED))
+        return;
+    }
+    if (tries % TRACE_SNAP_SPINS == 0)
+      clock_nanosleep(CLOCK_MONOTONIC, 0, &backoff, NULL);
+  }
+}
+
+
+/* documented in header file */
+unsigned long long shmring_read(const struct shmring *ring,
+    unsigned long long from, unsigned long long to, struct trace_evt *evts)
+{
+  const struct shmring_header *hdr = ring->hdr;
+  unsigned long long i, head;
+
+  for (i = from; i < to; i++)
+    evt_from_shm(&evts[i - from], &ring->events[i & (hdr->capacity - 1)]);
+
+  /* Slots up to `head` may have been (or be being) overwritten since */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  head = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+  if (head < from + hdr->capacity)
+    return 0;
+  else if (head - hdr->capacity + 1 - from < to - from)
+    return head - hdr->capacity + 1 - from;
+  else
+    return to - from;
+}
+
+
+/* documented in header file */
+int shmring_taskset(const struct shmring *ring, struct taskset *ts) {
+  const struct shmring_header *hdr = ring->hdr;
+  const struct shmring_task *st;
+  struct task *task;
+  int t, s;
+
+  if (hdr->tasks_count <= 0)
+    return -1;
+
+  options.mutex_protocol = hdr->mutex_protocol;
+  options.overrun_policy = hdr->overrun_policy;
+  options.trace_size = hdr->capacity + 1;
+  taskset_init(ts);
+
+  ts->tasks = calloc(hdr->tasks_count, sizeof(struct task));
+  if (ts->tasks == NULL) {
+    printf_log(LOG_ERROR, "Out of memory while reading the taskset.\n");
+    exit(1);
+  }
+  for (t = 0; t < hdr->tasks_count; t++) {
+    st = &ring->tasks[t];
+    task = &ts->tasks[t];
+    task->id = t;
+    task_init(task);
+    task->ts = ts;
+    task->kind = st->kind;
+    task->period = st->period;
+    task->deadline = st->deadline;
+    task->priority = st->priority;
+    task->phase = st->phase;
+    task->avg_interarrival = st->avg_interarrival;
+    task->budget = st->budget;
+    task->server_policy = st->server_policy;
+    task->server_id = st->server_id;
+    task->sections_count = st->sections_count;
+    /* The table was checked against the size of the mapping, not the tasks */
+    if (st->sections_first < 0 || task->sections_count < 0
+        || task->sections_count > hdr->sections_count - st->sections_first)
+      task->sections_count = 0;
+    task->sections = calloc(task->sections_count + 1,
+        sizeof(struct task_section));
+    if (task->sections == NULL) {
+      printf_log(LOG_ERROR, "Out of memory while reading the taskset.\n");
+      exit(1);
+    }
+    for (s = 0; s < task->sections_count; s++) {
+      task->sections[s].res = ring->sections[st->sections_first + s].res;
+      task->sections[s].avg = ring->sections[st->sections_first + s].avg;
+    }
+  }
+  ts->tasks_count = hdr->tasks_count;
+  return 0;
+}
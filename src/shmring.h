@@ -0,0 +1,205 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * This module publishes the trace to other processes, through a POSIX
+ * shared-memory ring of events (see shm_overview(7)), so that a viewer
+ * (scheduletrace-view) can watch a run from another process, on another CPU
+ * and at normal priority, attaching and detaching at any time.
+ *
+ * The recorder creates the segment, named as by --shm, and mirrors every
+ * update of the trace into it: publishing is a few stores to memory, with
+ * no system calls nor locks, and the recorder never knows whether anybody
+ * is watching. Viewers map the segment read-only.
+ *
+ * The layout of the segment is a `struct shmring_header`, followed by the
+ * table of the taskset (`tasks_count` `struct shmring_task`s, then the
+ * `sections_count` `struct shmring_section`s of all tasks), and finally by
+ * `capacity` `struct shmring_evt`s. All fields are naturally aligned and
+ * have fixed sizes, in the byte order of the machine:
+ *  - the static part of the header (from `magic` to `sections_count`) and
+ *    the table are written once, before `magic` is set: a viewer must check
+ *    `magic`, `version` and `evt_size`, and that the segment is as large as
+ *    the header says, before reading anything else;
+ *  - the event `i` (counting from 0) of the trace is stored in the slot
+ *    `i % capacity`, before `head` becomes greater than `i`. The ring holds
+ *    at least as many events as the trace, so it never wraps in practice;
+ *    viewers check anyway that the slots they read were not overwritten;
+ *  - `state`, `t0`, `head` and the current event `cur` are protected by the
+ *    sequence lock `seq`, odd while the recorder updates them: a consistent
+ *    copy is one taken while `seq` was even and did not change.
+ */
+
+#ifndef __SHMRING_H__
+#define __SHMRING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "trace.h"
+
+struct taskset;
+
+
+#define SHMRING_MAGIC   0x53435452      /* "SCTR" */
+#define SHMRING_VERSION 2
+
+/* The status of the recorded taskset */
+enum shmring_state {
+  SHMRING_READY,        /* created, waiting for activation */
+  SHMRING_RUNNING,      /* activated */
+  SHMRING_QUITTING,     /* instructed to quit */
+  SHMRING_STOPPED       /* all tasks have finished */
+};
+
+/** A `struct trace_evt`, with fixed-size fields */
+struct shmring_evt {
+  int32_t valid;
+  int32_t type;
+  int32_t task;
+  int32_t res;
+  int32_t count;
+  int32_t job;
+  int64_t arg;
+  int64_t sec;          /* `time` */
+  int64_t nsec;
+  uint64_t tick;
+};
+
+struct shmring_section {
+  uint32_t res;
+  uint32_t pad;
+  uint64_t avg;
+};
+
+/** The parameters of a task (see `struct task`) */
+struct shmring_task {
+  int32_t kind;
+  uint32_t period;
+  uint32_t deadline;
+  uint32_t priority;
+  uint32_t phase;
+  uint32_t avg_interarrival;
+  uint32_t budget;
+  int32_t server_policy;
+  int32_t server_id;
+  int32_t sections_count;
+  int32_t sections_first;       /* index of the first in the section table */
+  int32_t pad;
+};
+
+struct shmring_header {
+  /* Static part */
+  uint32_t magic;               /* SHMRING_MAGIC, once the rest is valid */
+  uint32_t version;             /* SHMRING_VERSION */
+  uint32_t evt_size;            /* sizeof(struct shmring_evt) */
+  uint32_t capacity;            /* slots in the ring, a power of two */
+  int32_t mutex_protocol;       /* options of the recorder */
+  int32_t overrun_policy;
+  int32_t tasks_count;           /* entries of the task table */
+  int32_t sections_count;       /* entries of the section table */
+
+  /* Dynamic part, protected by `seq` */
+  uint32_t seq;                 /* sequence lock: odd while updating */
+  uint32_t state;               /* one of the SHMRING_* states */
+  int64_t t0_sec;               /* activation time of the taskset */
+  int64_t t0_nsec;
+  uint64_t head;                /* number of events in the ring so far */
+  struct shmring_evt cur;       /* the current event (see trace.h) */
+};
+
+/** A mapping of the segment, in the recorder or in a viewer */
+struct shmring {
+  struct shmring_header *hdr;
+  struct shmring_task *tasks;   /* the task table, after the header */
+  struct shmring_section *sections;     /* the section table */
+  struct shmring_evt *events;   /* the `capacity` slots after the tables */
+  size_t size;                  /* size of the mapping */
+  char *name;                   /* name of the segment, if created here */
+};
+
+/** A consistent copy of the dynamic part of the header */
+struct shmring_snap {
+  enum shmring_state state;
+  struct timespec t0;
+  unsigned long long head;
+  struct trace_evt cur;
+};
+
+
+/*** Recorder side ***/
+
+/**
+ * Create the segment `name` (replacing any stale one), sized for the trace
+ * of `ts` and describing its tasks, and prefault it.
+ * Return NULL on failure (logged).
+ */
+struct shmring *shmring_create(const char *name, const struct taskset *ts);
+
+/**
+ * Remove the segment and unmap it: viewers still attached keep their own
+ * mapping, and new ones wait for the next recorder.
+ */
+void shmring_destroy(struct shmring *ring);
+
+/**
+ * Start an update of the dynamic part of the header: called by
+ * trace_write_begin, with the same serialization among writers.
+ */
+void shmring_write_begin(struct shmring *ring);
+
+/** Copy `cur` as the current event, and publish the update */
+void shmring_write_end(struct shmring *ring, const struct trace_evt *cur);
+
+/** Append a committed event, within an update */
+void shmring_push(struct shmring *ring, const struct trace_evt *evt);
+
+/** Set the state (and, when activated, t0), within an update */
+void shmring_set_state(struct shmring *ring, enum shmring_state state,
+    const struct timespec *t0);
+
+
+/*** Viewer side ***/
+
+/**
+ * Map the segment `name` read-only, and check its layout.
+ * Return NULL if it does not exist (yet) or is not valid (logged).
+ */
+struct shmring *shmring_attach(const char *name);
+
+/** Unmap the segment */
+void shmring_detach(struct shmring *ring);
+
+/** Take a consistent copy of the dynamic part of the header */
+void shmring_snapshot(const struct shmring *ring, struct shmring_snap *snap);
+
+/**
+ * Copy the events from `from` to `to` (excluded, at most `head`) to `evts`.
+ * Return the number of events at the beginning of `evts` that had been
+ * overwritten by the recorder in the meantime, and are not valid.
+ */
+unsigned long long shmring_read(const struct shmring *ring,
+    unsigned long long from, unsigned long long to, struct trace_evt *evts);
+
+/**
+ * Initialize `ts` with the tasks described by the segment, and set the
+ * options of the recorder. Return 0 on success, -1 if there are no tasks.
+ */
+int shmring_taskset(const struct shmring *ring, struct taskset *ts);
+
+#endif
@@ -23,27 +23,41 @@
 #include <assert.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <semaphore.h>
+#include <alloca.h>
+#include <unistd.h>
+#include <sys/resource.h>
 
 #include "task.h"
 #include "periodic.h"
+#include "time_utils.h"
 #include "common.h"
 #include "resources.h"
+#include "logger.h"
 
 
 /** 
  * Increments the global tick, considering that calling task owns the given
  * resource and is performing an action of the given type.
  * If needed, saves the current trace event and creates a new one.
- * _Always_ to be called while owning the task_lock
+ * _Always_ to be called while owning the task_lock (see taskset_lock)
  */
-/* Not static, shared with idle.c */
 void tick_pp(struct taskset *ts, int id, int res, int type,
     unsigned long *last_tick)
 {
-  assert(ts->tick >= *last_tick);
-  assert(ts->tick >= ts->next_evt->tick);
+  hot_assert(ts->tick >= *last_tick);
+  hot_assert(ts->tick >= ts->next_evt->tick);
+
+  /* Another task ran since this task's last tick, within a job: unless the
+   * task was waiting for a resource, it has been preempted by (at least)
+   * that task. Ticks of the idle task and activations recorded by the
+   * release engine don't count. */
+  if (id >= 0 && *last_tick > 0 && *last_tick < ts->run_tick
+      && ts->tasks[id].job_rec != NULL && ! ts->tasks[id].waited) {
+    job_record_preempted(ts->tasks[id].job_rec, ts->run_task);
+  }
 
   if (/* Detected context switch or same task changed activity */
       (*last_tick < ts->tick)
@@ -53,14 +67,20 @@ void tick_pp(struct taskset *ts, int id, int res, int type,
     printf_log(LOG_DEBUG, "Evt. (I've been asleep for %lu)\n",
         ts->tick - *last_tick);
 
+#if INSTRUMENT_LEVEL >= 1
     trace_next_add(&ts->trace);
     ts->next_evt = trace_next(&ts->trace);
-    assert(! ts->next_evt->valid);
+    hot_assert(! ts->next_evt->valid);
+#endif
+    /* otherwise, the current event is overwritten: it still tells who owns
+     * the CPU, for counting preemptions */
 
     ts->next_evt->type = type;
     ts->next_evt->task = id;
     ts->next_evt->res = res;
     ts->next_evt->count = 0;  /* will be incremented immediately */
+    ts->next_evt->job = (id >= 0) ? ts->tasks[id].jobs : 0;
+    ts->next_evt->arg = 0;
     ts->next_evt->tick = ts->tick + 1;
     clock_gettime(CLOCK_MONOTONIC, &ts->next_evt->time);
     ts->next_evt->valid = true;
@@ -69,13 +89,142 @@ void tick_pp(struct taskset *ts, int id, int res, int type,
   ts->tick ++;
   ts->next_evt->count ++;
   *last_tick = ts->tick;
+  if (id >= 0 && type != EVT_ACTIVATION) {
+    ts->run_tick = ts->tick;
+    ts->run_task = id;
+  }
+
+  hot_assert(ts->next_evt->count > 0);
+  hot_assert(ts->next_evt->count == 1  ||  ts->next_evt->type == EVT_RUN);
+  hot_assert(ts->next_evt->count != 1  ||  ts->next_evt->tick == ts->tick);
+  hot_assert(ts->next_evt->task == id);
+  hot_assert(ts->next_evt->type == type);
+  hot_assert(ts->next_evt->res == res);
+}
+
+
+/**
+ * Like tick_pp, but also takes care of the task lock and allows to set the
+ * `arg` of the (newly-created) event. If `time` is not NULL, the time of the
+ * event is copied there.
+ */
+static void task_tick(struct task *task, int res, int type, long long arg,
+    struct timespec *time) {
+  taskset_lock(task->ts);
+  tick_pp(task->ts, task->id, res, type, &task->last_tick);
+  task->ts->next_evt->arg = arg;
+  if (time != NULL)
+    time_cpy(time, &task->ts->next_evt->time);
+  taskset_unlock(task->ts);
+}
+
+
+/** Account a release latency sample in the task statistics */
+static void latency_add(struct task *task, long long ns) {
+  struct latency_stats *st = &task->latency;
+
+  histogram_record(&task->hist_latency, ns);
+  if (st->count == 0 || ns < st->min)
+    st->min = ns;
+  if (st->count == 0 || ns > st->max)
+    st->max = ns;
+  st->sum += ns;
+  st->sum_sq += (double) ns * ns;
+  st->count ++;
+}
+
+
+/* documented in header file */
+void task_record_activation(struct task *task, long long arg) {
+  task_tick(task, 0, EVT_ACTIVATION, arg, NULL);
+  latency_add(task, arg);
+}
+
+
+/* documented in header file */
+void task_record_release(struct task *task, int job, long long arg) {
+  unsigned long last_tick = 0UL;  /* forces a new event */
+
+  taskset_lock(task->ts);
+  tick_pp(task->ts, task->id, 0, EVT_ACTIVATION, &last_tick);
+  task->ts->next_evt->job = job;
+  task->ts->next_evt->arg = arg;
+  taskset_unlock(task->ts);
+
+  latency_add(task, arg);
+}
+
+
+/**
+ * Record the completion (or abortion) of the current job, checking whether
+ * its deadline was missed.
+ */
+static void job_end(struct task *task, bool aborted) {
+  struct timespec now;
+  long long lateness;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  lateness = time_diff_ns(&now, &task->dl);
+
+  time_cpy(&task->job_rec->completion, &now);
+  task->job_rec->aborted = aborted;
+  task->job_rec->dmiss = (lateness > 0 && task->kind != TASK_APERIODIC);
+
+  if (! aborted) {
+    task_tick(task, 0, EVT_COMPLETION, time_diff_ns(&now, &task->rel), NULL);
+    histogram_record(&task->hist_response, time_diff_ns(&now, &task->rel));
+  }
+
+  if (task->kind == TASK_APERIODIC) {
+    printf_log(LOG_INFO, "Aperiodic job %d served by T%d: response %lld us\n",
+        task->jobs, task->host->id, time_diff_ns(&now, &task->rel) / 1000);
+  }
+  else if (lateness > 0) {
+    task->dmiss ++;
+    task_tick(task, 0, EVT_DEADLINE, lateness, NULL);
+    printf_log(LOG_INFO, "Deadline miss%s! Lateness %lld us (so far: %d)\n",
+        (aborted ? ", job aborted" : ""), lateness / 1000, task->dmiss);
+  }
+}
+
+
+/**
+ * Account the page faults taken by the calling thread since `start` to the
+ * current job of the task.
+ */
+static void job_faults(struct task *task, const struct rusage *start) {
+  struct rusage now;
+  long minflt, majflt;
 
-  assert(ts->next_evt->count > 0);
-  assert(ts->next_evt->count == 1  ||  ts->next_evt->type == EVT_RUN);
-  assert(ts->next_evt->count != 1  ||  ts->next_evt->tick == ts->tick);
-  assert(ts->next_evt->task == id);
-  assert(ts->next_evt->type == type);
-  assert(ts->next_evt->res == res);
+  if (getrusage(RUSAGE_THREAD, &now) < 0)
+    return;
+
+  minflt = now.ru_minflt - start->ru_minflt;
+  majflt = now.ru_majflt - start->ru_majflt;
+  if (minflt > 0 || majflt > 0) {
+    task->minflt += minflt;
+    task->majflt += majflt;
+    task->fault_jobs ++;
+    task->last_fault_job = task->jobs;
+    task->job_rec->minflt = minflt;
+    task->job_rec->majflt = majflt;
+    printf_log(LOG_INFO, "Job %d took %ld minor and %ld major page faults\n",
+        task->jobs, minflt, majflt);
+  }
+}
+
+
+/* Result of the synthetic work, so that it is not optimized away */
+static volatile unsigned int work_sink;
+
+/* documented in header file */
+void synthetic_work(unsigned int units) {
+  unsigned int i, x;
+
+  x = work_sink;
+  for (i = 0; i < units; i++)
+    x = x * 1103515245u + 12345u;
+  work_sink = x;
 }
 
 
@@ -84,13 +233,32 @@ static void task_body(struct task *task) {
   int s;                /* section index */
   int r;                /* current resource */
   unsigned long op;     /* operations countdown */
+  bool aborted;         /* whether the job was aborted because of an overrun */
+  bool check_overrun;
+  struct task *server;  /* the server whose budget is used, if any */
+  struct rusage ru;     /* resource usage at the start of the job */
+  struct timespec start;        /* time of the EVT_START event */
+  long long wait;       /* time spent waiting for a resource [ns] */
+  long long blocking;   /* total time spent waiting for resources [ns] */
 
   printf_log(LOG_INFO, "Starting job %d\n", task->jobs);
 
+  aborted = false;
+  blocking = 0;
+  server = (task->kind == TASK_APERIODIC) ? task->host : NULL;
+  check_overrun = (options.overrun_policy == OVERRUN_ABORT && server == NULL);
+
+  getrusage(RUSAGE_THREAD, &ru);
+  task_tick(task, 0, EVT_START, 0, &start);
+
+  task->job_rec = job_table_append(&task->job_table, task->jobs);
+  time_cpy(&task->job_rec->release, &task->rel);
+  time_cpy(&task->job_rec->start, &start);
+
   /* Thanks heaven  dot,  arrow,  array indexing  and  postfix increment 
    * all have the same precedence and associate left-to-right */
 
-  for (s = 0; s < task->sections_count; s++) {
+  for (s = 0; s < task->sections_count && ! aborted; s++) {
 
     r = task->sections[s].res;
     op = task->sections[s].avg;
@@ -99,38 +267,193 @@ static void task_body(struct task *task) {
      * Note taht this may cause the "acquired" report to be slightly delayed
      * from the actual acquirement, but it is no big deal.
      */
-    resource_acquire(&task->ts->resources, r);
+    wait = resource_acquire(&task->ts->resources, r);
+    task->job_rec->blocked[r] += wait;
+    blocking += wait;
+    task->waited = (wait > 0);
 
-    run_assert(0 == sem_wait(&task->ts->task_lock));
-    tick_pp(task->ts, task->id, r, EVT_ACQUIRE, &task->last_tick);
-    run_assert(0 == sem_post(&task->ts->task_lock));
+    task_tick(task, r, EVT_ACQUIRE, wait, NULL);
+    task->waited = false;
 
     printf_log(LOG_INFO,
         "Entered section %d of length %lu: (R%d,%lu)\n",
         s, op, r, task->sections[s].avg);
 
     for (; op > 0; op--) {
-      run_assert(0 == sem_wait(&task->ts->task_lock));
+      if (task->op_work > 0)
+        synthetic_work(task->op_work);
+      taskset_lock(task->ts);
       tick_pp(task->ts, task->id, r, EVT_RUN, &task->last_tick);
-      run_assert(0 == sem_post(&task->ts->task_lock));
+      taskset_unlock(task->ts);
+
+      if ((check_overrun || server != NULL)
+          && op % OVERRUN_CHECK_PERIOD == 0) {
+        if (server != NULL) {
+          /* Inside a resource, the check is deferred to the section exit:
+           * suspending there would block every other user of the resource
+           * until the replenishment */
+          if (r == 0)
+            server_budget_check(server);
+        }
+        else if (deadline_miss(&task->dl)) {
+          aborted = true;
+          break;
+        }
+      }
     }
 
-    run_assert(0 == sem_wait(&task->ts->task_lock));
+    taskset_lock(task->ts);
     tick_pp(task->ts, task->id, r, EVT_RELEASE, &task->last_tick);
-    run_assert(0 == sem_post(&task->ts->task_lock));
+    taskset_unlock(task->ts);
 
     /* Release resource outside the task lock */
     resource_release(&task->ts->resources, r);
+
+    if (server != NULL && r != 0)
+      server_budget_check(server);
   }
 
+  if (aborted)
+    task->aborted ++;
+  job_faults(task, &ru);
+  histogram_record(&task->hist_blocking, blocking);
+  job_end(task, aborted);
+
+  task->job_rec = NULL;
   task->jobs ++;
 }
 
 
+/* documented in header file */
+void task_job(struct task *task) {
+  task_body(task);
+}
+
+
+/* documented in header file */
+double task_calibrate(long ms) {
+  struct taskset ts;
+  struct task task;
+  struct timespec start, now;
+  unsigned long ops;
+  int i;
+
+  taskset_init(&ts);
+  task_init(&task);
+  task.id = 0;
+  task.ts = &ts;
+  ts.tasks = &task;
+  ts.tasks_count = 1;
+  ts.next_evt = trace_next(&ts.trace);
+
+  ops = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    for (i = 0; i < 1000; i++) {
+      taskset_lock(&ts);
+      tick_pp(&ts, task.id, 0, EVT_RUN, &task.last_tick);
+      taskset_unlock(&ts);
+    }
+    ops += 1000;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while (time_diff_ms(&now, &start) < ms);
+
+  trace_free(&ts.trace);
+  run_assert(0 == sem_destroy(&ts.task_lock));
+  return (double) ops * 1000000.0 / time_diff_ns(&now, &start);
+}
+
+
+/* Main loop of a periodic task */
+static void periodic_loop(struct task *task) {
+  int s;
+  int i;
+  struct timespec now;
+  struct period_timer timer;
+
+  if (! options.release_engine) {
+    if (options.timer_slack >= 0 && set_timer_slack(options.timer_slack) < 0)
+      printf_log_perror(LOG_WARNING, errno, "Could not set the timer slack "
+          "to %ld ns: ", options.timer_slack);
+
+    s = period_timer_init(&timer, options.timer_backend,
+        options.timer_spin * 1000L);
+    if (s < 0) {
+      printf_log_perror(LOG_WARNING, errno, "Could not set up the %s timer, "
+          "falling back to nanosleep: ",
+          timer_backend_string(options.timer_backend));
+      period_timer_init(&timer, TIMER_NANOSLEEP, 0);
+    }
+  }
+
+  set_period_ms(&task->at, &task->dl, task->period, task->deadline,
+      &task->ts->t0, task->phase);
+
+  while (! task->quit) {
+    time_cpy(&task->rel, &task->at);
+    if (options.release_engine) {
+      /* the engine records the activation */
+      release_wait(task);
+      time_add_ms(&task->at, task->period);
+      time_add_ms(&task->dl, task->period);
+    }
+    else {
+      wait_for_period_ms(&timer, &task->at, &task->dl, task->period);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (! task->quit)
+        task_record_activation(task, time_diff_ns(&now, &task->rel));
+    }
+
+    if (! task->quit)
+      task_body(task);
+
+    if (options.overrun_policy == OVERRUN_SKIP) {
+      if (options.release_engine) {
+        /* the releases issued while running are the missed ones: the job
+         * numbers of the next ones follow the engine's */
+        s = release_discard(task);
+        for (i = 0; i < s; i++) {
+          time_add_ms(&task->at, task->period);
+          time_add_ms(&task->dl, task->period);
+        }
+      }
+      else {
+        s = skip_missed_periods_ms(&task->at, &task->dl, task->period);
+      }
+      if (s > 0) {
+        task->jobs += s;
+        task->skipped += s;
+        printf_log(LOG_INFO, "Overrun: skipping %d activation%s\n",
+            s, (s == 1 ? "" : "s"));
+      }
+    }
+  }
+
+  if (! options.release_engine)
+    period_timer_free(&timer);
+}
+
+
+/** Touch the stack of the calling thread, so that jobs won't fault on it */
+static void stack_prefault(void) {
+  volatile char *stack;
+  size_t len;
+  size_t i;
+  long page;
+
+  if (options.stack_size <= STACK_PREFAULT_MARGIN)
+    return;
+
+  page = sysconf(_SC_PAGESIZE);
+  len = (options.stack_size - STACK_PREFAULT_MARGIN) * 1024UL;
+  stack = alloca(len);
+  for (i = 0; i < len; i += page)
+    stack[i] = 0;
+}
+
+
 /* Implememntation of the task */
 static void task_loop(struct task* task) {
-  struct timespec at;
-  struct timespec dl;
   int s;
 
   s = pthread_setname_np(pthread_self(), task->name);
@@ -139,6 +462,10 @@ static void task_loop(struct task* task) {
         "Task activation failed: pthread_setname_np returned error: ");
     return;
   }
+  logger_thread_init(task->name);
+
+  /* Before activation, so as not to delay the first job */
+  stack_prefault();
 
   s = sem_wait(&task->activation_sem);
   if (s < 0) {
@@ -153,20 +480,18 @@ static void task_loop(struct task* task) {
   }
 
   task->activated = true;
+  resources_thread_init(task->priority);
   printf_log(LOG_INFO, "Activated!\n");
 
-  set_period_ms(&at, &dl, task->period, task->deadline,
-      &task->ts->t0, task->phase);
-
-  while (! task->quit) {
-    wait_for_period_ms(&at, &dl, task->period);
-    if (deadline_miss(&dl)) {
-      task->dmiss ++;
-      printf_log(LOG_INFO, "Deadline miss! (so far: %d)\n", task->dmiss);
-    }
-
-    if (! task->quit)
-      task_body(task);
+  switch (task->kind) {
+    case TASK_SPORADIC:
+      sporadic_loop(task);
+      break;
+    case TASK_SERVER:
+      server_loop(task);
+      break;
+    default:
+      periodic_loop(task);
   }
 
   task->done = true;
@@ -176,6 +501,7 @@ static void task_loop(struct task* task) {
 /* Wrapper around task_loop with a signature compatible with pthread_create */
 static void *task_function(void* task) {
   task_loop((struct task*) task);
+  logger_thread_exit();
   return NULL;
 }
 
@@ -184,20 +510,128 @@ static void *task_function(void* task) {
 void task_init(struct task* task) {
   snprintf(task->name, MAX_TASK_NAME_LEN + 1, "task%d", task->id);
 
+  task->kind = TASK_PERIODIC;
+  task->sections = NULL;
   task->sections_count = 0;
   task->period = DEFAULT_TASK_PERIOD;
   task->deadline = DEFAULT_TASK_DEADLINE;
   task->priority = DEFAULT_TASK_PRIORITY;
   task->phase = 0;
+  task->avg_interarrival = 0;
+  task->budget = 0;
+  task->server_policy = SERVER_POLLING;
+  task->server_id = -1;
+  task->op_work = 0;
 
   task->ts = NULL;
+  task->host = NULL;
+  task->arrivals.replay = NULL;
+  task->arrivals.replay_len = 0;
+  task->job_table.records = NULL;
+  task->job_table.blocked = NULL;
+  task->job_table.capacity = 0;
+
+  task_reset(task);
+}
+
+
+/* documented in header file */
+void task_free(struct task *task) {
+  free(task->sections);
+  task->sections = NULL;
+  task->sections_count = 0;
+  free(task->arrivals.replay);
+  task->arrivals.replay = NULL;
+  task->arrivals.replay_len = 0;
+  job_table_free(&task->job_table);
+}
 
+
+/* documented in header file */
+void task_reset(struct task *task) {
   task->last_tick = 0UL;
   task->activated = false;
   task->quit = false;
   task->done = false;
   task->dmiss = 0;
+  task->skipped = 0;
+  task->aborted = 0;
   task->jobs = 0;
+  memset(&task->latency, 0, sizeof(task->latency));
+  histogram_init(&task->hist_latency);
+  histogram_init(&task->hist_response);
+  histogram_init(&task->hist_blocking);
+  task->minflt = 0;
+  task->majflt = 0;
+  task->fault_jobs = 0;
+  task->last_fault_job = -1;
+  task->job_table.first = 0;
+  task->job_table.len = 0;
+  task->job_table.overwritten = 0;
+  task->job_rec = NULL;
+  task->waited = false;
+}
+
+
+/**
+ * Parse the first part of a task string, up to the opening bracket of the
+ * sections. Return the number of chars consumed, or -1 on failure.
+ */
+static int task_init_str_head(struct task *task, const char *initstr) {
+  int n;        /* stores the number of chars read */
+  char policy;  /* server policy: first letter of PS, DS or SS */
+
+  n = -1;
+  sscanf(initstr, " T=%u,D=%u,pr=%u,ph=%u,[%n",
+      &task->period, &task->deadline, &task->priority, &task->phase, &n);
+  if (n >= 0) {
+    task->kind = TASK_PERIODIC;
+    return n;
+  }
+
+  n = -1;
+  sscanf(initstr, " S=%u,A=%u,D=%u,pr=%u,ph=%u,[%n",
+      &task->period, &task->avg_interarrival, &task->deadline,
+      &task->priority, &task->phase, &n);
+  if (n >= 0) {
+    task->kind = TASK_SPORADIC;
+    if (task->avg_interarrival < task->period) {
+      printf_log(LOG_WARNING, "Average inter-arrival time of %s is less than "
+          "its minimum inter-arrival time: using the latter.\n", task->name);
+      task->avg_interarrival = task->period;
+    }
+    return n;
+  }
+
+  n = -1;
+  sscanf(initstr, " %cS=%u,Q=%u,pr=%u,ph=%u,[%n",
+      &policy, &task->period, &task->budget, &task->priority, &task->phase,
+      &n);
+  if (n >= 0 && (policy == 'P' || policy == 'D' || policy == 'S')) {
+    task->kind = TASK_SERVER;
+    task->deadline = task->period;
+    task->server_policy = (policy == 'P' ? SERVER_POLLING :
+                           policy == 'D' ? SERVER_DEFERRABLE : SERVER_SPORADIC);
+    if (task->budget == 0 || task->budget > task->period) {
+      printf_log(LOG_WARNING,
+          "Server budget shall be in (0, period]: got %u.\n", task->budget);
+      return -1;
+    }
+    return n;
+  }
+
+  n = -1;
+  sscanf(initstr, " AP=%u,srv=%d,ph=%u,[%n",
+      &task->avg_interarrival, &task->server_id, &task->phase, &n);
+  if (n >= 0) {
+    task->kind = TASK_APERIODIC;
+    task->period = 0;
+    task->deadline = 0;
+    task->priority = 0;
+    return n;
+  }
+
+  return -1;
 }
 
 
@@ -205,20 +639,29 @@ void task_init(struct task* task) {
 int task_init_str(struct task *task, const char *initstr, int id){
   int n = -1;   /* stores the number of chars read */
   struct task_section *sect;    /* the section currently being parsed */
+  int sections_size = 0;        /* number of allocated sections */
 
   task->id = id;
   task_init(task);
 
-  sscanf(initstr, " T=%u,D=%u,pr=%u,ph=%u,[%n",
-      &task->period, &task->deadline, &task->priority, &task->phase, &n);
+  n = task_init_str_head(task, initstr);
   if (n < 0) {
     printf_log(LOG_WARNING,
         "Error while parsing (first part of) task string \"%s\"", initstr);
     return 1;
   }
 
-  while (n >= 0  &&  task->sections_count < MAX_TASK_SECTIONS) {
+  while (n >= 0) {
     initstr += n;
+    if (task->sections_count == sections_size) {
+      sections_size = (sections_size == 0 ? 4 : 2 * sections_size);
+      task->sections = realloc(task->sections,
+          sections_size * sizeof(struct task_section));
+      if (task->sections == NULL) {
+        printf_log(LOG_ERROR, "Out of memory while parsing task sections.\n");
+        exit(1);
+      }
+    }
     sect = &task->sections[task->sections_count];
     task->sections_count ++;
     n = -1;
@@ -232,8 +675,10 @@ int task_init_str(struct task *task, const char *initstr, int id){
   if (n < 0) {
     printf_log(LOG_WARNING,
         "Error while parsing task sections starting from \"%s\""
-        " (%d sections parsed successfully). Too many sections?\n",
+        " (%d sections parsed successfully).\n",
         initstr, task->sections_count);
+    free(task->sections);
+    task->sections = NULL;
     task->sections_count = 0;
     return 1;
   }
@@ -247,10 +692,31 @@ void task_str(char *str,int len, const struct task *task, int verbosity){
   int n,        /* number of chars consumed by subsequent calls to sprintf */
       i;        /* loop index for iterating task sections */
 
-  n = snprintf(str, len,
-      "Task <%s>:\n  T=%u ms, D=%u ms, prio=%u, phase=%u, %u section[s];",
-      task->name, task->period, task->deadline, task->priority, task->phase,
-      task->sections_count);
+  switch (task->kind) {
+    case TASK_SPORADIC:
+      n = snprintf(str, len, "Task <%s>: sporadic\n  MIT=%u ms, avg=%u ms, "
+          "D=%u ms, prio=%u, phase=%u, %u section[s];",
+          task->name, task->period, task->avg_interarrival, task->deadline,
+          task->priority, task->phase, task->sections_count);
+      break;
+    case TASK_APERIODIC:
+      n = snprintf(str, len, "Task <%s>: aperiodic\n  avg=%u ms, server=T%d, "
+          "phase=%u, %u section[s];",
+          task->name, task->avg_interarrival, task->server_id, task->phase,
+          task->sections_count);
+      break;
+    case TASK_SERVER:
+      n = snprintf(str, len, "Task <%s>: %s server\n  T=%u ms, Q=%u ms, "
+          "prio=%u, phase=%u;",
+          task->name, server_policy_string(task->server_policy),
+          task->period, task->budget, task->priority, task->phase);
+      break;
+    default:
+      n = snprintf(str, len,
+          "Task <%s>:\n  T=%u ms, D=%u ms, prio=%u, phase=%u, %u section[s];",
+          task->name, task->period, task->deadline, task->priority,
+          task->phase, task->sections_count);
+  }
   len -= n; str += n; assert(len > 0);
 
   if (verbosity >= 1) {
@@ -264,8 +730,10 @@ void task_str(char *str,int len, const struct task *task, int verbosity){
 
   if (verbosity >= 2) {
     n = snprintf(str, len,
-        "\n  active=%d, quit=%d, done=%d, dmiss=%d, jobs=%d",
-        task->activated,task->quit,task->done,task->dmiss, task->jobs);
+        "\n  active=%d, quit=%d, done=%d, dmiss=%d, jobs=%d"
+        ", skipped=%d, aborted=%d",
+        task->activated,task->quit,task->done,task->dmiss, task->jobs,
+        task->skipped, task->aborted);
     len -= n; str += n; assert(len > 0);
   }
 }
@@ -302,6 +770,12 @@ void task_create(struct task *task) {
   int policy;                   /* scheduling policy */
   int s;                        /* return value of called library functions */
 
+  if (task->kind == TASK_APERIODIC) {
+    printf_log(LOG_DEBUG, "%s has no thread: it will run in T%d\n",
+        task->name, task->host->id);
+    return;
+  }
+
   printf_log(LOG_DEBUG, "Starting creation of %s\n", task->name);
 
   sem_init(&task->activation_sem, 0, 0);
@@ -312,6 +786,9 @@ void task_create(struct task *task) {
   s = pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_JOINABLE);
   if (s) handle_error_clean(s, "pthread_attr_setdetachstate", task->name);
 
+  s = pthread_attr_setstacksize(&tattr, options.stack_size * 1024UL);
+  if (s) handle_error_clean(s, "pthread_attr_setstacksize", task->name);
+
   s = pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
   if (s) handle_error_clean(s, "pthread_attr_setinheritsched", task->name);
 
@@ -346,7 +823,10 @@ void task_create(struct task *task) {
 
 /* documented in header file */
 void task_activate(struct task *task) {
-  sem_post(&task->activation_sem);
+  if (task->kind == TASK_APERIODIC)
+    task->activated = true;
+  else
+    sem_post(&task->activation_sem);
 }
 
 
@@ -354,6 +834,9 @@ void task_activate(struct task *task) {
 void task_join(struct task *task) {
   int s;
 
+  if (task->kind == TASK_APERIODIC)
+    return;  /* its server is in charge of setting `done` */
+
   s = pthread_join(task->tid, NULL);
   if (s) printf_log_perror(LOG_WARNING, s,
       "Error calling pthread_join for <%s>: ", task->name);
@@ -26,6 +26,9 @@
  * activated (i.e. it starts executing its body sections with the given period).
  *
  * Finally, a task can be quit gracefully by setting its `quit` flag.
+ *
+ * Besides periodic tasks, sporadic, aperiodic and server tasks are supported:
+ * see "aperiodic.h" for their activation.
  */
 
 #ifndef __TASK_H__
@@ -38,14 +41,14 @@
 
 #include "common.h"
 #include "resources.h"
+#include "aperiodic.h"
+#include "release.h"
+#include "jobs.h"
+#include "histogram.h"
 
 struct taskset;  /* can't include taskset before defining `struct task` */
 
 
-#ifndef MAX_TASK_SECTIONS
-#define MAX_TASK_SECTIONS 10
-#endif
-
 #define MAX_TASK_NAME_LEN 15  /* see PTHREAD_SETNAME_NP(3) */
 
 #ifndef DEFAULT_TASK_PERIOD
@@ -64,6 +67,41 @@ struct taskset;  /* can't include taskset before defining `struct task` */
 #define TASK_SCHED_POLICY SCHED_RR
 #endif
 
+/* Default stack size of task threads [KiB] (see `options.stack_size`) */
+#ifndef TASK_STACK_SIZE
+#define TASK_STACK_SIZE 256
+#endif
+
+/* Part of the stack [KiB] not prefaulted, left for the thread's own frames */
+#ifndef STACK_PREFAULT_MARGIN
+#define STACK_PREFAULT_MARGIN 32
+#endif
+
+/*
+ * With OVERRUN_ABORT, the deadline is checked once every this many operations.
+ * So is the budget of the server, for jobs of aperiodic tasks.
+ */
+#ifndef OVERRUN_CHECK_PERIOD
+#define OVERRUN_CHECK_PERIOD 1000
+#endif
+
+/**
+ * What to do when a job overruns its deadline (see `options.overrun_policy`)
+ */
+enum overrun_policy {
+  OVERRUN_CONTINUE,     /* let it finish, later jobs start late as needed */
+  OVERRUN_SKIP,         /* let it finish, then skip the activations missed */
+  OVERRUN_ABORT         /* abort the job as soon as its deadline is missed */
+};
+
+/** The different kinds of task */
+enum task_kind {
+  TASK_PERIODIC,        /* activated every `period` */
+  TASK_SPORADIC,        /* activated by arrivals at least `period` apart */
+  TASK_APERIODIC,       /* activated by arrivals, run by a server task */
+  TASK_SERVER           /* periodic server hosting aperiodic tasks */
+};
+
 /**
  * Description of a section of a task consisting of a gaussian-distributed
  * number of simple operations to be done while locking a given resource.
@@ -77,21 +115,40 @@ struct task_section {
   /*unsigned long dev;    * standard deviation of number of iterations */
 };
 
+/**
+ * Statistics on the release latency of the jobs of a task, i.e. the delay
+ * between the nominal release and the moment the job was actually released.
+ */
+struct latency_stats {
+  unsigned long count;  /* number of samples */
+  long long min;        /* [ns] */
+  long long max;        /* [ns] */
+  double sum;           /* [ns] */
+  double sum_sq;        /* [ns^2] */
+};
+
 /**
  * Parameters required to start and run a periodic task
  */
 struct task {
   /* To be set by the user before starting the task (or by task_init_str) */
   int id;                       /* id of this task (to match index in taskset)*/
-  struct task_section sections[MAX_TASK_SECTIONS];  /* sequence of sections */
+  enum task_kind kind;          /* periodic, sporadic, aperiodic or server */
+  struct task_section *sections;        /* sequence of sections */
   int sections_count;           /* length of `sections` */
-  unsigned int period;          /* in milliseconds */
-  unsigned int deadline;        /* relative, in milliseconds */
+  unsigned int period;          /* in ms (minimum inter-arrival if sporadic) */
+  unsigned int deadline;        /* relative, in ms (0 for none, if aperiodic) */
   unsigned int priority;        /* in [0,99], allowed values depend on policy */
   unsigned int phase;           /* starting _positive_ phase in milliseconds */
+  unsigned int avg_interarrival;/* sporadic and aperiodic only, in ms */
+  unsigned int budget;          /* server only: capacity, in ms */
+  int server_policy;            /* server only: one of the SERVER_* constants */
+  int server_id;                /* aperiodic only: id of the hosting server */
+  unsigned int op_work;         /* probe only: synthetic work per operation */
 
   /* Set at taskset initialization time */
   struct taskset *ts;   /* pointer to the taskset containing some shared vars */
+  struct task *host;    /* aperiodic only: the server running its jobs */
 
   /* Set at creation/initialization time */
   char name[MAX_TASK_NAME_LEN + 1];     /* the thread name */  
@@ -104,9 +161,26 @@ struct task {
   bool quit;            /* when true, instructs the task to stop gracefully */
   bool done;            /* becomes true after the task has stopped gracefully */
   int dmiss;            /* number of deadline misses */
-  int jobs;             /* number of jobs executed */
+  int skipped;          /* number of activations skipped (OVERRUN_SKIP) */
+  int aborted;          /* number of jobs aborted (OVERRUN_ABORT) */
+  int jobs;             /* index of the next job: run or skipped so far */
+  struct latency_stats latency; /* of the recorded activations */
+  struct histogram hist_latency;        /* release latency of jobs */
+  struct histogram hist_response;       /* response time of completed jobs */
+  struct histogram hist_blocking;       /* time jobs waited for resources */
+  long minflt;          /* minor page faults taken while running jobs */
+  long majflt;          /* major page faults taken while running jobs */
+  int fault_jobs;       /* number of jobs that took page faults */
+  int last_fault_job;   /* index of the last job that did, or -1 */
+  struct job_table job_table;   /* metrics of the last jobs */
+  struct job_record *job_rec;   /* record of the running job, or NULL */
+  bool waited;          /* whether the last resource acquisition blocked */
   struct timespec at;   /* next activation time */
-  struct timespec dl;   /* next absolute deadline */
+  struct timespec rel;  /* release time of the current job */
+  struct timespec dl;   /* absolute deadline of the current job */
+  struct arrivals arrivals;     /* sporadic and aperiodic only */
+  struct server server;         /* server only */
+  struct release release;       /* periodic only, with the release engine */
 };
 
 #include "taskset.h"  /* Deferred include avoids circular dependency */
@@ -119,12 +193,61 @@ struct task {
  */
 void task_init(struct task *task);
 
+/** Free the sections, replayed arrivals and job table of a joined task */
+void task_free(struct task *task);
+
+/**
+ * Clear the run-time state and statistics of a task that has been joined,
+ * so that it can be created and activated again.
+ */
+void task_reset(struct task *task);
+
 /**
  * Initializes a task according to the given description string,
  * and with the given id.
  */
 int task_init_str(struct task *task, const char *initstr, int id);
 
+/**
+ * Execute one job of the task in the calling thread, once its `rel` and `dl`
+ * are set. Jobs of aperiodic tasks are run by their server (see aperiodic.h).
+ */
+void task_job(struct task *task);
+
+/**
+ * Run `units` units of synthetic work (steps of a LCG) in the calling thread:
+ * what a task does, besides ticking, for each operation of a probed job.
+ */
+void synthetic_work(unsigned int units);
+
+/**
+ * Measure how many section operations (one tick of the task body, see
+ * task_job) are run per millisecond, running them for about `ms` milliseconds
+ * in the calling thread.
+ */
+double task_calibrate(long ms);
+
+/**
+ * Record an EVT_ACTIVATION event for the task, `arg` being the delay [ns]
+ * between the nominal release and the time it was recorded.
+ * The delay is also accounted in the task's release latency statistics.
+ */
+void task_record_activation(struct task *task, long long arg);
+
+/**
+ * Record an EVT_ACTIVATION event for job `job` of the task on behalf of
+ * another thread (the release engine), `arg` being as above.
+ */
+void task_record_release(struct task *task, int job, long long arg);
+
+/**
+ * Increment the global tick on behalf of task `id` (-1 for idle), owning
+ * resource `res` and doing an action of type `type` (EVT_*), recording a new
+ * trace event if needed. To be called while owning the task lock.
+ */
+void tick_pp(struct taskset *ts, int id, int res, int type,
+    unsigned long *last_tick);
+
 /**
  * Create the thread for the task described by the given structure.
  * The scheduling policy to be used can be configured at compile time
@@ -20,21 +20,46 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "common.h"
 #include "task.h"
 #include "taskset.h"
+#include "periodic.h"
+#include "shmring.h"
 
 
+/* Bind each aperiodic task to its server */
+static void servers_setup(struct taskset *ts) {
+  int t;
+  int srv;
+
+  for (t = 0; t < ts->tasks_count; t++) {
+    if (ts->tasks[t].kind != TASK_APERIODIC)
+      continue;
+
+    srv = ts->tasks[t].server_id;
+    if (srv < 0 || srv >= ts->tasks_count
+        || ts->tasks[srv].kind != TASK_SERVER) {
+      printf_log(LOG_ERROR, "Aperiodic task T%d refers to T%d, which is not "
+          "a server task.\n", t, srv);
+      exit(1);
+    }
+    ts->tasks[t].host = &ts->tasks[srv];
+  }
+}
+
 static void resources_setup_from_tasks(struct taskset *ts) {
   int t, s;  /* loop indices for tasks and sections */
+  int prio;  /* priority the sections of the task are run at */
 
   resources_init(&ts->resources);
 
   for (t = 0; t < ts->tasks_count; t++) {
+    prio = (ts->tasks[t].kind == TASK_APERIODIC ?
+        ts->tasks[t].host->priority : ts->tasks[t].priority);
     for (s = 0; s < ts->tasks[t].sections_count; s++) {
-      resources_update(&ts->resources,
-          ts->tasks[t].sections[s].res, ts->tasks[t].priority);
+      resources_update(&ts->resources, ts->tasks[t].sections[s].res, prio);
     }
   }
 
@@ -48,9 +73,13 @@ void taskset_init(struct taskset *ts) {
   int s;
 
   ts->tasks_count = 0;
+  ts->tasks = NULL;
   ts->tick = 1UL;
+  ts->run_tick = 0UL;
+  ts->run_task = -1;
   ts->activated = false;
   ts->stopped = false;
+  ts->release_engine.running = false;
   trace_init(&ts->trace);
 
   idle_task_init(&ts->idle);
@@ -69,15 +98,24 @@ int taskset_init_file(struct taskset* ts) {
   char *line = NULL;    /* pointer to the line buffer */
   size_t len = 0;       /* size of alloccated line buffer */
   ssize_t read;         /* number of read characters */
+  int tasks_size = 0;   /* number of allocated tasks */
+  int i;
 
   taskset_init(ts);
 
-  while ((read = getline(&line, &len, options.taskfile)) != -1
-      && ts->tasks_count < MAX_TASKSET_SIZE)
-  {
+  while ((read = getline(&line, &len, options.taskfile)) != -1) {
     if (read == 0 || line[0] == '#' || line[0] == '\n')
       continue;
 
+    if (ts->tasks_count == tasks_size) {
+      tasks_size = (tasks_size == 0 ? 16 : 2 * tasks_size);
+      ts->tasks = realloc(ts->tasks, tasks_size * sizeof(struct task));
+      if (ts->tasks == NULL) {
+        printf_log(LOG_ERROR, "Out of memory while reading the taskset.\n");
+        exit(1);
+      }
+    }
+
     s = task_init_str(&ts->tasks[ts->tasks_count], line, ts->tasks_count);
     if (s) {
       printf_log(LOG_WARNING,
@@ -92,14 +130,19 @@ int taskset_init_file(struct taskset* ts) {
   if (line) free(line);
   fclose(options.taskfile);
 
-  if (read != -1) {
-    printf_log(LOG_WARNING,
-        "Maximum number of tasks reached, some may have been skipped!\n",
-        MAX_TASKSET_SIZE);
+  servers_setup(ts);
+
+  if (options.arrivals_file != NULL) {
+    arrivals_load(ts, options.arrivals_file);
   }
 
   resources_setup_from_tasks(ts);
 
+  for (i = 0; i < ts->tasks_count; i++) {
+    job_table_init(&ts->tasks[i].job_table, options.jobs_size,
+        (ts->resources.len > 0 ? ts->resources.len : 1));
+  }
+
   return 0;
 }
 
@@ -118,14 +161,25 @@ void taskset_activate(struct taskset *ts) {
 
   clock_gettime(CLOCK_MONOTONIC, &ts->t0);
 
+  /* The GUI may be already reading the trace */
+  trace_write_begin(&ts->trace);
   ts->next_evt = trace_next(&ts->trace);
   ts->next_evt->type = EVT_RUN;
   ts->next_evt->task = -1;
   ts->next_evt->res = 0;
   ts->next_evt->count = 1;
+  ts->next_evt->job = 0;
+  ts->next_evt->arg = 0;
   ts->next_evt->tick = 1;
   clock_gettime(CLOCK_MONOTONIC, &ts->next_evt->time);
   ts->next_evt->valid = true;
+  if (ts->trace.ring != NULL)
+    shmring_set_state(ts->trace.ring, SHMRING_RUNNING, &ts->t0);
+  trace_write_end(&ts->trace);
+
+  if (options.release_engine) {
+    release_engine_start(ts);
+  }
 
   idle_task_create(&ts->idle);
 
@@ -138,23 +192,103 @@ void taskset_activate(struct taskset *ts) {
 
 void taskset_print(const struct taskset *ts) {
   int i;
-  char str[10000];
+  int len;
+  char *str;
 
   printf_log(LOG_INFO, "Taskset made of %d tasks.\n", ts->tasks_count);
   for (i = 0; i < ts->tasks_count; i++) {
-    task_str(str, 1000, &ts->tasks[i], 2);
+    len = 1000 + 40 * ts->tasks[i].sections_count;
+    str = malloc(len);
+    if (str == NULL) {
+      printf_log(LOG_ERROR, "Out of memory while printing the taskset.\n");
+      exit(1);
+    }
+    task_str(str, len, &ts->tasks[i], 2);
     printf_log(LOG_INFO, "%s\n", str);
+    free(str);
   }
 }
 
+void taskset_print_stats(const struct taskset *ts) {
+  int i;
+  double avg, var;
+  const struct latency_stats *st;
+
+  printf_log(LOG_INFO, "Release latency [us] (%s):\n", options.release_engine ?
+      "release engine" : timer_backend_string(options.timer_backend));
+  for (i = 0; i < ts->tasks_count; i++) {
+    st = &ts->tasks[i].latency;
+    if (st->count == 0)
+      continue;
+    avg = st->sum / st->count;
+    var = st->sum_sq / st->count - avg * avg;
+    printf_log(LOG_INFO, "  T%d: %lu jobs, min %.1f avg %.1f max %.1f "
+        "stddev %.1f, p50 %.1f p99 %.1f p99.9 %.1f\n", i, st->count,
+        st->min / 1000.0, avg / 1000.0, st->max / 1000.0,
+        (var > 0 ? sqrt(var) : 0.0) / 1000.0,
+        histogram_percentile(&ts->tasks[i].hist_latency, 50) / 1000.0,
+        histogram_percentile(&ts->tasks[i].hist_latency, 99) / 1000.0,
+        histogram_percentile(&ts->tasks[i].hist_latency, 99.9) / 1000.0);
+  }
+
+  printf_log(LOG_INFO, "Response time [us] (p50 / p99 / p99.9 / max):\n");
+  for (i = 0; i < ts->tasks_count; i++) {
+    if (ts->tasks[i].hist_response.count == 0)
+      continue;
+    printf_log(LOG_INFO, "  T%d: %.1f / %.1f / %.1f / %.1f\n", i,
+        histogram_percentile(&ts->tasks[i].hist_response, 50) / 1000.0,
+        histogram_percentile(&ts->tasks[i].hist_response, 99) / 1000.0,
+        histogram_percentile(&ts->tasks[i].hist_response, 99.9) / 1000.0,
+        histogram_percentile(&ts->tasks[i].hist_response, 100) / 1000.0);
+  }
+
+  printf_log(LOG_INFO, "Page faults while running jobs:\n");
+  for (i = 0; i < ts->tasks_count; i++) {
+    if (ts->tasks[i].fault_jobs == 0) {
+      printf_log(LOG_INFO, "  T%d: none in %d jobs\n", i,
+          ts->tasks[i].jobs - ts->tasks[i].skipped);
+      continue;
+    }
+    printf_log(LOG_INFO, "  T%d: %ld minor, %ld major in %d of %d jobs "
+        "(last in job %d)\n", i, ts->tasks[i].minflt, ts->tasks[i].majflt,
+        ts->tasks[i].fault_jobs, ts->tasks[i].jobs - ts->tasks[i].skipped,
+        ts->tasks[i].last_fault_job);
+  }
+
+  resources_print_stats(&ts->resources);
+}
+
+int taskset_export_histograms(const struct taskset *ts, FILE *f) {
+  int i;
+  char label[32];
+
+  fprintf(f, "# scheduletrace histograms [ns]: <label> <low> <high> <count>\n"
+      "# sub_bits=%d max_bits=%d\n", HIST_SUB_BITS, HIST_MAX_BITS);
+  for (i = 0; i < ts->tasks_count; i++) {
+    snprintf(label, sizeof(label), "T%d.response", i);
+    histogram_export(&ts->tasks[i].hist_response, label, f);
+    snprintf(label, sizeof(label), "T%d.latency", i);
+    histogram_export(&ts->tasks[i].hist_latency, label, f);
+    snprintf(label, sizeof(label), "T%d.blocking", i);
+    histogram_export(&ts->tasks[i].hist_blocking, label, f);
+  }
+  return (ferror(f) ? -1 : 0);
+}
+
 void taskset_quit(struct taskset *ts) {
   int i;
   struct timespec t;
 
   ts->stopped = true;
+  if (ts->trace.ring != NULL) {
+    taskset_lock(ts);
+    shmring_set_state(ts->trace.ring, SHMRING_QUITTING, NULL);
+    taskset_unlock(ts);
+  }
   for (i = 0; i < ts->tasks_count; i++) {
     ts->tasks[i].quit = true;
   }
+  release_engine_stop(ts);
 
   /* Wait a bit before stopping the idle, so last event will be shown */
   t.tv_sec = 0;
@@ -169,7 +303,54 @@ void taskset_join(struct taskset *ts) {
   for (i = 0; i < ts->tasks_count; i++) {
     task_join(&ts->tasks[i]);
   }
+  release_engine_join(ts);
   idle_task_join(&ts->idle);
+
+  if (ts->trace.ring != NULL) {
+    taskset_lock(ts);
+    shmring_set_state(ts->trace.ring, SHMRING_STOPPED, NULL);
+    taskset_unlock(ts);
+  }
+}
+
+void taskset_reset(struct taskset *ts) {
+  int i;
+
+  assert(! taskset_isactive(ts));
+
+  ts->tick = 1UL;
+  ts->run_tick = 0UL;
+  ts->run_task = -1;
+  ts->activated = false;
+  ts->stopped = false;
+  trace_free(&ts->trace);
+  trace_init(&ts->trace);
+
+  idle_task_init(&ts->idle);
+  ts->idle.ts = ts;
+
+  resources_locks_reset(&ts->resources);
+
+  for (i = 0; i < ts->tasks_count; i++) {
+    task_reset(&ts->tasks[i]);
+  }
+}
+
+void taskset_free(struct taskset *ts) {
+  int i;
+
+  assert(! taskset_isactive(ts));
+
+  for (i = 0; i < ts->tasks_count; i++) {
+    task_free(&ts->tasks[i]);
+  }
+  free(ts->tasks);
+  ts->tasks = NULL;
+  ts->tasks_count = 0;
+
+  trace_free(&ts->trace);
+  resources_free(&ts->resources);
+  run_assert(0 == sem_destroy(&ts->task_lock));
 }
 
 bool taskset_isactive(struct taskset *ts) {
@@ -191,3 +372,13 @@ bool taskset_isactive(struct taskset *ts) {
     return (done_count != ts->tasks_count);
   }
 }
+
+void taskset_lock(struct taskset *ts) {
+  run_assert(0 == sem_wait(&ts->task_lock));
+  trace_write_begin(&ts->trace);
+}
+
+void taskset_unlock(struct taskset *ts) {
+  trace_write_end(&ts->trace);
+  run_assert(0 == sem_post(&ts->task_lock));
+}
@@ -29,6 +29,7 @@
 #include <time.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdio.h>
 
 #include "common.h"
 #include "resources.h"
@@ -37,19 +38,19 @@
 #include "trace.h"
 
 
-#ifndef MAX_TASKSET_SIZE
-#define MAX_TASKSET_SIZE 20
-#endif
-
 struct taskset {
   int tasks_count;
-  struct task tasks[MAX_TASKSET_SIZE];
+  struct task *tasks;   /* array of `tasks_count` tasks */
   struct idle_task idle;
 
   struct resource_set resources;
+  struct release_engine release_engine; /* used with --release-engine */
 
-  sem_t task_lock;      /* mutex protecting writes to tick and trace */
+  sem_t task_lock;      /* mutex protecting writes to tick and trace, taken
+                         * with taskset_lock */
   unsigned long tick;   /* global taskset tick */
+  unsigned long run_tick;       /* last tick of a task running a job */
+  int run_task;                 /* the task that made `run_tick` */
   struct trace trace;   /* the event trace */
   struct trace_evt *next_evt;   /* the next event, to be added when ready */
 
@@ -69,10 +70,41 @@ void taskset_activate(struct taskset* ts);
 
 void taskset_print(const struct taskset* ts);
 
+/**
+ * Log the statistics collected while running: release latency, page faults
+ * and resource usage.
+ */
+void taskset_print_stats(const struct taskset* ts);
+
+/**
+ * Write the response time, release latency and blocking histograms of all
+ * tasks (see histogram_export). Return 0 on success.
+ */
+int taskset_export_histograms(const struct taskset *ts, FILE *f);
+
 void taskset_quit(struct taskset *ts);
 
 void taskset_join(struct taskset *ts);
 
 bool taskset_isactive(struct taskset *ts);
 
+/**
+ * Take the task lock, for updating the tick and the trace: the critical
+ * section is also a write section of the trace (see trace_write_begin).
+ */
+void taskset_lock(struct taskset *ts);
+
+/** Publish the updates to the trace, and release the task lock */
+void taskset_unlock(struct taskset *ts);
+
+/**
+ * Bring a joined taskset back to its state before `taskset_create`: clear
+ * the trace and all statistics, and re-initialize the resource locks with
+ * the current `options.mutex_protocol`.
+ */
+void taskset_reset(struct taskset *ts);
+
+/** Free all memory owned by a taskset that is not active (any more) */
+void taskset_free(struct taskset *ts);
+
 #endif
@@ -44,12 +44,21 @@ int time_cmp(const struct timespec *t1, const struct timespec *t2) {
 
 
 void time_add_ms(struct timespec *t, long ms) {
-  t->tv_sec += ms / 1000;
-  t->tv_nsec += (ms % 1000) * 1000000;
-  if (t->tv_nsec > 1000000000) {
+  time_add_ns(t, ms * 1000000LL);
+}
+
+
+void time_add_ns(struct timespec *t, long long ns) {
+  t->tv_sec += ns / 1000000000;
+  t->tv_nsec += ns % 1000000000;
+  if (t->tv_nsec >= 1000000000) {
     t->tv_nsec -= 1000000000;
     t->tv_sec += 1;
   }
+  else if (t->tv_nsec < 0) {
+    t->tv_nsec += 1000000000;
+    t->tv_sec -= 1;
+  }
 }
 
 
@@ -75,3 +84,9 @@ long time_diff_ms(const struct timespec *t1, const struct timespec *t2) {
 
   return time_to_ms(&diff);
 }
+
+
+long long time_diff_ns(const struct timespec *t1, const struct timespec *t2) {
+  return (t1->tv_sec - t2->tv_sec) * 1000000000LL
+    + (t1->tv_nsec - t2->tv_nsec);
+}
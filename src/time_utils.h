@@ -38,7 +38,15 @@ int time_cmp(const struct timespec *t1, const struct timespec *t2);
  */
 void time_add_ms(struct timespec *t, long ms);
 
+/**
+ * Add `ns` nanoseconds to `*t` (`ns` may be negative)
+ */
+void time_add_ns(struct timespec *t, long long ns);
+
 /** Return time_to_ms(t1 - t2) */
 long time_diff_ms(const struct timespec *t1, const struct timespec *t2);
 
+/** Return (t1 - t2) in nanoseconds */
+long long time_diff_ns(const struct timespec *t1, const struct timespec *t2);
+
 #endif
@@ -15,9 +15,12 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "common.h"
 #include "trace.h"
+#include "shmring.h"
 
 
 const char *evt_string(int evt) {
@@ -33,30 +36,56 @@ const char *evt_string(int evt) {
   }
 }
 
-static void trace_evt_print(struct trace_evt *evt) {
+void trace_evt_print(const struct trace_evt *evt) {
   if (options.tracefile != NULL) {
     fprintf(options.tracefile,
-        "TRACE: [%lld.%.9ld][tick=%lu] %s task=%d R%d (x%u)\n",
+        "TRACE: [%lld.%.9ld][tick=%lu] %s task=%d R%d (x%u) job=%d arg=%lld\n",
         (long long) evt->time.tv_sec, evt->time.tv_nsec, evt->tick,
-        evt_string(evt->type), evt->task, evt->res, evt->count);
+        evt_string(evt->type), evt->task, evt->res, evt->count,
+        evt->job, evt->arg);
 
     if (options.tracefile_flush) fflush(options.tracefile);
   }
 
   printf_log(LOG_DEBUG,
-      "TRACE: [%lld.%.9ld][tick=%lu] %s task=%d R%d (x%u)\n",
+      "TRACE: [%lld.%.9ld][tick=%lu] %s task=%d R%d (x%u) job=%d arg=%lld\n",
       (long long) evt->time.tv_sec, evt->time.tv_nsec, evt->tick,
-      evt_string(evt->type), evt->task, evt->res, evt->count);
+      evt_string(evt->type), evt->task, evt->res, evt->count,
+      evt->job, evt->arg);
   if (options.tracefile_flush) fflush(options.logfile);
 }
 
+bool evt_running(const struct trace_evt *evt) {
+  return evt->task >= 0 && (evt->type == EVT_START || evt->type == EVT_RUN
+      || evt->type == EVT_ACQUIRE || evt->type == EVT_RELEASE);
+}
+
 void trace_init(struct trace *tr) {
+  tr->size = options.trace_size;
+  tr->events = malloc(tr->size * sizeof(struct trace_evt));
+  if (tr->events == NULL) {
+    printf_log(LOG_ERROR, "Out of memory while allocating a trace of %d "
+        "events.\n", tr->size);
+    exit(1);
+  }
+  /* Touch every page now, rather than while tracing */
+  memset(tr->events, 0, tr->size * sizeof(struct trace_evt));
+
   tr->len = 0;
+  tr->seq = 0;
+  tr->ring = NULL;
   tr->events[0].valid = false;
 }
 
+void trace_free(struct trace *tr) {
+  free(tr->events);
+  tr->events = NULL;
+  tr->size = 0;
+  tr->len = 0;
+}
+
 struct trace_evt *trace_next(struct trace *tr) {
-  if (tr->len + 1 < TRACE_SIZE)
+  if (tr->len + 1 < tr->size)
     tr->events[tr->len + 1].valid = false;
   return &tr->events[tr->len];
 }
@@ -64,13 +93,51 @@ struct trace_evt *trace_next(struct trace *tr) {
 void trace_next_add(struct trace *tr) {
   trace_evt_print(&tr->events[tr->len]);
 
-  if (tr->len + 1 >= TRACE_SIZE) {
+  if (tr->len + 1 >= tr->size) {
     printf_log(LOG_INFO,
-        "Trace is full, will stop tracing. You may want to recompile with a "
-        "higher TRACE_SIZE");
+        "Trace is full, will stop tracing. You may want to run with a "
+        "higher --trace-size.\n");
     tr->events[tr->len].valid = false;
   }
   else {
+    if (tr->ring != NULL)
+      shmring_push(tr->ring, &tr->events[tr->len]);
     tr->len ++;
   }
 }
+
+void trace_write_begin(struct trace *tr) {
+  __atomic_store_n(&tr->seq, tr->seq + 1, __ATOMIC_RELAXED);
+  /* No update may become visible before the sequence is odd */
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  if (tr->ring != NULL)
+    shmring_write_begin(tr->ring);
+}
+
+void trace_write_end(struct trace *tr) {
+  if (tr->ring != NULL)
+    shmring_write_end(tr->ring, &tr->events[tr->len]);
+  __atomic_store_n(&tr->seq, tr->seq + 1, __ATOMIC_RELEASE);
+}
+
+void trace_snapshot(const struct trace *tr, struct trace_snap *snap) {
+  struct timespec backoff;
+  unsigned int seq;
+  int tries;
+
+  backoff.tv_sec = 0;
+  backoff.tv_nsec = TRACE_SNAP_SLEEP;
+  for (tries = 1; ; tries++) {
+    seq = __atomic_load_n(&tr->seq, __ATOMIC_ACQUIRE);
+    if (seq % 2 == 0) {
+      /* The copy may be torn, but then the sequence has changed */
+      snap->len = __atomic_load_n(&tr->len, __ATOMIC_RELAXED);
+      memcpy(&snap->cur, &tr->events[snap->len], sizeof(snap->cur));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (seq == __atomic_load_n(&tr->seq, __ATOMIC_RELAXED))
+        return;
+    }
+    if (tries % TRACE_SNAP_SPINS == 0)
+      clock_nanosleep(CLOCK_MONOTONIC, 0, &backoff, NULL);
+  }
+}
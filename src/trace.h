@@ -20,11 +20,20 @@
  * A schedule trace is a simple array of `trace_node`s, each storing
  * info about a specific event.
  *
- * In order to prevent the GUI thread to slow down the observer, the trace
- * is not thread-safe: instead, it is expected that tasks coordinate insertions
- * while the GUI only reads.
- *
  * Note that the events[len] is the "current" event, if its `valid` flag is set.
+ *
+ * Tasks coordinate insertions among themselves (see `task_lock`), and wrap
+ * each update of `len` and of the current event in trace_write_begin() and
+ * trace_write_end(). These form a sequence lock: readers (the GUI) take a
+ * consistent copy of both with trace_snapshot(), which retries if a write was
+ * in progress, so that they never take a lock nor slow down the writers.
+ * Events before `len` are never modified again, and may be read directly.
+ *
+ * Updates can also be mirrored to a shared-memory ring (see shmring.h), for
+ * viewers running in other processes.
+ *
+ * The events are allocated and touched once, at initialization time, so
+ * that recording never page-faults.
  */
 
 #ifndef __TRACE_H__
@@ -34,11 +43,33 @@
 
 #include "common.h"
 
+struct shmring;  /* see shmring.h */
 
+/* Default number of events (see `options.trace_size`) */
 #ifndef TRACE_SIZE
 #define TRACE_SIZE 10000
 #endif
 
+/* Attempts of trace_snapshot before sleeping */
+#ifndef TRACE_SNAP_SPINS
+#define TRACE_SNAP_SPINS 100
+#endif
+
+/* Sleep of trace_snapshot between series of attempts [ns] */
+#ifndef TRACE_SNAP_SLEEP
+#define TRACE_SNAP_SLEEP 50000
+#endif
+
+/*
+ * Event types. The meaning of the `arg` field of an event depends on its type:
+ *  - EVT_ACTIVATION: a job was released; `arg` is the delay [ns] between the
+ *                    nominal release time and the event
+ *  - EVT_DEADLINE:   a deadline miss was detected; `arg` is the lateness [ns]
+ *  - EVT_ACQUIRE:    the resource was locked; `arg` is the time [ns] spent
+ *                    blocked on it by another holder, 0 if it was free
+ *  - EVT_COMPLETION: the job completed; `arg` is its response time [ns]
+ * and is zero for all other types.
+ */
 enum {
   EVT_ACTIVATION,
   EVT_DEADLINE,
@@ -58,24 +89,64 @@ struct trace_evt {
   int task;     /* Task index. -1 for idle task. */
   int res;      /* Resource used. 0 for no resource. */
   int count;    /* Number of consecutive equivalent events. */
+  int job;      /* Index of the job of `task` this event belongs to */
+  long long arg;        /* Event-specific argument, see EVT_* above */
   struct timespec time; /* Event timestamp, or start time for EVT_RUN */
   unsigned long tick;    /* Event tickstamp, or start tick for EVT_RUN */
 };
 
 struct trace {
-  struct trace_evt events[TRACE_SIZE];
+  struct trace_evt *events;     /* array of `size` events */
+  int size;
   int len;
+  unsigned int seq;     /* sequence lock: odd while a write is in progress */
+  struct shmring *ring; /* where updates are mirrored, or NULL (shmring.h) */
+};
+
+/** A consistent view of the trace, taken with trace_snapshot */
+struct trace_snap {
+  int len;                      /* the trace length */
+  struct trace_evt cur;         /* a copy of events[len] */
 };
 
-/** Initialize the trace */
+/** Allocate and prefault the trace, sized after `options.trace_size` */
 void trace_init(struct trace *tr);
 
+/** Free the events of the trace */
+void trace_free(struct trace *tr);
+
 /** Return the location for the next new node. If full, free up a slot first. */
 struct trace_evt *trace_next(struct trace *tr);
 
+/** Print the event to the trace file (if any) and to the debug log */
+void trace_evt_print(const struct trace_evt *evt);
+
+/**
+ * Whether the owner of `evt` runs its job from `evt` on (START, RUN, ACQUIRE
+ * or RELEASE of a task), rather than e.g. the release engine or the idle task
+ */
+bool evt_running(const struct trace_evt *evt);
+
 /** Insert the node that was last returned by next_node */
 void trace_next_add(struct trace *tr);
 
+/**
+ * Start an update of `len` or of the current event. Writers must be already
+ * serialized with each other, and sections must not be nested.
+ */
+void trace_write_begin(struct trace *tr);
+
+/** End the update started by trace_write_begin, publishing it to readers */
+void trace_write_end(struct trace *tr);
+
+/**
+ * Take a consistent copy of the length and the current event of the trace,
+ * concurrently with writers. Never blocks them: if a write is in progress,
+ * the copy is retried (sleeping for TRACE_SNAP_SLEEP [ns] after
+ * TRACE_SNAP_SPINS attempts, so that a preempted writer can finish).
+ */
+void trace_snapshot(const struct trace *tr, struct trace_snap *snap);
+
 
 
 #endif
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include <stdlib.h>
+
+#include "trace_holds.h"
+#include "time_utils.h"
+
+
+/* Returned for resources never held */
+static const struct trace_res_holds none;
+
+
+/** Forget the holds of `rh`, keeping its memory */
+static void res_holds_clear(struct trace_res_holds *rh) {
+  rh->len = 0;
+  rh->seen = 0;
+  rh->max_wait = 0;
+  rh->handoffs = 0;
+  rh->handoff_sum = 0;
+  rh->handoff_max = 0;
+}
+
+/** Make room for resources up to `res`, return false if out of memory */
+static bool res_grow(struct trace_holds *h, int res) {
+  struct trace_res_holds *by_res;
+  int r;
+
+  if (res < h->res_count)
+    return true;
+
+  by_res = realloc(h->by_res, (res + 1) * sizeof(struct trace_res_holds));
+  if (by_res == NULL)
+    return false;
+  for (r = h->res_count; r <= res; r++) {
+    by_res[r].holds = NULL;
+    by_res[r].size = 0;
+    res_holds_clear(&by_res[r]);
+  }
+  h->by_res = by_res;
+  h->res_count = res + 1;
+  return true;
+}
+
+/** Append a hold acquired by event `i`, return false if out of memory */
+static bool hold_add(struct trace_res_holds *rh, uint32_t i, long long wait) {
+  struct trace_hold *holds;
+  uint32_t size;
+
+  if (rh->len == rh->size) {
+    size = (rh->size > 0) ? 2 * rh->size : TRACE_HOLDS_MIN;
+    holds = realloc(rh->holds, size * sizeof(struct trace_hold));
+    if (holds == NULL)
+      return false;
+    rh->holds = holds;
+    rh->size = size;
+  }
+  rh->holds[rh->len].acquire = i;
+  rh->holds[rh->len].release = TRACE_HOLD_OPEN;
+  rh->holds[rh->len].wait = wait;
+  rh->len ++;
+  return true;
+}
+
+/** Lower `changed` to `t`, if `t` is earlier */
+static void changed_lower(struct timespec *changed, const struct timespec *t) {
+  if (changed != NULL && time_cmp(t, changed) < 0)
+    time_cpy(changed, t);
+}
+
+/** Account the event `i` of resource `r` in its holds */
+static bool holds_add_evt(struct trace_holds *h, const struct trace *tr,
+    int r, uint32_t i, struct timespec *changed)
+{
+  struct trace_res_holds *rh = &h->by_res[r];
+  const struct trace_evt *evt;
+  struct trace_hold *last;
+  struct timespec from;
+  long long wait, handoff;
+
+  evt = &tr->events[i];
+  last = (rh->len > 0) ? &rh->holds[rh->len - 1] : NULL;
+
+  if (evt->type == EVT_ACQUIRE) {
+    wait = (evt->arg > 0) ? evt->arg : 0;
+    if (! hold_add(rh, i, wait))
+      return false;
+    if (wait > rh->max_wait)
+      rh->max_wait = wait;
+
+    time_cpy(&from, &evt->time);
+    time_add_ns(&from, -wait);
+    changed_lower(changed, &from);
+
+    handoff = trace_hold_handoff_ns(rh, tr, rh->len - 1);
+    if (handoff >= 0) {
+      rh->handoffs ++;
+      rh->handoff_sum += handoff;
+      if (handoff > rh->handoff_max)
+        rh->handoff_max = handoff;
+      changed_lower(changed,
+          &tr->events[rh->holds[rh->len - 2].release].time);
+    }
+  }
+  /* A release without its acquisition (e.g. before a rewind) is ignored */
+  else if (evt->type == EVT_RELEASE && last != NULL
+      && last->release == TRACE_HOLD_OPEN
+      && tr->events[last->acquire].task == evt->task) {
+    last->release = i;
+  }
+  return true;
+}
+
+
+/* documented in header file */
+void trace_holds_init(struct trace_holds *h) {
+  h->by_res = NULL;
+  h->res_count = 0;
+  h->upto = 0;
+}
+
+
+/* documented in header file */
+void trace_holds_free(struct trace_holds *h) {
+  int r;
+
+  for (r = 0; r < h->res_count; r++)
+    free(h->by_res[r].holds);
+  free(h->by_res);
+  trace_holds_init(h);
+}
+
+
+/* documented in header file */
+bool trace_holds_update(struct trace_holds *h, const struct trace_index *idx,
+    const struct trace *tr, struct timespec *changed)
+{
+  const struct trace_keyed *k;
+  struct trace_res_holds *rh;
+  int r;
+
+  /* The index of a rewound trace starts over, and so do the holds */
+  if (idx->upto < h->upto) {
+    for (r = 0; r < h->res_count; r++)
+      res_holds_clear(&h->by_res[r]);
+  }
+
+  if (! res_grow(h, idx->res_count - 1))
+    return false;
+
+  /* R0 is no resource: its sections hold nothing */
+  for (r = 1; r < idx->res_count; r++) {
+    k = trace_index_res(idx, r);
+    rh = &h->by_res[r];
+    for (; rh->seen < k->len; rh->seen ++) {
+      if (! holds_add_evt(h, tr, r, k->evts[rh->seen], changed))
+        return false;
+    }
+  }
+  h->upto = idx->upto;
+  return true;
+}
+
+
+/* documented in header file */
+const struct trace_res_holds *trace_holds_res(const struct trace_holds *h,
+    int res) {
+  if (res <= 0 || res >= h->res_count)
+    return &none;
+  return &h->by_res[res];
+}
+
+
+/* documented in header file */
+uint32_t trace_holds_before(const struct trace_res_holds *rh,
+    const struct trace *tr, const struct timespec *t) {
+  uint32_t lo, hi, mid;
+
+  /* The first hold not acquired before `t` is in [lo, hi] */
+  lo = 0;
+  hi = rh->len;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (time_cmp(&tr->events[rh->holds[mid].acquire].time, t) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+
+/* documented in header file */
+long long trace_hold_handoff_ns(const struct trace_res_holds *rh,
+    const struct trace *tr, uint32_t k) {
+  const struct trace_evt *acquire, *release;
+  long long gap;
+
+  if (k == 0 || k >= rh->len || rh->holds[k - 1].release == TRACE_HOLD_OPEN)
+    return -1;
+
+  acquire = &tr->events[rh->holds[k].acquire];
+  release = &tr->events[rh->holds[k - 1].release];
+  if (acquire->task == tr->events[rh->holds[k - 1].acquire].task)
+    return -1;
+
+  /* Its owner must have been blocked on the lock, that is on this release */
+  if (rh->holds[k].wait <= 0)
+    return -1;
+  gap = time_diff_ns(&acquire->time, &release->time);
+  return (gap > 0) ? gap : 0;
+}
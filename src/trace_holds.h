@@ -0,0 +1,109 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * This module implements an interval index of the holds of the resources in
+ * a trace: for each resource, the intervals from the EVT_ACQUIRE of a task to
+ * its matching EVT_RELEASE, in time order, which don't overlap.
+ *
+ * A hold also tells how long its owner was blocked on the lock, as measured
+ * when acquiring it (see the `arg` of EVT_ACQUIRE): being preempted before
+ * asking for the resource, or held off by a ceiling, is not waiting for it.
+ *
+ * A hold starts with a hand-off if its owner, another task, was blocked on
+ * the lock: it was then waiting for the previous hold to end, and the
+ * hand-off latency is the time from that EVT_RELEASE to this EVT_ACQUIRE.
+ *
+ * The holds are built from the positions of a trace_index, and extended
+ * incrementally as it is.
+ */
+
+#ifndef __TRACE_HOLDS_H__
+#define __TRACE_HOLDS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "trace.h"
+#include "trace_index.h"
+
+
+/* Initial number of holds of a resource */
+#ifndef TRACE_HOLDS_MIN
+#define TRACE_HOLDS_MIN 64
+#endif
+
+/* The `release` of a hold not released yet */
+#define TRACE_HOLD_OPEN UINT32_MAX
+
+struct trace_hold {
+  uint32_t acquire;     /* position of its EVT_ACQUIRE in the trace */
+  uint32_t release;     /* position of its EVT_RELEASE, or TRACE_HOLD_OPEN */
+  long long wait;       /* time its owner was blocked on the lock [ns] */
+};
+
+/** The holds of a resource */
+struct trace_res_holds {
+  struct trace_hold *holds;     /* in time order */
+  uint32_t len;
+  uint32_t size;        /* allocated holds */
+  uint32_t seen;        /* events of the resource examined so far */
+  long long max_wait;   /* the longest `wait` [ns] */
+  unsigned long handoffs;
+  long long handoff_sum;        /* of the hand-off latencies [ns] */
+  long long handoff_max;
+};
+
+struct trace_holds {
+  struct trace_res_holds *by_res;       /* `res_count`, grown as needed */
+  int res_count;
+  int upto;             /* events of the index examined so far */
+};
+
+
+/** Initialize an empty index of holds */
+void trace_holds_init(struct trace_holds *h);
+
+/** Free the holds of the index */
+void trace_holds_free(struct trace_holds *h);
+
+/**
+ * Extend the holds to the events of `tr` indexed by `idx`. The holds added
+ * may show waits and hand-offs that began before the events just indexed:
+ * `changed`, if not NULL, is lowered to the earliest time they begin at.
+ * Return false if out of memory: the holds found so far stay so.
+ */
+bool trace_holds_update(struct trace_holds *h, const struct trace_index *idx,
+    const struct trace *tr, struct timespec *changed);
+
+/** Return the holds of resource `res` (none for R0) */
+const struct trace_res_holds *trace_holds_res(const struct trace_holds *h,
+    int res);
+
+/** Return how many of the holds of `rh` are acquired before `t` */
+uint32_t trace_holds_before(const struct trace_res_holds *rh,
+    const struct trace *tr, const struct timespec *t);
+
+/**
+ * Return the latency [ns] of the hand-off starting the hold `k` of `rh`, -1
+ * if it doesn't start with a hand-off.
+ */
+long long trace_hold_handoff_ns(const struct trace_res_holds *rh,
+    const struct trace *tr, uint32_t k);
+
+#endif
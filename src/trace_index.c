@@ -0,0 +1,196 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+
+#include "trace_index.h"
+#include "time_utils.h"
+
+
+/* Returned for resources never seen */
+static const struct trace_keyed empty;
+
+
+/** Append position `i` to `k`, return false if out of memory */
+static bool keyed_add(struct trace_keyed *k, uint32_t i) {
+  uint32_t *evts;
+  uint32_t size;
+
+  if (k->len == k->size) {
+    size = (k->size > 0) ? 2 * k->size : TRACE_INDEX_MIN;
+    evts = realloc(k->evts, size * sizeof(uint32_t));
+    if (evts == NULL)
+      return false;
+    k->evts = evts;
+    k->size = size;
+  }
+  k->evts[k->len ++] = i;
+  return true;
+}
+
+/** Make room for resources up to `res`, return false if out of memory */
+static bool res_grow(struct trace_index *idx, int res) {
+  struct trace_keyed *by_res;
+  int r;
+
+  if (res < idx->res_count)
+    return true;
+
+  by_res = realloc(idx->by_res, (res + 1) * sizeof(struct trace_keyed));
+  if (by_res == NULL)
+    return false;
+  for (r = idx->res_count; r <= res; r++) {
+    by_res[r].evts = NULL;
+    by_res[r].len = by_res[r].size = 0;
+  }
+  idx->by_res = by_res;
+  idx->res_count = res + 1;
+  return true;
+}
+
+
+/* documented in header file */
+void trace_index_init(struct trace_index *idx, int tasks) {
+  idx->by_task = NULL;
+  idx->tasks = tasks;
+  idx->by_res = NULL;
+  idx->res_count = 0;
+  idx->upto = 0;
+}
+
+
+/* documented in header file */
+void trace_index_free(struct trace_index *idx) {
+  int i;
+
+  if (idx->by_task != NULL) {
+    for (i = 0; i <= idx->tasks; i++)
+      free(idx->by_task[i].evts);
+    free(idx->by_task);
+  }
+  for (i = 0; i < idx->res_count; i++)
+    free(idx->by_res[i].evts);
+  free(idx->by_res);
+  trace_index_init(idx, idx->tasks);
+}
+
+
+/* documented in header file */
+bool trace_index_update(struct trace_index *idx, const struct trace *tr,
+    int len) {
+  const struct trace_evt *evt;
+  int i;
+
+  if (idx->by_task == NULL) {
+    idx->by_task = calloc(idx->tasks + 1, sizeof(struct trace_keyed));
+    if (idx->by_task == NULL)
+      return false;
+  }
+
+  /* A rewound trace is indexed again */
+  if (len < idx->upto) {
+    for (i = 0; i <= idx->tasks; i++)
+      idx->by_task[i].len = 0;
+    for (i = 0; i < idx->res_count; i++)
+      idx->by_res[i].len = 0;
+    idx->upto = 0;
+  }
+
+  for (i = idx->upto; i < len; i++) {
+    evt = &tr->events[i];
+    assert(-1 <= evt->task && evt->task < idx->tasks && evt->res >= 0);
+
+    /* Both or neither, so that the event is retried as a whole */
+    if (! res_grow(idx, evt->res)
+        || ! keyed_add(&idx->by_task[evt->task + 1], i))
+      return false;
+    if (! keyed_add(&idx->by_res[evt->res], i)) {
+      idx->by_task[evt->task + 1].len --;
+      return false;
+    }
+    idx->upto = i + 1;
+  }
+  return true;
+}
+
+
+/* documented in header file */
+const struct trace_keyed *trace_index_task(const struct trace_index *idx,
+    int task) {
+  assert(-1 <= task && task < idx->tasks);
+  if (idx->by_task == NULL)
+    return &empty;
+  return &idx->by_task[task + 1];
+}
+
+
+/* documented in header file */
+const struct trace_keyed *trace_index_res(const struct trace_index *idx,
+    int res) {
+  if (res < 0 || res >= idx->res_count)
+    return &empty;
+  return &idx->by_res[res];
+}
+
+
+/* documented in header file */
+uint32_t trace_keyed_before(const struct trace_keyed *k,
+    const struct trace *tr, const struct timespec *t) {
+  uint32_t lo, hi, mid;
+
+  /* The first event not before `t` is in [lo, hi] */
+  lo = 0;
+  hi = k->len;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (time_cmp(&tr->events[k->evts[mid]].time, t) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+
+/* documented in header file */
+long long trace_keyed_busy_ns(const struct trace_keyed *k,
+    const struct trace *tr, int len, const struct timespec *from,
+    const struct timespec *to) {
+  const struct timespec *start, *end;
+  long long busy;
+  uint32_t p;
+
+  busy = 0;
+  p = trace_keyed_before(k, tr, from);
+  if (p > 0)
+    p --;  /* may still be running at `from` */
+  for (; p < k->len && k->evts[p] + 1 < (uint32_t) len; p++) {
+    start = &tr->events[k->evts[p]].time;
+    end = &tr->events[k->evts[p] + 1].time;
+    if (time_cmp(start, to) >= 0)
+      break;
+    if (! evt_running(&tr->events[k->evts[p]]))
+      continue;  /* e.g. an activation by the release engine */
+    if (time_cmp(start, from) < 0)
+      start = from;
+    if (time_cmp(end, to) > 0)
+      end = to;
+    if (time_cmp(end, start) > 0)
+      busy += time_diff_ns(end, start);
+  }
+  return busy;
+}
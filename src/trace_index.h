@@ -0,0 +1,99 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * This module implements the indices of a trace by task and by resource: for
+ * each of them, the positions of its events in the trace, in time order.
+ *
+ * Questions about a single task (its busy time in a window, the event at a
+ * given time, ...) then look at its own events only, found by binary search,
+ * rather than scanning the events of all tasks, which are interleaved.
+ *
+ * Positions are 32-bit, so an index takes 8 bytes per event. The reader of a
+ * trace extends its index incrementally up to the committed length (e.g. that
+ * of a trace_snap), so recording is not slowed down: events before `len`
+ * never change, and neither do their positions. A trace that got shorter
+ * (rewound) is indexed again.
+ */
+
+#ifndef __TRACE_INDEX_H__
+#define __TRACE_INDEX_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "trace.h"
+
+
+/* Initial number of positions of a task or resource */
+#ifndef TRACE_INDEX_MIN
+#define TRACE_INDEX_MIN 64
+#endif
+
+/** The positions of the events of a task, or of a resource */
+struct trace_keyed {
+  uint32_t *evts;       /* positions in the trace, in time order */
+  uint32_t len;
+  uint32_t size;        /* allocated positions */
+};
+
+struct trace_index {
+  struct trace_keyed *by_task;  /* `tasks + 1` entries, idle first */
+  int tasks;
+  struct trace_keyed *by_res;   /* `res_count` entries, grown as needed */
+  int res_count;
+  int upto;             /* events indexed so far */
+};
+
+
+/** Initialize an empty index of a trace of `tasks` tasks */
+void trace_index_init(struct trace_index *idx, int tasks);
+
+/** Free the positions of the index */
+void trace_index_free(struct trace_index *idx);
+
+/**
+ * Index the events of `tr` not indexed yet, up to (excluded) `len`, which
+ * must not exceed the committed length. Return false if out of memory: the
+ * events indexed so far stay so.
+ */
+bool trace_index_update(struct trace_index *idx, const struct trace *tr,
+    int len);
+
+/** Return the events of `task` (-1 for idle) */
+const struct trace_keyed *trace_index_task(const struct trace_index *idx,
+    int task);
+
+/** Return the events using resource `res` (0 for none) */
+const struct trace_keyed *trace_index_res(const struct trace_index *idx,
+    int res);
+
+/** Return how many of the events of `k` start before `t` */
+uint32_t trace_keyed_before(const struct trace_keyed *k,
+    const struct trace *tr, const struct timespec *t);
+
+/**
+ * Return the time [ns] the events of `k` ran within [`from`, `to`): only
+ * those of a running job count (see evt_running), and only if ended within
+ * the first `len` of the trace. An event ends where the next one starts.
+ */
+long long trace_keyed_busy_ns(const struct trace_keyed *k,
+    const struct trace *tr, int len, const struct timespec *from,
+    const struct timespec *to);
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ * Copyright 2015 Davide Kirchner
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * scheduletrace-view: watch a run of scheduletrace live, from another
+ * process, through the shared-memory ring it publishes with --shm (see
+ * shmring.h).
+ *
+ * The viewer keeps a replica of the recorded taskset: a thread copies the
+ * new events of the ring to the replica's trace every VIEW_PERIOD ms, under
+ * the taskset lock as the recorder's tasks do, and accounts the statistics
+ * the events carry (release latency, response times and deadline misses).
+ * The usual GUI draws the replica, at normal priority.
+ *
+ * The viewer may be started before the recorder, which it waits for, and
+ * stopped and restarted at any time: the recorder never notices.
+ *
+ * Usage: scheduletrace-view [OPTIONS] NAME
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common.h"
+#include "../taskset.h"
+#include "../shmring.h"
+#include "../logger.h"
+#include "../gui.h"
+
+
+/* Period of the replica thread [ms] */
+#ifndef VIEW_PERIOD
+#define VIEW_PERIOD 10
+#endif
+
+/* Period of the attempts to attach to the ring [ms] */
+#ifndef VIEW_ATTACH_PERIOD
+#define VIEW_ATTACH_PERIOD 500
+#endif
+
+/* Long options without a short equivalent */
+#define MAX_FPS 256
+#define RES_LANES 257
+
+struct replica {
+  struct shmring *ring;
+  struct taskset *ts;
+  unsigned long long read;      /* events of the ring copied so far */
+  unsigned long long lost;      /* events overwritten before being copied */
+  volatile bool quit;
+  pthread_t tid;
+};
+
+
+static void help(const char *cmd_name) {
+  printf("\
+Usage: %s [OPTIONS] NAME\n\
+Watch live the run of scheduletrace publishing its trace to the shared-\n\
+memory segment NAME (see its --shm option). Waits for the recorder if it\n\
+has not started yet.\n\
+\n\
+  -h, --help            Display this help and exit.\n\
+  -v, --verbose         Verbose output.\n\
+  -q, --quiet           Quiet mode: will only log warnings and fatal errors.\n\
+  -W, --width=NUM       Set window width to NUM.\n\
+  -H, --height=NUM      Set window height to NUM.\n\
+      --max-fps=NUM     Redraw the window at most NUM times per second\n\
+                        (default: %d).\n\
+      --resource-lanes  Show a lane per resource (key L toggles it).\n\
+", cmd_name, GUI_DEFAULT_MAX_FPS);
+}
+
+
+/** Populate the options used by the GUI, parsing the command line */
+static const char *options_init(int argc, char **argv) {
+  int c;
+  struct option long_options[] = {
+    {"help", no_argument, NULL, 'h'},
+    {"verbose", no_argument, NULL, 'v'},
+    {"quiet", no_argument, NULL, 'q'},
+    {"width", required_argument, NULL, 'W'},
+    {"height", required_argument, NULL, 'H'},
+    {"max-fps", required_argument, NULL, MAX_FPS},
+    {"resource-lanes", no_argument, NULL, RES_LANES},
+    {NULL, 0, NULL, 0}
+  };
+
+  options.verbosity = LOG_INFO;
+  options.logfile = stderr;
+  options.logfile_sync = false;
+  options.tracefile = NULL;
+  options.gui_w = GUI_DEFAULT_W;
+  options.gui_h = GUI_DEFAULT_H;
+  options.gui_max_fps = GUI_DEFAULT_MAX_FPS;
+  options.gui_res_lanes = false;
+
+  while ((c = getopt_long(argc, argv, "hvqW:H:", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'h':
+        help(argv[0]);
+        exit(0);
+      case 'v':
+        options.verbosity = LOG_DEBUG;
+        break;
+      case 'q':
+        options.verbosity = LOG_WARNING;
+        break;
+      case 'W':
+        options.gui_w = atoi(optarg);
+        break;
+      case 'H':
+        options.gui_h = atoi(optarg);
+        break;
+      case MAX_FPS:
+        options.gui_max_fps = atoi(optarg);
+        if (options.gui_max_fps <= 0) {
+          printf("Invalid frame rate: %s\n", optarg);
+          exit(1);
+        }
+        break;
+      case RES_LANES:
+        options.gui_res_lanes = true;
+        break;
+      default:
+        help(argv[0]);
+        exit(1);
+    }
+  }
+
+  if (optind != argc - 1) {
+    help(argv[0]);
+    exit(1);
+  }
+  return argv[optind];
+}
+
+
+/** Account the statistics carried by a (complete) event */
+static void replica_account(struct taskset *ts, const struct trace_evt *evt) {
+  struct task *task;
+
+  if (evt->task < 0 || evt->task >= ts->tasks_count)
+    return;
+
+  task = &ts->tasks[evt->task];
+  switch (evt->type) {
+    case EVT_ACTIVATION:
+      histogram_record(&task->hist_latency, evt->arg);
+      break;
+    case EVT_DEADLINE:
+      task->dmiss ++;
+      break;
+    case EVT_COMPLETION:
+      histogram_record(&task->hist_response, evt->arg);
+      task->jobs ++;
+      break;
+  }
+}
+
+
+/** Copy the updates of the ring to the replica */
+static void replica_update(struct replica *r) {
+  struct taskset *ts = r->ts;
+  struct trace *trace = &ts->trace;
+  struct shmring_snap snap;
+  unsigned long long to, n, lost;
+  int i;
+
+  shmring_snapshot(r->ring, &snap);
+
+  taskset_lock(ts);
+
+  /* The trace keeps a slot for the current event */
+  to = snap.head;
+  if (to - r->read > trace->size - 1 - trace->len)
+    to = r->read + (trace->size - 1 - trace->len);
+
+  n = to - r->read;
+  lost = shmring_read(r->ring, r->read, to, &trace->events[trace->len]);
+  if (lost > 0) {
+    memmove(&trace->events[trace->len], &trace->events[trace->len + lost],
+        (n - lost) * sizeof(struct trace_evt));
+    n -= lost;
+    r->lost += lost;
+    printf_log(LOG_WARNING, "%llu events overwritten before being read.\n",
+        lost);
+  }
+  for (i = trace->len; i < trace->len + n; i++)
+    replica_account(ts, &trace->events[i]);
+  trace->len += n;
+  r->read = to;
+  trace->events[trace->len] = snap.cur;
+
+  ts->t0 = snap.t0;
+  ts->activated = (snap.state >= SHMRING_RUNNING);
+  ts->stopped = (snap.state >= SHMRING_QUITTING);
+  for (i = 0; i < ts->tasks_count; i++)
+    ts->tasks[i].done = (snap.state == SHMRING_STOPPED);
+
+  taskset_unlock(ts);
+}
+
+
+static void *replica_thread(void *arg) {
+  struct replica *r = arg;
+  struct timespec period;
+
+  pthread_setname_np(pthread_self(), "replica");
+  logger_thread_init("replica");
+
+  period.tv_sec = 0;
+  period.tv_nsec = VIEW_PERIOD * 1000000L;
+  while (! r->quit) {
+    replica_update(r);
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &period, NULL);
+  }
+
+  logger_thread_exit();
+  return NULL;
+}
+
+
+/** Attach to the ring `name`, waiting for it to be created */
+static struct shmring *attach(const char *name) {
+  struct shmring *ring;
+  struct timespec period;
+
+  period.tv_sec = VIEW_ATTACH_PERIOD / 1000;
+  period.tv_nsec = (VIEW_ATTACH_PERIOD % 1000) * 1000000L;
+
+  ring = shmring_attach(name);
+  if (ring == NULL)
+    printf_log(LOG_INFO, "Waiting for the event ring %s...\n", name);
+  while (ring == NULL) {
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &period, NULL);
+    ring = shmring_attach(name);
+  }
+  return ring;
+}
+
+
+int main(int argc, char **argv) {
+  struct taskset ts;
+  struct replica r;
+  const char *name;
+  int s;
+
+  name = options_init(argc, argv);
+  logger_start();
+
+  r.ring = attach(name);
+  if (shmring_taskset(r.ring, &ts) < 0) {
+    printf_log(LOG_ERROR, "The event ring %s describes no tasks.\n", name);
+    exit(1);
+  }
+  printf_log(LOG_INFO, "Attached to %s: %d tasks.\n", name, ts.tasks_count);
+
+  r.ts = &ts;
+  r.read = 0;
+  r.lost = 0;
+  r.quit = false;
+  replica_update(&r);
+  s = pthread_create(&r.tid, NULL, replica_thread, &r);
+  if (s) {
+    printf_log_perror(LOG_ERROR, s, "pthread_create returned error: ");
+    exit(1);
+  }
+
+  gui_view(&ts);
+
+  r.quit = true;
+  run_assert(0 == pthread_join(r.tid, NULL));
+  shmring_detach(r.ring);
+  if (r.lost > 0)
+    printf_log(LOG_WARNING, "%llu events were lost.\n", r.lost);
+
+  printf_log(LOG_INFO, "Detached from %s.\n", name);
+  return 0;
+}